@@ -0,0 +1,239 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "CaseInsensitiveSearch.h"
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    inline bool IsAsciiLetter(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    inline char FoldCase(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+    }
+
+    //a byte to look for at a fixed offset into each candidate.  letters are compared with 0x20 or'd in, which maps both cases (and only those) to lowercase.
+    struct ProbeByte
+    {
+        explicit ProbeByte(char c) : Value(IsAsciiLetter(c) ? FoldCase(c) : c), Mask(IsAsciiLetter(c) ? 0x20 : 0)
+        {
+        }
+
+        inline bool Matches(char c) const
+        {
+            return (char)(c | Mask) == Value;
+        }
+
+        char Value;
+        char Mask;
+    };
+
+    //the search for one needle.  candidates are positions where both the first and last bytes match, and only those get the full comparison.
+    class Searcher
+    {
+    public:
+        explicit Searcher(std::string_view needle) : needle(needle), first(needle.front()), last(needle.back())
+        {
+            hasLetters = std::any_of(needle.begin(), needle.end(), IsAsciiLetter);
+        }
+
+        inline bool IsMatchAt(const char *candidate) const
+        {
+            //the first and last bytes were already checked
+            if (needle.size() <= 2)
+                return true;
+            if (!hasLetters)
+                return memcmp(candidate + 1, needle.data() + 1, needle.size() - 2) == 0;
+
+            for (size_t i = 1; i < needle.size() - 1; ++i)
+            {
+                if (FoldCase(candidate[i]) != FoldCase(needle[i]))
+                    return false;
+            }
+
+            return true;
+        }
+
+        size_t FindScalar(std::string_view haystack, size_t start) const
+        {
+            const char *data = haystack.data();
+            size_t lastStart = haystack.size() - needle.size();
+            for (size_t pos = start; pos <= lastStart; ++pos)
+            {
+                if (first.Matches(data[pos]) && last.Matches(data[pos + needle.size() - 1]) && IsMatchAt(data + pos))
+                    return pos;
+            }
+
+            return std::string_view::npos;
+        }
+
+        size_t Find(std::string_view haystack) const
+        {
+            size_t pos = 0;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+            //test 16 candidate positions at a time, comparing a block at the start of each candidate and another block at the end
+            const char *data = haystack.data();
+            size_t lastOffset = needle.size() - 1;
+            const __m128i firstValue = _mm_set1_epi8(first.Value);
+            const __m128i firstMask = _mm_set1_epi8(first.Mask);
+            const __m128i lastValue = _mm_set1_epi8(last.Value);
+            const __m128i lastMask = _mm_set1_epi8(last.Mask);
+
+            for (; pos + 16 + lastOffset <= haystack.size(); pos += 16)
+            {
+                __m128i firstBlock = _mm_loadu_si128((const __m128i*)(data + pos));
+                __m128i lastBlock = _mm_loadu_si128((const __m128i*)(data + pos + lastOffset));
+                __m128i firstEqual = _mm_cmpeq_epi8(_mm_or_si128(firstBlock, firstMask), firstValue);
+                __m128i lastEqual = _mm_cmpeq_epi8(_mm_or_si128(lastBlock, lastMask), lastValue);
+
+                for (uint32_t candidates = (uint32_t)_mm_movemask_epi8(_mm_and_si128(firstEqual, lastEqual)); candidates != 0; candidates &= candidates - 1)
+                {
+                    size_t candidate = pos + std::countr_zero(candidates);
+                    if (IsMatchAt(data + candidate))
+                        return candidate;
+                }
+            }
+#endif
+
+            //whatever is left over is too short for a full block
+            return FindScalar(haystack, pos);
+        }
+
+    private:
+        std::string_view needle;
+        ProbeByte first;
+        ProbeByte last;
+        bool hasLetters;
+    };
+
+    //what filtering did before this existed, kept as the reference for verification and benchmarking
+    size_t FindWithStdSearch(std::string_view haystack, std::string_view needle)
+    {
+        auto found = std::search(haystack.begin(), haystack.end(), needle.begin(), needle.end(), [](char c0, char c1) { return std::toupper((unsigned char)c0) == std::toupper((unsigned char)c1); });
+        return found == haystack.end() ? (needle.empty() ? 0 : std::string_view::npos) : (size_t)(found - haystack.begin());
+    }
+
+    //json-ish text with mixed case, symbols that differ from letters only in the case bit, and non-ascii bytes
+    std::string MakeSampleLine(uint32_t &seed, size_t length)
+    {
+        static const char alphabet[] = "aAbBcCxXyYzZ09 ,:\"{}[]@`^~_\x7f\xc3\xa9\xe0";
+        std::string line;
+        line.reserve(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            line.push_back(alphabet[(seed >> 16) % (sizeof(alphabet) - 1)]);
+        }
+
+        return line;
+    }
+}
+
+namespace CaseInsensitiveSearch
+{
+    size_t Find(std::string_view haystack, std::string_view needle)
+    {
+        if (needle.empty())
+            return 0;
+        if (haystack.size() < needle.size())
+            return std::string_view::npos;
+
+        return Searcher(needle).Find(haystack);
+    }
+
+    size_t FindScalar(std::string_view haystack, std::string_view needle)
+    {
+        if (needle.empty())
+            return 0;
+        if (haystack.size() < needle.size())
+            return std::string_view::npos;
+
+        return Searcher(needle).FindScalar(haystack, 0);
+    }
+
+    bool VerifySearch(AppStatusMonitor &monitor)
+    {
+        uint32_t seed = 1;
+        bool allPassed = true;
+        for (int i = 0; i < 2000 && allPassed; ++i)
+        {
+            std::string haystack = MakeSampleLine(seed, seed % 200);
+            std::string needle;
+
+            //mostly take needles from the haystack so there are matches to find, then change their case
+            if (!haystack.empty() && seed % 4 != 0)
+            {
+                size_t start = (seed >> 8) % haystack.size();
+                needle = haystack.substr(start, 1 + (seed >> 4) % 20);
+                for (char &c : needle)
+                {
+                    seed = seed * 1103515245 + 12345;
+                    if ((seed >> 16) & 1)
+                        c = (char)std::toupper((unsigned char)c);
+                }
+            }
+            else
+                needle = MakeSampleLine(seed, 1 + seed % 4);
+
+            size_t expected = FindWithStdSearch(haystack, needle);
+            size_t found = Find(haystack, needle);
+            size_t foundScalar = FindScalar(haystack, needle);
+            if (found != expected || foundScalar != expected)
+            {
+                monitor.AddDebugOutput("Case insensitive search mismatch on \"" + needle + "\": expected " + std::to_string(expected) + " got " + std::to_string(found) + " and " + std::to_string(foundScalar));
+                allPassed = false;
+            }
+        }
+
+        return allPassed;
+    }
+
+    void BenchmarkSearch(AppStatusMonitor &monitor)
+    {
+        int iters = 2000;
+#ifdef _DEBUG
+        iters = 100;
+#endif
+
+        //long raw lines that don't contain the needle, which is the usual case when filtering
+        uint32_t seed = 7;
+        std::vector<std::string> lines;
+        for (int i = 0; i < 16; ++i)
+            lines.emplace_back(MakeSampleLine(seed, 4000));
+        const std::string needle = "RequestComplete";
+
+        size_t checksum = 0;
+        auto tpBegin = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iters; ++i)
+            checksum += Find(lines[i % lines.size()], needle);
+        auto tpSimd = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iters; ++i)
+            checksum += FindScalar(lines[i % lines.size()], needle);
+        auto tpScalar = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iters; ++i)
+            checksum += FindWithStdSearch(lines[i % lines.size()], needle);
+        auto tpStd = std::chrono::high_resolution_clock::now();
+
+        auto nsPerLine = [&](auto begin, auto end) { return std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / (double)iters; };
+
+        std::stringstream ss;
+        ss << "Case insensitive search on 4000 byte lines: vectorized " << nsPerLine(tpBegin, tpSimd) << "ns, scalar " << nsPerLine(tpSimd, tpScalar) << "ns, std::search " << nsPerLine(tpScalar, tpStd) << "ns per line (checksum " << checksum << ")";
+        monitor.AddDebugOutput(ss.str());
+    }
+}
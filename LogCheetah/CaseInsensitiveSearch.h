@@ -0,0 +1,24 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <string_view>
+#include "SharedGlobals.h"
+
+//Substring search that ignores ASCII case, used for the default (match case off) filters and search box.  Only 'a'-'z' and 'A'-'Z' are folded, the same as
+//std::toupper in the "C" locale, so any other byte (including UTF-8 sequences) has to match exactly.
+namespace CaseInsensitiveSearch
+{
+    //returns the position of the first match of needle in haystack, or npos.  an empty needle matches at 0.
+    size_t Find(std::string_view haystack, std::string_view needle);
+
+    //the same search one byte at a time, without SIMD
+    size_t FindScalar(std::string_view haystack, std::string_view needle);
+
+    //checks the search against a plain std::search on generated text, reporting any mismatches.  returns true if everything matched.
+    bool VerifySearch(AppStatusMonitor &monitor);
+
+    //times the search against std::search with a toupper comparison on long lines, and reports the results
+    void BenchmarkSearch(AppStatusMonitor &monitor);
+}
@@ -0,0 +1,117 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "ConcurrentColumnRegistry.h"
+#include <algorithm>
+#include <functional>
+
+ConcurrentColumnRegistry::ConcurrentColumnRegistry(size_t maxColumns) : maxEntries(maxColumns)
+{
+    //keep the table at most half full so probe sequences stay short
+    size_t slotCount = 16;
+    while (slotCount < maxColumns * 2)
+        slotCount *= 2;
+
+    slotMask = slotCount - 1;
+    slots.reset(new std::atomic<Entry*>[slotCount]);
+    for (size_t i = 0; i < slotCount; ++i)
+        slots[i].store(nullptr, std::memory_order_relaxed);
+}
+
+ConcurrentColumnRegistry::~ConcurrentColumnRegistry()
+{
+    for (size_t i = 0; i <= slotMask; ++i)
+        delete slots[i].load(std::memory_order_relaxed);
+}
+
+uint32_t ConcurrentColumnRegistry::FindOrAdd(std::string_view name, uint64_t firstSeenOrder, uint32_t flags)
+{
+    size_t hash = std::hash<std::string_view>()(name);
+    Entry *newEntry = nullptr;
+
+    for (size_t probe = hash & slotMask; ; probe = (probe + 1) & slotMask)
+    {
+        Entry *existing = slots[probe].load(std::memory_order_acquire);
+
+        if (!existing)
+        {
+            //try to claim the empty slot for this name
+            if (!newEntry)
+            {
+                if (count.load(std::memory_order_relaxed) >= maxEntries)
+                    return InvalidIndex;
+
+                uint32_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+                if (index >= maxEntries)
+                    return InvalidIndex;
+
+                newEntry = new Entry { std::string(name), hash, index, { firstSeenOrder }, { flags } };
+            }
+
+            if (slots[probe].compare_exchange_strong(existing, newEntry, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                count.fetch_add(1, std::memory_order_relaxed);
+                if (firstSeenOrder != NotSeen)
+                    seenCount.fetch_add(1, std::memory_order_relaxed);
+                return newEntry->Index;
+            }
+
+            //someone else got there first, existing now holds what they put there
+        }
+
+        if (existing->Hash == hash && existing->Name == name)
+        {
+            //another thread may have won the race to add this name, in which case our index is just left unused
+            delete newEntry;
+
+            //only write when something changes, so repeat lookups stay read-only
+            uint64_t seen = existing->FirstSeen.load(std::memory_order_relaxed);
+            while (firstSeenOrder < seen)
+            {
+                if (existing->FirstSeen.compare_exchange_weak(seen, firstSeenOrder, std::memory_order_relaxed))
+                {
+                    if (seen == NotSeen)
+                        seenCount.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+
+            if ((existing->Flags.load(std::memory_order_relaxed) & flags) != flags)
+                existing->Flags.fetch_or(flags, std::memory_order_relaxed);
+
+            return existing->Index;
+        }
+    }
+}
+
+std::vector<ConcurrentColumnRegistry::Column> ConcurrentColumnRegistry::Finalize(std::vector<uint16_t> &provisionalToFinal) const
+{
+    std::vector<const Entry*> entries;
+    entries.reserve(count.load());
+    for (size_t i = 0; i <= slotMask; ++i)
+    {
+        const Entry *e = slots[i].load(std::memory_order_acquire);
+        if (e && e->FirstSeen.load(std::memory_order_relaxed) != NotSeen)
+            entries.push_back(e);
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry *a, const Entry *b)
+    {
+        uint64_t aSeen = a->FirstSeen.load(std::memory_order_relaxed);
+        uint64_t bSeen = b->FirstSeen.load(std::memory_order_relaxed);
+        if (aSeen != bSeen)
+            return aSeen < bSeen;
+        return a->Index < b->Index;
+    });
+
+    std::vector<Column> columns;
+    columns.reserve(entries.size());
+    provisionalToFinal.assign(std::min<size_t>(nextIndex.load(), maxEntries), 0);
+    for (const Entry *e : entries)
+    {
+        provisionalToFinal[e->Index] = (uint16_t)columns.size();
+        columns.push_back({ e->Name, e->Flags.load(std::memory_order_relaxed) });
+    }
+
+    return std::move(columns);
+}
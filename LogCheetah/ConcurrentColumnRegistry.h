@@ -0,0 +1,66 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+//Maps column names to column indices from many threads at once.  Lookups never lock or copy, and new names are published with a single
+//compare-exchange into an open-addressed table, so an index never changes once handed out.
+//The indices handed out while parsing are provisional since their order depends on thread timing.  Once all threads are done, Finalize
+//orders the columns by where they were first seen in the input, which is the same regardless of how the work was split up.
+//Names can also be preloaded before parsing starts (such as from a saved schema), so the common case of finding an existing name never writes to shared memory.
+class ConcurrentColumnRegistry
+{
+public:
+    static const uint32_t InvalidIndex = 0xffffffff;
+    static const uint64_t NotSeen = 0xffffffffffffffff;
+
+    //what Finalize reports about each column that was seen
+    struct Column
+    {
+        std::string Name;
+        uint32_t Flags;
+    };
+
+    ConcurrentColumnRegistry(size_t maxColumns);
+    ~ConcurrentColumnRegistry();
+
+    ConcurrentColumnRegistry(const ConcurrentColumnRegistry&) = delete;
+    ConcurrentColumnRegistry& operator=(const ConcurrentColumnRegistry&) = delete;
+
+    //returns the provisional index of the name, adding it if needed.  firstSeenOrder should increase with the position in the input the name was seen at.
+    //flags are caller defined bits that are or'd into whatever has been recorded for the name.  returns InvalidIndex if the registry is full.
+    uint32_t FindOrAdd(std::string_view name, uint64_t firstSeenOrder, uint32_t flags = 0);
+
+    //adds a name that may or may not show up in the input.  it only makes it into Finalize's results if it's later seen with FindOrAdd.
+    inline void Preload(std::string_view name, uint32_t flags) { FindOrAdd(name, NotSeen, flags); }
+
+    //number of distinct names seen so far, not counting preloaded names that haven't been seen
+    inline size_t Size() const { return seenCount.load(std::memory_order_relaxed); }
+
+    //must only be called once no other threads are using the registry.  returns the seen names in their final order, and fills provisionalToFinal so it can be indexed by provisional index.
+    std::vector<Column> Finalize(std::vector<uint16_t> &provisionalToFinal) const;
+
+private:
+    struct Entry
+    {
+        std::string Name;
+        size_t Hash;
+        uint32_t Index;
+        std::atomic<uint64_t> FirstSeen;
+        std::atomic<uint32_t> Flags;
+    };
+
+    size_t maxEntries;
+    size_t slotMask;
+    std::unique_ptr<std::atomic<Entry*>[]> slots;
+    std::atomic<uint32_t> nextIndex { 0 };
+    std::atomic<size_t> count { 0 };
+    std::atomic<size_t> seenCount { 0 };
+};
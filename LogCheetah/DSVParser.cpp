@@ -4,7 +4,15 @@
 #include "DSVParser.h"
 #include "SharedGlobals.h"
 #include "StringUtils.h"
+#include "ThreadPool.h"
+#include "TimestampParser.h"
 #include <cctype>
+#include <cstring>
+#include <bit>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace
 {
@@ -133,13 +141,296 @@ namespace
         }
     }
 
+    //per-thread scratch space and results for parsing dsv body lines
+    struct DSVLineParseState
+    {
+        std::vector<LogEntryColumn> ColumnData;
+        std::vector<uint32_t> FieldEnds;
+        int DummyColumnMax = 0;
+        size_t TruncatedLines = 0;
+    };
+
+    //parses a single body line against the columns declared by the header, one character at a time.  this defines the behavior the vectorized version must match.
+    void ParseDSVLineScalar(const std::string &rawString, char deliminator, size_t headerColumnCount, DSVLineParseState &state, LogEntry &outEntry)
+    {
+        bool parseFailed = false;
+        uint16_t colIndex = 0;
+        bool inQuotedField = false;
+        bool doneWithColumnData = false;
+        bool allowQuotedField = true;
+
+        state.ColumnData.clear();
+        state.ColumnData.emplace_back();
+        state.ColumnData.back().ColumnNumber = colIndex;
+        state.ColumnData.back().IndexDataBegin = 0;
+        state.ColumnData.back().IndexDataEnd = 0;
+
+        for (int i = 0; i < rawString.size(); ++i)
+        {
+            char c = rawString[i];
+
+            bool changeColumn = false;
+            if (c == '"')
+            {
+                if (allowQuotedField && !inQuotedField)
+                {
+                    inQuotedField = true;
+                    state.ColumnData.back().IndexDataBegin = i + 1;
+                    state.ColumnData.back().IndexDataEnd = i + 1;
+                }
+                else if (inQuotedField)
+                {
+                    if (i + 1 < rawString.size() && rawString[i + 1] == '"') //walk past escape sequence
+                        ++i;
+                    else
+                    {
+                        inQuotedField = false;
+                        doneWithColumnData = true;
+                    }
+                }
+            }
+            else if (!inQuotedField && c == deliminator)
+                changeColumn = true;
+            else if (!doneWithColumnData)
+            {
+                allowQuotedField = false;
+                state.ColumnData.back().IndexDataEnd = i + 1;
+            }
+
+            if (changeColumn)
+            {
+                if (state.ColumnData.back().IndexDataBegin == state.ColumnData.back().IndexDataEnd) //discard empty columns
+                    state.ColumnData.pop_back();
+
+                state.ColumnData.emplace_back();
+
+                if (state.ColumnData.size() > headerColumnCount)
+                {
+                    if (state.ColumnData.size() > state.DummyColumnMax)
+                        state.DummyColumnMax = (int)state.ColumnData.size();
+                }
+
+                doneWithColumnData = false;
+                allowQuotedField = true;
+                ++colIndex;
+
+                state.ColumnData.back().ColumnNumber = colIndex;
+                state.ColumnData.back().IndexDataBegin = i + 1;
+                state.ColumnData.back().IndexDataEnd = i + 1;
+            }
+
+            if (i >= MaxLogEntryDataIndex - 2)
+            {
+                parseFailed = true;
+                ++state.TruncatedLines;
+                break;
+            }
+        }
+
+        if (headerColumnCount != 0 && colIndex + 1 != headerColumnCount)
+            parseFailed = true;
+
+        if (state.DummyColumnMax < colIndex)
+            state.DummyColumnMax = colIndex;
+
+        if (!state.ColumnData.empty() && state.ColumnData.back().IndexDataBegin == state.ColumnData.back().IndexDataEnd) //discard empty columns
+            state.ColumnData.pop_back();
+
+        outEntry.Set(rawString, std::string(), state.ColumnData, std::vector<LogEntryColumn>());
+        outEntry.ParseFailed = parseFailed;
+    }
+
+    //finds delimiters and quotes in a 64 byte block, returning a bit per byte for each.  bytes past count are treated as neither.
+    template<char Deliminator>
+    inline void FindDSVSymbols(const char *block, size_t count, uint64_t &outDelims, uint64_t &outQuotes)
+    {
+        alignas(16) char padded[64];
+        if (count < 64)
+        {
+            memset(padded, 0, sizeof(padded));
+            memcpy(padded, block, count);
+            block = padded;
+        }
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+        const __m128i delimVec = _mm_set1_epi8(Deliminator);
+        const __m128i quoteVec = _mm_set1_epi8('"');
+
+        outDelims = 0;
+        outQuotes = 0;
+        for (int part = 0; part < 4; ++part)
+        {
+            __m128i data = _mm_loadu_si128((const __m128i*)(block + part * 16));
+            outDelims |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(data, delimVec)) << (part * 16);
+            outQuotes |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(data, quoteVec)) << (part * 16);
+        }
+#else
+        outDelims = 0;
+        outQuotes = 0;
+        for (int i = 0; i < 64; ++i)
+        {
+            outDelims |= (uint64_t)(block[i] == Deliminator) << i;
+            outQuotes |= (uint64_t)(block[i] == '"') << i;
+        }
+#endif
+    }
+
+    //each bit becomes the xor of itself and all lower bits, which turns quote positions into a mask of the bytes between quote pairs
+    inline uint64_t PrefixXor(uint64_t bits)
+    {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    //finds the delimiters that end each field of a line.  returns false if the line has a quote that doesn't start a field, since the scalar parser
+    //ignores those rather than treating them as the start of a quoted region, and the quote mask would disagree with it.
+    template<char Deliminator>
+    bool FindDSVFieldEnds(const std::string &rawString, std::vector<uint32_t> &outFieldEnds)
+    {
+        outFieldEnds.clear();
+
+        uint64_t insideCarry = 0; //all ones if the previous block ended inside quotes
+        uint64_t prevStartsField = 1; //whether the byte before the block allows a quote to open a field
+        for (size_t blockStart = 0; blockStart < rawString.size(); blockStart += 64)
+        {
+            uint64_t delims, quotes;
+            FindDSVSymbols<Deliminator>(rawString.data() + blockStart, std::min<size_t>(64, rawString.size() - blockStart), delims, quotes);
+
+            //inside includes opening quotes but not closing ones.  an escaped quote inside a quoted field closes and immediately reopens, which nets out the same.
+            uint64_t inside = PrefixXor(quotes) ^ insideCarry;
+            insideCarry = (uint64_t)((int64_t)inside >> 63);
+
+            uint64_t opening = quotes & inside;
+            uint64_t startsField = ((delims | quotes) << 1) | prevStartsField;
+            prevStartsField = (delims | quotes) >> 63;
+            if (opening & ~startsField)
+                return false;
+
+            uint64_t fieldEnds = delims & ~inside;
+            while (fieldEnds)
+            {
+                outFieldEnds.push_back((uint32_t)(blockStart + std::countr_zero(fieldEnds)));
+                fieldEnds &= fieldEnds - 1;
+            }
+        }
+
+        return true;
+    }
+
+    //parses a single body line using the vectorized field scan, falling back to the scalar parser for lines it can't handle
+    template<char Deliminator>
+    void ParseDSVLineVectorized(const std::string &rawString, char deliminator, size_t headerColumnCount, DSVLineParseState &state, LogEntry &outEntry)
+    {
+        if (rawString.size() >= MaxLogEntryDataIndex - 2 || !FindDSVFieldEnds<Deliminator>(rawString, state.FieldEnds))
+        {
+            ParseDSVLineScalar(rawString, Deliminator, headerColumnCount, state, outEntry);
+            return;
+        }
+
+        bool hasQuotes = rawString.find('"') != std::string::npos;
+
+        state.ColumnData.clear();
+        uint16_t colIndex = 0;
+        size_t fieldStart = 0;
+        for (size_t field = 0; field <= state.FieldEnds.size(); ++field)
+        {
+            size_t fieldEnd = field < state.FieldEnds.size() ? state.FieldEnds[field] : rawString.size();
+
+            //only fields containing quotes need walking, the rest are just the bytes between delimiters
+            size_t dataBegin = fieldStart;
+            size_t dataEnd = fieldEnd;
+            if (hasQuotes && memchr(rawString.data() + fieldStart, '"', fieldEnd - fieldStart))
+            {
+                bool inQuotedField = false;
+                bool doneWithColumnData = false;
+                bool allowQuotedField = true;
+                dataEnd = fieldStart;
+
+                for (size_t i = fieldStart; i < fieldEnd; ++i)
+                {
+                    if (rawString[i] == '"')
+                    {
+                        if (allowQuotedField && !inQuotedField)
+                        {
+                            inQuotedField = true;
+                            dataBegin = dataEnd = i + 1;
+                        }
+                        else if (inQuotedField)
+                        {
+                            if (i + 1 < fieldEnd && rawString[i + 1] == '"') //walk past escape sequence
+                                ++i;
+                            else
+                            {
+                                inQuotedField = false;
+                                doneWithColumnData = true;
+                            }
+                        }
+                    }
+                    else if (!doneWithColumnData)
+                    {
+                        allowQuotedField = false;
+                        dataEnd = i + 1;
+                    }
+                }
+            }
+
+            if (dataBegin != dataEnd) //discard empty columns
+                state.ColumnData.emplace_back(colIndex, (uint32_t)dataBegin, (uint32_t)dataEnd);
+
+            if (field < state.FieldEnds.size())
+            {
+                //account for the column the delimiter starts, the same way the scalar parser does
+                size_t startedColumnCount = state.ColumnData.size() + 1;
+                if (startedColumnCount > headerColumnCount && startedColumnCount > (size_t)state.DummyColumnMax)
+                    state.DummyColumnMax = (int)startedColumnCount;
+
+                ++colIndex;
+            }
+
+            fieldStart = fieldEnd + 1;
+        }
+
+        bool parseFailed = headerColumnCount != 0 && colIndex + 1 != headerColumnCount;
+
+        if (state.DummyColumnMax < colIndex)
+            state.DummyColumnMax = colIndex;
+
+        outEntry.Set(rawString, std::string(), state.ColumnData, std::vector<LogEntryColumn>());
+        outEntry.ParseFailed = parseFailed;
+    }
+
+    typedef void (*DSVLineParser)(const std::string &rawString, char deliminator, size_t headerColumnCount, DSVLineParseState &state, LogEntry &outEntry);
+
+    //common delimiters get a version of the parser with the delimiter baked in
+    DSVLineParser SelectDSVLineParser(char deliminator)
+    {
+        switch (deliminator)
+        {
+        case ',':
+            return ParseDSVLineVectorized<','>;
+        case '\t':
+            return ParseDSVLineVectorized<'\t'>;
+        case '|':
+            return ParseDSVLineVectorized<'|'>;
+        case ' ':
+            return ParseDSVLineVectorized<' '>;
+        default:
+            return ParseDSVLineScalar;
+        }
+    }
+
     void DoParseDSVLogsBody(AppStatusMonitor &monitor, LogCollection &logs, std::vector<std::string> &allLines, char deliminator, bool parseHeader, uint64_t &nextLine)
     {
         //determine which column is the special Date column, if any
         auto dateColumn = FindSortColumn(logs.Columns.begin(), logs.Columns.end(), [](auto ci) {return ci->UniqueName; });
 
         if (dateColumn != logs.Columns.end())
-            logs.SortColumn = (uint16_t)(dateColumn - logs.Columns.begin());
+            logs.SortOrder = { LogSortEntry { (uint16_t)(dateColumn - logs.Columns.begin()) } };
 
         //prevent duplicate column names and handle empty column names
         for (size_t o = 0; o < logs.Columns.size(); ++o)
@@ -169,118 +460,72 @@ namespace
             }
         }
 
-        //parse the lines
-        if (nextLine < allLines.size())
-            logs.Lines.reserve(allLines.size() - nextLine);
-
-        int dummyColumnMax = 0;
-        std::vector<LogEntryColumn> columnDataOrig;
-
-        for (; nextLine < allLines.size(); ++nextLine)
+        //find where this section ends.  when parsing headers a comment starts a new section, otherwise comments are just skipped.
+        uint64_t bodyBegin = nextLine;
+        uint64_t bodyEnd = allLines.size();
+        if (parseHeader)
         {
-            if (monitor.IsCancelling())
-                break;
-
-            monitor.AddProgress(1);
-
-            std::string &rawString = allLines[nextLine];
-            if (!rawString.empty() && rawString[0] == '#')
+            for (bodyEnd = bodyBegin; bodyEnd < allLines.size(); ++bodyEnd)
             {
-                //if we hit a comment and we are parsing headers completely bail, otherwise just skip the comment
-                if (parseHeader)
+                if (!allLines[bodyEnd].empty() && allLines[bodyEnd][0] == '#')
                     break;
-                else
-                    continue;
             }
+        }
 
-            bool parseFailed = false;
-            uint16_t colIndex = 0;
-            bool inQuotedField = false;
-            bool doneWithColumnData = false;
-            bool allowQuotedField = true;
-
-            columnDataOrig.clear();
-            columnDataOrig.emplace_back();
-            columnDataOrig.back().ColumnNumber = colIndex;
-            columnDataOrig.back().IndexDataBegin = 0;
-            columnDataOrig.back().IndexDataEnd = 0;
-
-            for (int i = 0; i < rawString.size(); ++i)
-            {
-                char c = rawString[i];
-
-                bool changeColumn = false;
-                if (c == '"')
-                {
-                    if (allowQuotedField && !inQuotedField)
-                    {
-                        inQuotedField = true;
-                        columnDataOrig.back().IndexDataBegin = i + 1;
-                        columnDataOrig.back().IndexDataEnd = i + 1;
-                    }
-                    else if (inQuotedField)
-                    {
-                        if (i + 1 < rawString.size() && rawString[i + 1] == '"') //walk past escape sequence
-                            ++i;
-                        else
-                        {
-                            inQuotedField = false;
-                            doneWithColumnData = true;
-                        }
-                    }
-                }
-                else if (!inQuotedField && c == deliminator)
-                    changeColumn = true;
-                else if (!doneWithColumnData)
-                {
-                    allowQuotedField = false;
-                    columnDataOrig.back().IndexDataEnd = i + 1;
-                }
-
-                if (changeColumn)
-                {
-                    if (columnDataOrig.back().IndexDataBegin == columnDataOrig.back().IndexDataEnd) //discard empty columns
-                        columnDataOrig.pop_back();
+        //parse batches of lines in parallel, each into its own partial set of rows.  the input was already split into lines, so batch boundaries are always record boundaries.
+        const size_t batchSize = 4096;
+        size_t batchCount = (size_t)((bodyEnd - bodyBegin + batchSize - 1) / batchSize);
+        size_t threadCount = std::min((size_t)cpuCountParse, batchCount);
 
-                    columnDataOrig.emplace_back();
+        std::vector<std::vector<LogEntry>> partialLines(batchCount);
+        std::vector<DSVLineParseState> threadStates(std::max<size_t>(threadCount, 1));
 
-                    if (columnDataOrig.size() > logs.Columns.size())
-                    {
-                        if (columnDataOrig.size() > dummyColumnMax)
-                            dummyColumnMax = (int)columnDataOrig.size();
-                    }
+        DSVLineParser parseLine = SelectDSVLineParser(deliminator);
+        ParallelFor(monitor, threadCount, (size_t)bodyBegin, (size_t)bodyEnd, batchSize, [&](size_t threadIndex, size_t batchBegin, size_t batchEnd)
+        {
+            DSVLineParseState &state = threadStates[threadIndex];
+            monitor.AddProgress(batchEnd - batchBegin);
 
-                    doneWithColumnData = false;
-                    allowQuotedField = true;
-                    ++colIndex;
+            std::vector<LogEntry> &partial = partialLines[(batchBegin - bodyBegin) / batchSize];
+            partial.reserve(batchEnd - batchBegin);
 
-                    columnDataOrig.back().ColumnNumber = colIndex;
-                    columnDataOrig.back().IndexDataBegin = i + 1;
-                    columnDataOrig.back().IndexDataEnd = i + 1;
-                }
+            for (size_t row = batchBegin; row < batchEnd; ++row)
+            {
+                std::string &rawString = allLines[row];
+                if (!rawString.empty() && rawString[0] == '#') //only reachable when not parsing headers
+                    continue;
 
-                if (i >= MaxLogEntryDataIndex - 2)
-                {
-                    parseFailed = true;
-                    monitor.AddDebugOutput("DSVParser: Line is too long to store and has been truncated.");
-                    break;
-                }
+                partial.emplace_back();
+                parseLine(rawString, deliminator, logs.Columns.size(), state, partial.back());
+                rawString = std::string(); //free old memory now to reduce max memory usage during parsing
             }
+        });
 
-            if (!logs.Columns.empty() && colIndex + 1 != logs.Columns.size())
-                parseFailed = true;
+        nextLine = bodyEnd;
 
-            if (dummyColumnMax < colIndex)
-                dummyColumnMax = colIndex;
+        //merge the partial results back in order
+        size_t totalLines = 0;
+        for (auto &partial : partialLines)
+            totalLines += partial.size();
+        logs.Lines.reserve(logs.Lines.size() + totalLines);
 
-            if (!columnDataOrig.empty() && columnDataOrig.back().IndexDataBegin == columnDataOrig.back().IndexDataEnd) //discard empty columns
-                columnDataOrig.pop_back();
+        for (auto &partial : partialLines)
+        {
+            for (auto &line : partial)
+                logs.Lines.emplace_back(std::move(line));
+        }
 
-            logs.Lines.emplace_back(rawString, std::string(), columnDataOrig, std::vector<LogEntryColumn>());
-            logs.Lines.back().ParseFailed = parseFailed;
-            rawString = std::string(); //free old memory now to reduce max memory usage during parsing
+        int dummyColumnMax = 0;
+        size_t truncatedLines = 0;
+        for (auto &state : threadStates)
+        {
+            dummyColumnMax = std::max(dummyColumnMax, state.DummyColumnMax);
+            truncatedLines += state.TruncatedLines;
         }
 
+        if (truncatedLines)
+            monitor.AddDebugOutput("DSVParser: " + std::to_string(truncatedLines) + " line(s) were too long to store and have been truncated.");
+
         //it's possible for invalid files to have more columns in the data than the header declared, so add dummy columns for those
         for (int i = (int)logs.Columns.size(); i <= dummyColumnMax; ++i)
         {
@@ -313,82 +558,18 @@ namespace
         return std::move(logs);
     }
 
-    bool ParseDateString(const ExternalSubstring<const char> &dateString, int &outYear, int &outMonth, int &outDay, int &outHour, int &outMinute, int &outSecond, int &outMilliseconds)
-    {
-        char *endChar = nullptr;
-
-        //month
-        size_t cur = 0;
-        size_t next = dateString.find('/');
-        if (next == std::string::npos)
-            return false;
-        outMonth = strtol(dateString.begin() + cur, &endChar, 10);
-
-        //day
-        cur = next + 1;
-        next = dateString.find('/', cur);
-        if (next == std::string::npos)
-            return false;
-        outDay = strtol(dateString.begin() + cur, &endChar, 10);
-
-        //year
-        cur = next + 1;
-        next = dateString.find(' ', cur);
-        if (next == std::string::npos)
-            return false;
-        outYear = strtol(dateString.begin() + cur, &endChar, 10);
-
-        //hour
-        cur = next + 1;
-        next = dateString.find(':', cur);
-        if (next == std::string::npos)
-            return false;
-        outHour = strtol(dateString.begin() + cur, &endChar, 10);
-
-        //minute
-        cur = next + 1;
-        next = dateString.find(':', cur);
-        if (next == std::string::npos)
-            return false;
-        outMinute = strtol(dateString.begin() + cur, &endChar, 10);
-
-        //second
-        cur = next + 1;
-        next = dateString.find('.', cur);
-        if (next == std::string::npos) //no milliseconds present, so done
-        {
-            outSecond = strtol(dateString.begin() + cur, &endChar, 10);
-            outMilliseconds = 0;
-            return true;
-        }
-        else
-            outSecond = strtol(dateString.begin() + cur, &endChar, 10);
-
-        //millisecond
-        cur = next + 1;
-        next = dateString.size();
-        if (next - cur <= 0)
-            return false;
-        outMilliseconds = strtol(dateString.begin() + cur, &endChar, 10);
-
-        return true;
-    }
-
     time_t ParseTimeFromDateString(const ExternalSubstring<const char> &date, int &outMilliseconds)
     {
-        std::tm outTime = { 0 };
-        if (ParseDateString(date, outTime.tm_year, outTime.tm_mon, outTime.tm_mday, outTime.tm_hour, outTime.tm_min, outTime.tm_sec, outMilliseconds))
-        {
-            --outTime.tm_mon;
-            outTime.tm_year -= 1900;
+        Timestamp::Components timestamp;
+        if (!Timestamp::ParseUsDateTime(std::string_view(date.begin(), date.size()), timestamp))
+            return 0;
 
-            time_t ret = _mkgmtime(&outTime);
-            if (ret == -1)
-                return 0;
-            return ret;
-        }
+        outMilliseconds = (int)(timestamp.SubsecondTicks / Timestamp::TicksPerMillisecond);
 
-        return 0;
+        int64_t seconds = Timestamp::ToUnixSeconds(timestamp);
+        if (seconds <= 0)
+            return 0;
+        return (time_t)seconds;
     }
 
     time_t ParseTimeFromLine(const ExternalSubstring<const char> &line, int &outMilliseconds)
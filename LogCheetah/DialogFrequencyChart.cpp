@@ -242,6 +242,12 @@ std::shared_ptr<FrequencyChart> ComputeFrequencyChart(const std::vector<uint32_t
     AllInstances.emplace_back(std::make_shared<FrequencyChart>());
     std::shared_ptr<FrequencyChart> fc = AllInstances.back();
 
+    //pulling out deferred columns rewrites rows, so it's done as a write before the crunching
+    GuiStatusManager::ShowBusyDialogAndRunMonitor("Extracting columns", true, [&](GuiStatusMonitor &monitor)
+    {
+        globalLogs.ExtractDeferredColumns(monitor, dataColumns);
+    });
+
     GuiStatusManager::ShowBusyDialogAndRunMonitor("Crunching data", false, [&](GuiStatusMonitor &monitor)
     {
         monitor.SetControlFeatures(true);
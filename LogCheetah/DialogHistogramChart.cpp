@@ -755,6 +755,12 @@ std::shared_ptr<HistogramChart> ComputeHistogramChart(int dataColumn, const std:
     AllInstances.emplace_back(std::make_shared<HistogramChart>());
     std::shared_ptr<HistogramChart> hc = AllInstances.back();
 
+    //pulling out deferred columns rewrites rows, so it's done as a write before the parsing
+    GuiStatusManager::ShowBusyDialogAndRunMonitor("Extracting columns", true, [&](GuiStatusMonitor &monitor)
+    {
+        globalLogs.ExtractDeferredColumns(monitor, std::vector<uint32_t> { (uint32_t)dataColumn });
+    });
+
     GuiStatusManager::ShowBusyDialogAndRunMonitor("Parsing raw values", false, [&](GuiStatusMonitor &monitor)
     {
         monitor.SetControlFeatures(true);
@@ -20,7 +20,7 @@
 void DoLoadLogsFromFileBatchWorker(const std::vector<std::string> &files, std::vector<LogType> fileLogType, bool merge)
 {
     if (!merge)
-        MoveAndLoadLogs(LogCollection(), false); //clear old logs before we start to reduce memory use
+        ClearLogsForNewLoad(); //clear old logs before we start to reduce memory use
 
     //load schema data
     std::vector<std::string> additionalSchemas;
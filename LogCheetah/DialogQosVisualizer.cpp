@@ -10,6 +10,7 @@
 #include "resource.h"
 #include "DebugWindow.h"
 #include "MainLogView.h"
+#include "TimestampParser.h"
 
 #include <Windowsx.h>
 #include <CommCtrl.h>
@@ -903,10 +904,12 @@ namespace
     {
         //Sample timestamp: 2016-07-27T22:56:47.0107862Z
 
-        std::istringstream stream(timestamp);
-        std::chrono::sys_time<std::chrono::milliseconds> tp;
-        std::chrono::from_stream(stream, "%Y-%m-%dT%H:%M:%S%Z", tp);
-        return std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
+        Timestamp::Components components;
+        if (!Timestamp::ParseIso8601(timestamp, components))
+            return 0;
+
+        int64_t ms = Timestamp::ToUnixMilliseconds(components);
+        return ms > 0 ? (uint64_t)ms : 0;
     }
 
     std::shared_ptr<VisualizerWindow> ParseDataAndStuff(const std::vector<uint32_t> &rowsToUse)
@@ -951,6 +954,17 @@ namespace
             std::optional<uint16_t> indexRequestStatus = FindOptionalColumnIndex("data.baseData.requestStatus");
             std::optional<uint16_t> indexCv = FindOptionalColumnIndex("cV");
 
+            std::vector<uint32_t> usedColumns = { indexBaseType, indexSucceeded, indexLatencyMs, indexTimestamp };
+            if (indexRequestStatus.has_value())
+                usedColumns.push_back(indexRequestStatus.value());
+            if (indexCv.has_value())
+                usedColumns.push_back(indexCv.value());
+            {
+                //pulling out deferred columns rewrites rows, which the views mustn't paint from meanwhile
+                GuiStatusManager::AutoSection extractSection { monitorManager, true, "Extracting Columns", 1 };
+                globalLogs.ExtractDeferredColumns(extractSection.Section().PartIndex(0), usedColumns);
+            }
+
             // Grab qos data from all rows
             monitorParse.SetControlFeatures(true);
             monitorParse.SetProgressFeatures(rowsToUse.size(), "kiloline", 1000);
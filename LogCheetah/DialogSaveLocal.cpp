@@ -62,6 +62,21 @@ void SaveLogsLocalWorker(const std::vector<uint32_t> &filteredRows, const std::v
     if (SaveFilename.empty())
         return;
 
+    std::vector<uint32_t> cols;
+    if (SaveLogColFilter == LOGCOLFILTER_FILTERED)
+        cols = filteredColumns;
+    else
+    {
+        for (size_t c = 0; c < globalLogs.Columns.size(); ++c)
+            cols.emplace_back((uint32_t)c);
+    }
+
+    //pulling out deferred columns rewrites rows, so it's done as a write before saving
+    GuiStatusManager::ShowBusyDialogAndRunMonitor("Extracting columns", true, [&](GuiStatusMonitor &monitor)
+    {
+        globalLogs.ExtractDeferredColumns(monitor, cols);
+    });
+
     //write logs
     GuiStatusManager::ShowBusyDialogAndRunMonitor("Saving Logs", false, [&](GuiStatusMonitor &monitor)
     {
@@ -83,15 +98,6 @@ void SaveLogsLocalWorker(const std::vector<uint32_t> &filteredRows, const std::v
                     rows.emplace_back((uint32_t)r);
             }
 
-            std::vector<uint32_t> cols;
-            if (SaveLogColFilter == LOGCOLFILTER_FILTERED)
-                cols = filteredColumns;
-            else
-            {
-                for (size_t c = 0; c < globalLogs.Columns.size(); ++c)
-                    cols.emplace_back((uint32_t)c);
-            }
-
             FormatLogData(SaveLogFormat, rows, cols, file);
         }
 
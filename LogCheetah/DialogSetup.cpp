@@ -9,11 +9,19 @@
 #include <Shlobj.h>
 #include <thread>
 #include <filesystem>
+#include <cassert>
 
 #include "Preferences.h"
 #include "WinMain.h"
+#include "Globals.h"
 #include "GuiStatusMonitor.h"
 #include "JsonParser.h"
+#include "TimestampParser.h"
+#include "CaseInsensitiveSearch.h"
+#include "TrigramIndex.h"
+#include "TypedColumn.h"
+#include "ParallelSort.h"
+#include "RowSorter.h"
 #include "CatWindow.h"
 
 INT_PTR CALLBACK SetupDialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
@@ -31,6 +39,9 @@ namespace
     HWND hwndForceCats = 0;
 
     HWND hwndPromptForMemoryUse = 0;
+    HWND hwndDeferUnusedJsonColumns = 0;
+    HWND hwndExplodeJsonArrays = 0;
+    HWND hwndIndexRawTextForSearch = 0;
 
     void TestParallelismCase(uint64_t &outParseTime, uint64_t &outSortTime, uint64_t &outFilterTime)
     {
@@ -59,8 +70,9 @@ namespace
         LogFilterEntry lfe;
         lfe.Column = -1;
         lfe.Value = "xHttpLite.RequestComplete";
+        CompiledLogFilter compiledFilter { { lfe }, logCollection };
         for (auto &l : logCollection.Lines)
-            DoesLogEntryPassFilters(l, { lfe });
+            compiledFilter.Passes(l);
         QueryPerformanceCounter((LARGE_INTEGER*)&val3);
         outFilterTime = val3 - val2;
     }
@@ -112,6 +124,35 @@ namespace
         comAppPathString = nullptr;
         return std::move(appPathString);
     }
+
+    //a kernel's check against a simple reference implementation, and its benchmark if it has one
+    struct KernelSelfTest
+    {
+        const char *Name;
+        bool (*Verify)(AppStatusMonitor &monitor);
+        void (*Benchmark)(AppStatusMonitor &monitor);
+    };
+
+    //runs every check, then every benchmark.  the checks log their own mismatches, and any that fail are listed together at the end.
+    void RunKernelSelfTests(AppStatusMonitor &monitor, const std::vector<KernelSelfTest> &tests)
+    {
+        std::string failed;
+        for (const KernelSelfTest &test : tests)
+        {
+            if (!test.Verify(monitor))
+                failed += std::string(failed.empty() ? "" : ", ") + test.Name;
+        }
+
+        for (const KernelSelfTest &test : tests)
+        {
+            if (test.Benchmark)
+                test.Benchmark(monitor);
+        }
+
+        if (!failed.empty())
+            monitor.AddDebugOutput("Self tests FAILED: " + failed);
+        assert(failed.empty());
+    }
 }
 
 void ShowSetupDialog()
@@ -197,6 +238,16 @@ void RunTestParallelismDialog()
             monitor.AddDebugOutput(ss.str().c_str());
         }
 
+        //single threaded kernels first, then the multithreaded ones, which are timed at each thread count
+        RunKernelSelfTests(monitor, {
+            { "Timestamp parsers", Timestamp::VerifyParsers, Timestamp::BenchmarkParsers },
+            { "Case insensitive search", CaseInsensitiveSearch::VerifySearch, CaseInsensitiveSearch::BenchmarkSearch },
+            { "Search index", TrigramIndex::VerifyIndex, nullptr },
+            { "Typed column ranges", TypedColumn::VerifyRanges, nullptr },
+            { "Parallel sort", ParallelSort::VerifySort, ParallelSort::BenchmarkSort },
+            { "Row sorter", RowSorter::VerifySort, nullptr }
+        });
+
         OverrideCpuCount(newCpuCountGeneral, newCpuCountParse, newCpuCountSort, newCpuCountFilter);
         Preferences::ParallelismOverrideGeneral = newCpuCountGeneral;
         Preferences::ParallelismOverrideParse = newCpuCountParse;
@@ -216,7 +267,7 @@ INT_PTR CALLBACK SetupDialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPa
         SetWindowText(hwnd, "LogCheetah Setup");
 
         //oddly it creates us at a size different than we specified.. so fix it
-        SetWindowPos(hwnd, 0, 0, 0, 650, 350, SWP_NOMOVE);
+        SetWindowPos(hwnd, 0, 0, 0, 650, 425, SWP_NOMOVE);
 
         RECT clientRect;
         GetClientRect(hwnd, &clientRect);
@@ -259,6 +310,12 @@ INT_PTR CALLBACK SetupDialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPa
         CreateWindow(WC_STATIC, "General Options:", WS_VISIBLE | WS_CHILD, 275, 260, 400, 19, hwnd, 0, hInstance, 0);
         hwndPromptForMemoryUse = CreateWindow(WC_BUTTON, "Prompt For Memory Full", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 275, 280, 200, 22, hwnd, 0, hInstance, 0);
         Button_SetCheck(hwndPromptForMemoryUse, allowMemoryUseChecks);
+        hwndDeferUnusedJsonColumns = CreateWindow(WC_BUTTON, "Defer Unused JSON Columns", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 275, 303, 200, 22, hwnd, 0, hInstance, 0);
+        Button_SetCheck(hwndDeferUnusedJsonColumns, deferUnusedJsonColumns);
+        hwndExplodeJsonArrays = CreateWindow(WC_BUTTON, "Explode JSON Arrays", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 275, 326, 200, 22, hwnd, 0, hInstance, 0);
+        Button_SetCheck(hwndExplodeJsonArrays, explodeJsonArrays);
+        hwndIndexRawTextForSearch = CreateWindow(WC_BUTTON, "Index Raw Text For Search", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 275, 349, 200, 22, hwnd, 0, hInstance, 0);
+        Button_SetCheck(hwndIndexRawTextForSearch, indexRawTextForSearch);
 
         //Cats
         CreateWindow(WC_STATIC, "Cats:", WS_VISIBLE | WS_CHILD, 475, 170, 400, 19, hwnd, 0, hInstance, 0);
@@ -363,6 +420,23 @@ INT_PTR CALLBACK SetupDialogProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lPa
             Button_SetCheck((HWND)lParam, !Button_GetCheck((HWND)lParam));
             allowMemoryUseChecks = (Button_GetCheck((HWND)lParam) != 0);
         }
+        else if ((HWND)lParam == hwndDeferUnusedJsonColumns)
+        {
+            Button_SetCheck((HWND)lParam, !Button_GetCheck((HWND)lParam));
+            deferUnusedJsonColumns = (Button_GetCheck((HWND)lParam) != 0);
+        }
+        else if ((HWND)lParam == hwndExplodeJsonArrays)
+        {
+            Button_SetCheck((HWND)lParam, !Button_GetCheck((HWND)lParam));
+            explodeJsonArrays = (Button_GetCheck((HWND)lParam) != 0);
+        }
+        else if ((HWND)lParam == hwndIndexRawTextForSearch)
+        {
+            Button_SetCheck((HWND)lParam, !Button_GetCheck((HWND)lParam));
+            indexRawTextForSearch = (Button_GetCheck((HWND)lParam) != 0);
+            if (!indexRawTextForSearch)
+                globalLogs.InvalidateSearchIndex();
+        }
     }
     };
 
@@ -0,0 +1,430 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "FilterExpression.h"
+#include "TypedColumn.h"
+#include <cctype>
+#include <cstring>
+
+namespace
+{
+    //how many NOTs and parentheses can be nested inside one another, which keeps parsing and evaluating the query from running the stack out
+    const size_t MaxNestingDepth = 100;
+
+    inline bool IsOperatorChar(char c)
+    {
+        return c == '!' || c == '~' || c == '=' || c == '/' || c == '<' || c == '>';
+    }
+
+    class QueryParser
+    {
+    public:
+        QueryParser(const std::string &query, const std::vector<ColumnInformation> &columns) : query(query), columns(columns) {}
+
+        bool ParseQuery(FilterExpression &out, std::string &outError)
+        {
+            bool ok = ParseOr(out);
+            SkipSpace();
+            if (ok && pos < query.size())
+                ok = Fail(query[pos] == ')' ? "Unexpected ')'" : "Expected AND, OR, or the end of the query");
+
+            if (!ok)
+                outError = error + " at position " + std::to_string(errorPos + 1);
+            return ok;
+        }
+
+    private:
+        bool Fail(const std::string &message)
+        {
+            error = message;
+            errorPos = pos;
+            return false;
+        }
+
+        void SkipSpace()
+        {
+            while (pos < query.size() && std::isspace((unsigned char)query[pos]))
+                ++pos;
+        }
+
+        //consumes a keyword (ignoring case) or its symbol (if it has one), as long as a keyword isn't just the start of a longer name
+        bool TakeKeyword(const char *keyword, const char *symbol)
+        {
+            SkipSpace();
+
+            size_t symbolLength = strlen(symbol);
+            if (symbolLength && query.compare(pos, symbolLength, symbol) == 0 && !(symbolLength == 1 && pos + 1 < query.size() && IsOperatorChar(query[pos + 1])))
+            {
+                pos += symbolLength;
+                return true;
+            }
+
+            size_t keywordLength = strlen(keyword);
+            if (pos + keywordLength > query.size())
+                return false;
+
+            for (size_t i = 0; i < keywordLength; ++i)
+            {
+                if (std::toupper((unsigned char)query[pos + i]) != keyword[i])
+                    return false;
+            }
+
+            size_t after = pos + keywordLength;
+            if (after < query.size() && !std::isspace((unsigned char)query[after]) && query[after] != '(')
+                return false;
+
+            pos = after;
+            return true;
+        }
+
+        bool AtGroupEnd()
+        {
+            SkipSpace();
+            return pos >= query.size() || query[pos] == ')';
+        }
+
+        static void AddChild(FilterExpression &parent, FilterExpression &&child)
+        {
+            //flatten runs of the same operator, so the planner can order all of them together
+            if (child.Kind == parent.Kind && child.Kind != FilterExpression::NodeKind::Not && child.Kind != FilterExpression::NodeKind::Test)
+            {
+                for (auto &c : child.Children)
+                    parent.Children.emplace_back(std::move(c));
+            }
+            else
+                parent.Children.emplace_back(std::move(child));
+        }
+
+        bool ParseOr(FilterExpression &out)
+        {
+            FilterExpression first;
+            if (!ParseAnd(first))
+                return false;
+
+            if (!TakeKeyword("OR", "||"))
+            {
+                out = std::move(first);
+                return true;
+            }
+
+            out = FilterExpression();
+            out.Kind = FilterExpression::NodeKind::Or;
+            AddChild(out, std::move(first));
+            do
+            {
+                FilterExpression next;
+                if (!ParseAnd(next))
+                    return false;
+                AddChild(out, std::move(next));
+            } while (TakeKeyword("OR", "||"));
+
+            return true;
+        }
+
+        bool ParseAnd(FilterExpression &out)
+        {
+            FilterExpression first;
+            if (!ParseUnary(first))
+                return false;
+
+            out = FilterExpression();
+            out.Kind = FilterExpression::NodeKind::And;
+            AddChild(out, std::move(first));
+            while (true)
+            {
+                if (AtGroupEnd())
+                    break;
+
+                size_t beforeOr = pos;
+                if (TakeKeyword("OR", "||"))
+                {
+                    pos = beforeOr;
+                    break;
+                }
+
+                TakeKeyword("AND", "&&");
+
+                FilterExpression next;
+                if (!ParseUnary(next))
+                    return false;
+                AddChild(out, std::move(next));
+            }
+
+            if (out.Children.size() == 1)
+            {
+                FilterExpression only = std::move(out.Children[0]);
+                out = std::move(only);
+            }
+
+            return true;
+        }
+
+        bool ParseUnary(FilterExpression &out)
+        {
+            if (TakeKeyword("NOT", "!"))
+            {
+                if (depth >= MaxNestingDepth)
+                    return Fail("Too deeply nested");
+
+                out = FilterExpression();
+                out.Kind = FilterExpression::NodeKind::Not;
+                out.Children.emplace_back();
+                ++depth;
+                bool ok = ParseUnary(out.Children.back());
+                --depth;
+                return ok;
+            }
+
+            SkipSpace();
+            if (pos < query.size() && query[pos] == '(')
+            {
+                if (depth >= MaxNestingDepth)
+                    return Fail("Too deeply nested");
+
+                ++pos;
+                ++depth;
+                bool ok = ParseOr(out);
+                --depth;
+                if (!ok)
+                    return false;
+
+                SkipSpace();
+                if (pos >= query.size() || query[pos] != ')')
+                    return Fail("Missing ')'");
+                ++pos;
+                return true;
+            }
+
+            return ParseTest(out);
+        }
+
+        //a double quoted string, or a run of characters up to whitespace or anything in stopChars
+        bool ParseWord(const char *stopChars, std::string &outWord)
+        {
+            outWord.clear();
+            if (pos < query.size() && query[pos] == '"')
+            {
+                size_t quotePos = pos++;
+                while (pos < query.size() && query[pos] != '"')
+                {
+                    if (query[pos] == '\\' && pos + 1 < query.size())
+                        ++pos;
+                    outWord += query[pos++];
+                }
+
+                if (pos >= query.size())
+                {
+                    pos = quotePos;
+                    return Fail("Missing closing quote");
+                }
+
+                ++pos;
+                return true;
+            }
+
+            while (pos < query.size() && !std::isspace((unsigned char)query[pos]) && !strchr(stopChars, query[pos]))
+                outWord += query[pos++];
+
+            return true;
+        }
+
+        bool ParseTest(FilterExpression &out)
+        {
+            SkipSpace();
+            size_t columnPos = pos;
+            if (pos >= query.size() || query[pos] == ')')
+                return Fail("Expected a column name");
+
+            out = FilterExpression();
+            out.Kind = FilterExpression::NodeKind::Test;
+
+            std::string columnName;
+            if (!ParseWord("!~=/<>()", columnName))
+                return false;
+            if (columnName.empty() && pos == columnPos)
+                return Fail("Expected a column name");
+
+            if (columnName == "*" && query[columnPos] != '"')
+                out.Test.Column = -1;
+            else if (!FindColumn(columnName, out.Test.Column))
+            {
+                pos = columnPos;
+                return Fail("Unknown column '" + columnName + "'");
+            }
+
+            SkipSpace();
+            size_t operatorPos = pos;
+            if (TakeKeyword("BETWEEN", ""))
+            {
+                out.Test.Comparison = FilterComparison::Between;
+                if (!ParseValue("BETWEEN", out.Test.Value))
+                    return false;
+                if (!TakeKeyword("AND", "&&"))
+                    return Fail("Expected AND between the bounds of BETWEEN");
+                if (!ParseValue("AND", out.Test.UpperValue))
+                    return false;
+
+                return CheckRange(out.Test, operatorPos);
+            }
+
+            std::string op;
+            while (pos < query.size() && IsOperatorChar(query[pos]))
+                op += query[pos++];
+
+            size_t i = 0;
+            if (i < op.size() && op[i] == '!')
+            {
+                out.Test.Not = true;
+                ++i;
+            }
+            if (i < op.size() && (op[i] == '<' || op[i] == '>'))
+            {
+                bool less = (op[i] == '<');
+                bool orEqual = (i + 1 < op.size() && op[i + 1] == '=');
+                i += orEqual ? 2 : 1;
+                if (less)
+                    out.Test.Comparison = orEqual ? FilterComparison::LessEqual : FilterComparison::Less;
+                else
+                    out.Test.Comparison = orEqual ? FilterComparison::GreaterEqual : FilterComparison::Greater;
+
+                if (i != op.size())
+                {
+                    pos = operatorPos;
+                    return Fail("Unknown operator '" + op + "'");
+                }
+
+                return ParseValue(op, out.Test.Value) && CheckRange(out.Test, operatorPos);
+            }
+            else if (i < op.size() && (op[i] == '~' || op[i] == '='))
+            {
+                out.Test.MatchCase = (op[i] == '=');
+                ++i;
+            }
+            else
+            {
+                pos = operatorPos;
+                return Fail("Expected an operator (~ = ~= == < <= > >= or BETWEEN) after '" + columnName + "'");
+            }
+            if (i < op.size() && op[i] == '=')
+            {
+                out.Test.MatchSubstring = false;
+                ++i;
+            }
+            if (i < op.size() && op[i] == '/')
+            {
+                out.Test.Regex = true;
+                ++i;
+            }
+            if (i != op.size())
+            {
+                pos = operatorPos;
+                return Fail("Unknown operator '" + op + "'");
+            }
+
+            size_t valuePos = 0;
+            if (!ParseValue(op, out.Test.Value, &valuePos))
+                return false;
+
+            std::string regexError;
+            if (out.Test.Regex && !LinearRegex::Compile(out.Test.Value, out.Test.MatchCase, regexError))
+            {
+                pos = valuePos;
+                return Fail("Invalid regex (" + regexError + ")");
+            }
+
+            return true;
+        }
+
+        bool ParseValue(const std::string &after, std::string &outValue, size_t *outValuePos = nullptr)
+        {
+            SkipSpace();
+            size_t valuePos = pos;
+            if (outValuePos)
+                *outValuePos = valuePos;
+
+            if (!ParseWord(")", outValue))
+                return false;
+            if (pos == valuePos)
+                return Fail("Expected a value after '" + after + "' (use \"\" for an empty one)");
+
+            return true;
+        }
+
+        //ranges compare a column's values as numbers or times, so the bounds have to be one or the other
+        bool CheckRange(const LogFilterEntry &test, size_t operatorPos)
+        {
+            RangeValueType type;
+            if (test.Column < 0)
+            {
+                pos = operatorPos;
+                return Fail("'*' can't be compared as a range");
+            }
+            else if (!TypedColumn::FindRangeType(test, type))
+            {
+                pos = operatorPos;
+                return Fail(test.Comparison == FilterComparison::Between ? "Expected two numbers or two times" : "Expected a number or a time");
+            }
+
+            return true;
+        }
+
+        //exact names win, then names that only differ by case, then display names
+        bool FindColumn(const std::string &name, int &outColumn)
+        {
+            for (size_t c = 0; c < columns.size(); ++c)
+            {
+                if (columns[c].UniqueName == name)
+                {
+                    outColumn = (int)c;
+                    return true;
+                }
+            }
+
+            for (size_t c = 0; c < columns.size(); ++c)
+            {
+                const std::string &unique = columns[c].UniqueName;
+                if (unique.size() == name.size() && std::equal(unique.begin(), unique.end(), name.begin(), [](char a, char b) { return std::tolower((unsigned char)a) == std::tolower((unsigned char)b); }))
+                {
+                    outColumn = (int)c;
+                    return true;
+                }
+            }
+
+            for (size_t c = 0; c < columns.size(); ++c)
+            {
+                if (!columns[c].DisplayNameOverride.empty() && columns[c].DisplayNameOverride == name)
+                {
+                    outColumn = (int)c;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        const std::string &query;
+        const std::vector<ColumnInformation> &columns;
+        size_t pos = 0;
+        size_t depth = 0;
+        std::string error;
+        size_t errorPos = 0;
+    };
+}
+
+bool FilterExpression::Parse(const std::string &query, const std::vector<ColumnInformation> &columns, FilterExpression &outExpression, std::string &outError)
+{
+    QueryParser parser { query, columns };
+    return parser.ParseQuery(outExpression, outError);
+}
+
+void FilterExpression::CollectColumns(std::vector<uint32_t> &outColumns) const
+{
+    if (Kind == NodeKind::Test)
+    {
+        if (Test.Column >= 0)
+            outColumns.push_back((uint32_t)Test.Column);
+    }
+
+    for (auto &c : Children)
+        c.CollectColumns(outColumns);
+}
@@ -0,0 +1,37 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "LogParserCommon.h"
+
+//A boolean combination of row filters, parsed from a query such as:
+//    (level ~= Error OR level ~= Critical) AND NOT host ~ canary
+//Each test is a column name, an operator, and a value.  Operators are written the way the filter list shows them: '~' ignores case and '=' matches it,
+//a second '=' makes it match the whole value instead of a substring, a trailing '/' makes the value a regex, and a leading '!' negates the test.  The range
+//operators < <= > >= and "BETWEEN low AND high" compare the column as numbers, or as times if the bounds are ISO-8601 or US style times.
+//Column names and values with spaces or operator characters go in double quotes (with \" and \\ escapes), and '*' is the raw log line.  AND binds tighter
+//than OR, tests side by side are ANDed together, and && || ! work as well as the keywords.
+struct FilterExpression
+{
+    enum class NodeKind : uint8_t
+    {
+        Test,
+        And,
+        Or,
+        Not
+    };
+
+    NodeKind Kind = NodeKind::And;
+    LogFilterEntry Test; //only used by Test nodes
+    std::vector<FilterExpression> Children;
+
+    //parses query, looking up column names in columns.  returns false with a description of the problem in outError if it isn't valid.
+    static bool Parse(const std::string &query, const std::vector<ColumnInformation> &columns, FilterExpression &outExpression, std::string &outError);
+
+    //adds every column the tests look at to outColumns
+    void CollectColumns(std::vector<uint32_t> &outColumns) const;
+};
@@ -2,41 +2,106 @@
 // Licensed under the MIT license.
 
 #include "JsonParser.h"
-#include <thread>
+#include <cctype>
 #include <mutex>
-#include <atomic>
+#include <sstream>
 #include <unordered_map>
-#include <cctype>
 #include "SharedGlobals.h"
+#include "ThreadPool.h"
+#include "IniLexicon.h"
+#include "ConcurrentColumnRegistry.h"
+#include "TimestampParser.h"
 
 namespace
 {
-    size_t FindOrAddColumn(LogCollection &logs, std::unordered_map<std::string, size_t> &sharedColumnIndex, std::mutex &sharedMutex, std::unordered_map<std::string, size_t> &threadColumnIndex, const std::string &colName, const std::string &colDescription)
+    //what's known about a column from earlier parses and loaded schema files, since the logs were last replaced with unrelated ones.  these are
+    //preloaded into the column registry so discovery of columns that have been seen before never has to add anything.
+    struct KnownColumn
+    {
+        std::string Name;
+        std::string DisplayName;
+        std::string Description;
+    };
+
+    const size_t MaxKnownColumns = 1000;
+
+    //logs with more distinct columns than this are probably not json with fixed names (or are broken), so the rest of their values all go in one column
+    //rather than exploding into a column each.  it's checked every so many lines, so the cutoff doesn't depend on how the work is split between threads.
+    const size_t BrokenJsonCheckLines = 4096;
+    const size_t MaxJsonColumns = 1000;
+
+    std::mutex knownSchemaMutex;
+    std::vector<KnownColumn> knownSchema;
+    std::unordered_map<std::string, size_t> knownSchemaLookup;
+
+    //caller must hold knownSchemaMutex.  names and descriptions from schema files replace what's known, since they may have been hand edited, while
+    //ones found by parsing only fill in blanks.
+    void MergeKnownColumn(const KnownColumn &column, bool fromSchemaFile)
     {
-        //first try thread's copy
-        auto existingIndex = threadColumnIndex.find(colName);
-        if (existingIndex == threadColumnIndex.end())
+        auto existing = knownSchemaLookup.find(column.Name);
+        if (existing == knownSchemaLookup.end())
         {
-            //sync thread's copy to global copy and try again
-            std::lock_guard<std::mutex> lock(sharedMutex);
+            if (knownSchema.size() >= MaxKnownColumns)
+                return;
 
-            threadColumnIndex = sharedColumnIndex;
-            existingIndex = threadColumnIndex.find(colName);
-            if (existingIndex == threadColumnIndex.end())
-            {
-                //need to add it
-                logs.Columns.emplace_back(colName);
-                logs.Columns.back().Description = colDescription;
-                size_t mappedColumn = logs.Columns.size() - 1;
-                sharedColumnIndex.insert(std::make_pair(colName, mappedColumn));
-                threadColumnIndex = sharedColumnIndex;
-                return mappedColumn;
-            }
-            else
-                return existingIndex->second;
+            knownSchemaLookup.emplace(column.Name, knownSchema.size());
+            knownSchema.push_back(column);
+            return;
+        }
+
+        KnownColumn &known = knownSchema[existing->second];
+        if (known.DisplayName.empty() || (fromSchemaFile && !column.DisplayName.empty()))
+            known.DisplayName = column.DisplayName;
+        if (known.Description.empty() || (fromSchemaFile && !column.Description.empty()))
+            known.Description = column.Description;
+    }
+
+    //names that can't survive a round trip through the schema file are left out of it, and just get rediscovered
+    bool CanSaveColumnName(const std::string &name)
+    {
+        return !name.empty() && name.find_first_of("[]\r\n") == std::string::npos && name == TrimString(name);
+    }
+
+    //columns that always get their values pulled out up front, even when deferring the rest.  these are what the default sort column is picked from.
+    bool IsEagerColumnName(const std::string &name)
+    {
+        std::string lower = StringToLower(name);
+        return lower == "name" || lower.find("time") != std::string::npos || lower.find("date") != std::string::npos;
+    }
+
+    //exploded arrays get a path[N] column for each of their first elements.  past the first few they're only pulled out when used, so a handful of
+    //huge arrays don't bloat every row.
+    const size_t MaxExplodedArrayElements = 32;
+    const size_t EagerArrayElements = 8;
+
+    //arrays nested deeper than this are kept whole as one value instead of being walked, so a line of [[[[... can't run the stack out
+    const size_t MaxExplodedArrayDepth = 64;
+
+    bool IsLateArrayElementName(const std::string &name)
+    {
+        for (size_t open = name.find('['); open != std::string::npos; open = name.find('[', open + 1))
+        {
+            size_t close = name.find(']', open);
+            if (close == std::string::npos)
+                break;
+
+            std::string index { name.begin() + open + 1, name.begin() + close };
+            if (!index.empty() && index.size() < 6 && std::all_of(index.begin(), index.end(), [](char c) { return c >= '0' && c <= '9'; }) && (size_t)std::stoi(index) >= EagerArrayElements)
+                return true;
         }
-        else
-            return existingIndex->second;
+
+        return false;
+    }
+
+    bool ShouldDeferColumn(const std::string &name, bool deferColumns, bool explodeArrays)
+    {
+        return (deferColumns && !IsEagerColumnName(name)) || (explodeArrays && IsLateArrayElementName(name));
+    }
+
+    //orders column discovery by position in the input so column numbers don't depend on thread timing.  row 0 is reserved for the well known columns.
+    inline uint64_t ColumnSeenOrder(size_t row, size_t valueInRow)
+    {
+        return ((uint64_t)(row + 1) << 24) | (uint64_t)std::min<size_t>(valueInRow, 0xffffff);
     }
 
     inline bool IsValueChar(const char c)
@@ -108,6 +173,26 @@ namespace
         return pos;
     }
 
+    //returns one past the end of the object or array that starts at start, skipping over anything nested inside it
+    size_t WalkNestedValue(const std::string_view line, size_t start)
+    {
+        size_t depth = 0;
+        size_t pos = start;
+        while (pos < line.size())
+        {
+            if (line[pos] == '\"')
+                pos = WalkQuotedString(line, pos + 1);
+            else if (line[pos] == '[' || line[pos] == '{')
+                ++depth;
+            else if ((line[pos] == ']' || line[pos] == '}') && --depth == 0)
+                return pos + 1;
+
+            ++pos;
+        }
+
+        return line.size();
+    }
+
     time_t ParseTimeFromLine(const std::string_view line)
     {
         //first extract the date string by itself
@@ -137,69 +222,14 @@ namespace
             return 0;
 
         //string will be of the form: 2016-02-25T20:08:38.6443339Z
-        char *endChar = nullptr;
-        size_t cur = dateStart;
-        size_t next = cur;
-
-        //year
-        next = line.find('-', cur);
-        if (next == std::string::npos)
-            return 0;
-        int outYear = strtol(line.data() + cur, &endChar, 10);
-
-        //month
-        cur = next + 1;
-        next = line.find('-', cur);
-        if (next == std::string::npos)
-            return 0;
-        int outMonth = strtol(line.data() + cur, &endChar, 10);
-
-        //day
-        cur = next + 1;
-        next = line.find('T', cur);
-        if (next == std::string::npos)
-            return 0;
-        int outDay = strtol(line.data() + cur, &endChar, 10);
-
-        //hour
-        cur = next + 1;
-        next = line.find(':', cur);
-        if (next == std::string::npos)
+        Timestamp::Components timestamp;
+        if (!Timestamp::ParseIso8601(line.substr(dateStart, dateEnd - dateStart), timestamp))
             return 0;
-        int outHour = strtol(line.data() + cur, &endChar, 10);
 
-        //minute
-        cur = next + 1;
-        next = line.find(':', cur);
-        if (next == std::string::npos)
+        int64_t seconds = Timestamp::ToUnixSeconds(timestamp);
+        if (seconds <= 0)
             return 0;
-        int outMinute = strtol(line.data() + cur, &endChar, 10);
-
-        //second
-        cur = next + 1;
-        next = line.find('.', cur);
-        int outSecond = strtol(line.data() + cur, &endChar, 10);
-
-        if (outYear != 0)
-        {
-            std::tm outTime = { 0 };
-            outTime.tm_year = outYear;
-            outTime.tm_mon = outMonth;
-            outTime.tm_mday = outDay;
-            outTime.tm_hour = outHour;
-            outTime.tm_min = outMinute;
-            outTime.tm_sec = outSecond;
-
-            --outTime.tm_mon;
-            outTime.tm_year -= 1900;
-
-            time_t ret = _mkgmtime(&outTime);
-            if (ret == -1)
-                return 0;
-            return ret;
-        }
-
-        return 0;
+        return (time_t)seconds;
     }
 
     std::string DeEscapeString(std::string_view orig)
@@ -224,6 +254,326 @@ namespace
 
         return s;
     }
+
+    //parses lines for one thread, keeping its scratch space between lines.  it either discovers columns through the registry, or pulls out the values
+    //of a fixed set of already known columns from a row whose columns were deferred.
+    class JsonLineParser : public LineBatchParseWorker
+    {
+    public:
+        JsonLineParser(ConcurrentColumnRegistry &columnRegistry, bool allowNestedJson, bool explodeArrays, bool deferColumns, bool brokenJson) : columnRegistry(&columnRegistry), allowNestedJson(allowNestedJson), explodeArrays(explodeArrays), deferColumns(deferColumns), brokenJson(brokenJson)
+        {
+        }
+
+        JsonLineParser(const std::unordered_map<std::string, uint16_t> &extractColumns, bool allowNestedJson, bool explodeArrays, bool brokenJson) : extractColumns(&extractColumns), allowNestedJson(allowNestedJson), explodeArrays(explodeArrays), brokenJson(brokenJson)
+        {
+        }
+
+        void ParseBatch(std::span<std::string> lines, std::span<LogEntry> rows, size_t firstRow) override
+        {
+            for (size_t i = 0; i < lines.size(); ++i)
+                ParseLine(lines[i], rows[i], firstRow + i);
+        }
+
+        void ExtractRow(const LogEntry &source, LogEntry &dest)
+        {
+            std::string line { source.OriginalLogBegin(), source.OriginalLogEnd() };
+            ParseLine(line, dest, 0);
+
+            //final column numbers aren't in the order values appear, so match the tie breaking done after a normal parse
+            std::sort(dest.ColumnDataBegin(), dest.ColumnDataEnd(), [](const LogEntryColumn &a, const LogEntryColumn &b) { return a.ColumnNumber != b.ColumnNumber ? a.ColumnNumber < b.ColumnNumber : a.IndexDataBegin < b.IndexDataBegin; });
+        }
+
+    private:
+        inline void ParseLine(std::string &line, LogEntry &le, size_t lineRow)
+        {
+            if (line.empty())
+                return;
+
+            columnDataOrig.clear();
+            columnDataExtra.clear();
+            extraData.clear();
+
+            columnNameStack.clear();
+            curColumnName.clear();
+
+            //parse the line
+            row = lineRow;
+            parseFailed = false;
+            deferredInRow = false;
+            valuesInRow = 0;
+            lineSize = line.size();
+            arrayDepth = 0;
+
+            WalkBlob(line, 0, line.size(), false);
+
+            if (!columnNameStack.empty())
+                parseFailed = true;
+
+            //store data for the line
+            le.Set(line, extraData, columnDataOrig, columnDataExtra);
+            le.ParseFailed = parseFailed;
+            le.HasDeferredColumns = deferredInRow;
+            le.CatchAllColumn = brokenJson;
+            line = std::string(); //free old memory now to reduce max memory usage during parsing
+        }
+
+        void EmitValue(std::string_view blob, size_t start, size_t end, bool &isInLeftSide, bool emitAsExtra)
+        {
+            if (isInLeftSide)
+            {
+                isInLeftSide = false;
+                if (start == end)
+                    columnNameStack.emplace_back("(empty)");
+                else
+                    columnNameStack.emplace_back(std::string(blob.data() + start, blob.data() + end));
+            }
+            else
+            {
+                isInLeftSide = true;
+
+                if (brokenJson) //something is probably horribly wrong.. fall back to used a fixed value to prevent exploding too badly
+                    curColumnName = "(broken_json)";
+                else
+                {
+                    curColumnName = StringJoin('.', columnNameStack.begin(), columnNameStack.end());
+                    StripSymbolPrefixFromString(curColumnName);
+                }
+
+                uint32_t colIndex = ResolveColumn();
+                if (colIndex == ConcurrentColumnRegistry::InvalidIndex)
+                {
+                    if (!columnNameStack.empty())
+                        columnNameStack.pop_back();
+                    return;
+                }
+
+                if (start > MaxLogEntryDataIndex)
+                {
+                    start = MaxLogEntryDataIndex;
+                    parseFailed = true;
+                }
+
+                if (end > MaxLogEntryDataIndex)
+                {
+                    end = MaxLogEntryDataIndex;
+                    parseFailed = true;
+                }
+
+                LogEntryColumn *lce;
+                if (emitAsExtra)
+                {
+                    columnDataExtra.emplace_back();
+                    lce = &columnDataExtra.back();
+                }
+                else
+                {
+                    columnDataOrig.emplace_back();
+                    lce = &columnDataOrig.back();
+                }
+
+                lce->ColumnNumber = (uint16_t)colIndex;
+                lce->IndexDataBegin = (uint32_t)start;
+                lce->IndexDataEnd = (uint32_t)end;
+
+                if (!columnNameStack.empty())
+                    columnNameStack.pop_back();
+            }
+        }
+
+        void WalkBlob(std::string_view blob, size_t start, size_t end, bool emitAsExtra)
+        {
+            bool isInLeftSide = true;
+            size_t pos = start;
+            while (pos < end && !parseFailed)
+            {
+                const char &cur = blob[pos];
+
+                if (cur == '[' && explodeArrays && !isInLeftSide && !columnNameStack.empty())
+                {
+                    pos = WalkArray(blob, pos, end, isInLeftSide, emitAsExtra);
+                }
+                else if (cur == '[') //NOTE: For now we will treat the entire contents as a "mega string".. may revisit this later..
+                {
+                    if (pos != 0) //xpert exports the logs as a list, which screws up parsing the first logline.. just filter that out if it's the first thing
+                    {
+                        size_t blobStart = pos + 1;
+                        size_t blobEnd = WalkArrayMegaString(blob, blobStart);
+                        pos = blobEnd;
+                        EmitValue(blob, blobStart, blobEnd, isInLeftSide, true);
+                    }
+                }
+                else if (cur == '\"')
+                {
+                    size_t blobStart = pos + 1;
+                    size_t blobEnd = WalkQuotedString(blob, blobStart);
+                    int64_t blobSize = blobEnd - blobStart;
+                    pos = blobEnd;
+
+                    //The nested mode allows for json data inside of a nested string.. de-escape that and store it as extra data with the line
+                    if (allowNestedJson && !isInLeftSide && blobSize > 4 && blob[blobStart] == '{' && blob[blobStart + 1] == '\\' && blob[blobStart + 2] == '\"' && blob[blobEnd - 1] == '}')
+                    {
+                        std::string nestedString = DeEscapeString(std::string_view(blob.data() + blobStart, blobEnd - blobStart));
+                        size_t nestedBlobStart = extraData.size();
+                        extraData.reserve(lineSize); //prevent re-alloc, since we should never exceed this
+                        extraData += nestedString;
+                        WalkBlob(extraData, nestedBlobStart, extraData.size(), true);
+                        isInLeftSide = true;
+                    }
+                    else
+                        EmitValue(blob, blobStart, blobEnd, isInLeftSide, emitAsExtra);
+                }
+                else if (IsValueChar(cur))
+                {
+                    size_t blobStart = pos;
+                    size_t blobEnd = WalkValueString(blob, blobStart);
+                    pos = blobEnd - 1;
+                    EmitValue(blob, blobStart, blobEnd, isInLeftSide, emitAsExtra);
+                }
+                else if (cur == '{')
+                {
+                    isInLeftSide = true;
+                }
+                else if (cur == '}')
+                {
+                    if (!columnNameStack.empty())
+                        columnNameStack.pop_back();
+                }
+
+                ++pos;
+            }
+        }
+
+        //emits the whole array as one value like the mega string, along with a column for each element unless it's nested too deep.  returns the position of
+        //the closing bracket.
+        size_t WalkArray(std::string_view blob, size_t start, size_t end, bool &isInLeftSide, bool emitAsExtra)
+        {
+            size_t blobStart = start + 1;
+            size_t blobEnd = std::min(WalkNestedValue(blob, start), end);
+            if (blobEnd > blobStart && blob[blobEnd - 1] == ']')
+                --blobEnd;
+
+            if (arrayDepth < MaxExplodedArrayDepth)
+            {
+                ++arrayDepth;
+                WalkArrayElements(blob, blobStart, blobEnd, emitAsExtra);
+                --arrayDepth;
+            }
+            EmitValue(blob, blobStart, blobEnd, isInLeftSide, true);
+            return blobEnd;
+        }
+
+        //the array's own name is on top of the name stack, and is swapped for path[N] while walking each element
+        void WalkArrayElements(std::string_view blob, size_t start, size_t end, bool emitAsExtra)
+        {
+            size_t stackDepth = columnNameStack.size();
+            std::string arrayName = columnNameStack.back();
+
+            size_t element = 0;
+            size_t pos = start;
+            while (pos < end && element < MaxExplodedArrayElements && !parseFailed)
+            {
+                const char &cur = blob[pos];
+                bool isInLeftSide = false;
+                columnNameStack.back() = arrayName + '[' + std::to_string(element) + ']';
+
+                if (cur == '\"')
+                {
+                    size_t blobStart = pos + 1;
+                    size_t blobEnd = WalkQuotedString(blob, blobStart);
+                    EmitValue(blob, blobStart, blobEnd, isInLeftSide, emitAsExtra);
+                    pos = blobEnd + 1;
+                }
+                else if (IsValueChar(cur))
+                {
+                    size_t blobEnd = WalkValueString(blob, pos);
+                    EmitValue(blob, pos, blobEnd, isInLeftSide, emitAsExtra);
+                    pos = blobEnd;
+                }
+                else if (cur == '{')
+                {
+                    size_t blobEnd = std::min(WalkNestedValue(blob, pos), end);
+                    WalkBlob(blob, pos, blobEnd, emitAsExtra);
+                    pos = blobEnd;
+                }
+                else if (cur == '[')
+                {
+                    pos = WalkArray(blob, pos, end, isInLeftSide, emitAsExtra) + 1;
+                }
+                else
+                {
+                    //separators and whitespace
+                    ++pos;
+                    continue;
+                }
+
+                columnNameStack.resize(stackDepth);
+                columnNameStack.back() = arrayName;
+                ++element;
+            }
+        }
+
+        //finds the column number for curColumnName, or returns InvalidIndex if its value shouldn't be stored
+        inline uint32_t ResolveColumn()
+        {
+            if (extractColumns)
+            {
+                auto found = extractColumns->find(curColumnName);
+                if (found != extractColumns->end())
+                    return found->second;
+
+                deferredInRow = true;
+                return ConcurrentColumnRegistry::InvalidIndex;
+            }
+
+            uint32_t colIndex = columnRegistry->FindOrAdd(curColumnName, ColumnSeenOrder(row, valuesInRow++));
+            if (colIndex == ConcurrentColumnRegistry::InvalidIndex)
+            {
+                parseFailed = true;
+                return colIndex;
+            }
+
+            if (deferColumns || explodeArrays)
+            {
+                //the name check is only done once per column on each thread
+                if (colIndex >= columnIsEager.size())
+                    columnIsEager.resize(colIndex + 1, -1);
+                if (columnIsEager[colIndex] < 0)
+                    columnIsEager[colIndex] = ShouldDeferColumn(curColumnName, deferColumns, explodeArrays) ? 0 : 1;
+
+                if (!columnIsEager[colIndex])
+                {
+                    deferredInRow = true;
+                    return ConcurrentColumnRegistry::InvalidIndex;
+                }
+            }
+
+            return colIndex;
+        }
+
+        ConcurrentColumnRegistry *columnRegistry = nullptr;
+        const std::unordered_map<std::string, uint16_t> *extractColumns = nullptr;
+        bool allowNestedJson;
+        bool explodeArrays;
+        bool deferColumns = false;
+        bool brokenJson = false; //every value goes in the (broken_json) column
+        std::vector<int8_t> columnIsEager; //by provisional column index, -1 if not checked yet
+
+        //scratch space reused by every line
+        std::vector<LogEntryColumn> columnDataOrig;
+        std::vector<LogEntryColumn> columnDataExtra;
+        std::string extraData; //holds any column data (such as fields that had to be de-escaped or interpreted)
+
+        std::vector<std::string> columnNameStack;
+        std::string curColumnName;
+
+        //state of the line currently being parsed
+        size_t row = 0;
+        size_t lineSize = 0;
+        size_t arrayDepth = 0;
+        bool parseFailed = false;
+        bool deferredInRow = false;
+        size_t valuesInRow = 0;
+    };
 }
 
 namespace JSON
@@ -245,16 +595,55 @@ namespace JSON
         return true;
     }
 
+    //the schema is ini formatted, with a section per column path holding its DisplayName and Description
     void LoadSchemaData(AppStatusMonitor &monitor, const std::string &blob)
     {
+        std::istringstream stream(blob);
+        IniLexicon ini(stream);
+
+        std::lock_guard<std::mutex> lock(knownSchemaMutex);
+        for (const std::string &section : ini.GetSectionNames())
+        {
+            KnownColumn column;
+            column.Name = section;
+            column.DisplayName = ini.GetValue(section, "DisplayName");
+            column.Description = ini.GetValue(section, "Description");
+
+            MergeKnownColumn(column, true);
+        }
+
+        monitor.AddDebugOutput("Loaded " + std::to_string(ini.GetSectionNames().size()) + " JSON schema columns");
         monitor.Complete();
-        //FUTURE
+    }
+
+    void ForgetKnownSchema()
+    {
+        std::lock_guard<std::mutex> lock(knownSchemaMutex);
+        knownSchema.clear();
+        knownSchemaLookup.clear();
     }
 
     std::string SaveSchemaData()
     {
-        //FUTURE
-        return std::string();
+        IniLexicon ini;
+        {
+            std::lock_guard<std::mutex> lock(knownSchemaMutex);
+            for (const KnownColumn &column : knownSchema)
+            {
+                if (!CanSaveColumnName(column.Name))
+                    continue;
+
+                ini.SetValue(column.Name, "DisplayName", column.DisplayName);
+                ini.SetValue(column.Name, "Description", column.Description);
+            }
+        }
+
+        if (ini.GetSectionNames().empty())
+            return std::string();
+
+        std::ostringstream stream;
+        ini.Save(stream);
+        return stream.str();
     }
 
     LogCollection ParseLogs(AppStatusMonitor &monitor, std::vector<std::string> &&linesToConsume, bool allowNestedJson)
@@ -266,203 +655,77 @@ namespace JSON
             return std::move(logs);
 
         //add "well known" columns first so the results are more sane
-        std::unordered_map<std::string, size_t> sharedColumnIndex;
-        logs.Columns.emplace_back("time");
-        logs.Columns.emplace_back("name");
-        sharedColumnIndex.emplace("time", 0);
-        sharedColumnIndex.emplace("name", 1);
+        ConcurrentColumnRegistry columnRegistry { MaxLogEntryColumnIndex };
+        columnRegistry.FindOrAdd("time", 0);
+        columnRegistry.FindOrAdd("name", 1);
+
+        //then warm up the registry with everything seen before, so looking up known columns while parsing never writes to the table.
+        //they still only become columns if they show up in these logs.
+        std::unordered_map<std::string, KnownColumn> knownColumns;
+        {
+            std::lock_guard<std::mutex> lock(knownSchemaMutex);
+            for (const KnownColumn &column : knownSchema)
+            {
+                columnRegistry.Preload(column.Name, 0);
+                knownColumns.emplace(column.Name, column);
+            }
+        }
 
         //presize our destination storage
         logs.Lines.resize(linesToConsume.size());
 
-        //spread work accross threads and parse
+        //spread work accross threads and parse.  lines are handed out in small batches since line lengths vary wildly, and a thread that gets a slice of huge lines would otherwise hold up the rest
         monitor.SetControlFeatures(true);
         monitor.SetProgressFeatures(logs.Lines.size(), "kiloline", 1000);
 
-        std::mutex mut;
-        std::vector<std::thread> threads;
-        threads.reserve(cpuCountParse);
-        for (int cpu = 0; cpu < cpuCountParse; ++cpu)
+        bool deferColumns = deferUnusedJsonColumns;
+        bool explodeArrays = explodeJsonArrays;
+        //lines are parsed a chunk at a time until the logs look broken, then the rest all at once.  only checking between chunks means the same rows are affected
+        //however the work gets split between threads.
+        bool brokenJson = false;
+        auto makeParser = [&](size_t threadIndex) { return std::make_unique<JsonLineParser>(columnRegistry, allowNestedJson, explodeArrays, deferColumns, brokenJson); };
+        for (size_t chunkBegin = 0; chunkBegin < linesToConsume.size();)
         {
-            threads.emplace_back([&](int threadIndex)
-            {
-                size_t chunkSize = logs.Lines.size() / cpuCountParse;
-                if (!chunkSize)
-                    chunkSize = 1;
-
-                size_t iLogsStartIndex = chunkSize * threadIndex;
-                size_t iLogsEndIndex = chunkSize * (threadIndex + 1);
-                if (iLogsEndIndex > logs.Lines.size() || threadIndex == cpuCountParse - 1)
-                    iLogsEndIndex = logs.Lines.size();
-                if (iLogsStartIndex > iLogsEndIndex)
-                    iLogsStartIndex = iLogsEndIndex;
-
-                mut.lock();
-                std::unordered_map<std::string, size_t> threadColumnIndex(sharedColumnIndex);
-                mut.unlock();
-
-                std::vector<LogEntryColumn> columnDataOrig;
-                std::vector<LogEntryColumn> columnDataExtra;
-                std::string extraData; //holds any column data (such as fields that had to be de-escaped or interpreted)
-
-                std::vector<std::string> columnNameStack;
-                std::string curColumnName;
-
-                for (int row = (int)iLogsStartIndex; row < (int)iLogsEndIndex; ++row)
-                {
-                    if (monitor.IsCancelling())
-                        break;
-
-                    monitor.AddProgress(1);
-
-                    //
-                    std::string &line = linesToConsume[row];
-                    if (line.empty())
-                        continue;
-
-                    columnDataOrig.clear();
-                    columnDataExtra.clear();
-                    extraData.clear();
-
-                    columnNameStack.clear();
-                    curColumnName.clear();
-
-                    //parse the line
-                    bool parseFailed = false;
+            size_t chunkEnd = brokenJson ? linesToConsume.size() : std::min(chunkBegin + BrokenJsonCheckLines, linesToConsume.size());
+            if (!ParseLineBatches(monitor, linesToConsume, logs.Lines, chunkBegin, chunkEnd, 256, makeParser))
+                break;
 
-                    auto emitValue = [&](std::string_view blob, size_t start, size_t end, bool &isInLeftSide, bool emitAsExtra)
-                    {
-                        if (isInLeftSide)
-                        {
-                            isInLeftSide = false;
-                            if (start == end)
-                                columnNameStack.emplace_back("(empty)");
-                            else
-                                columnNameStack.emplace_back(std::string(blob.data() + start, blob.data() + end));
-                        }
-                        else
-                        {
-                            isInLeftSide = true;
-
-                            if (threadColumnIndex.size() > 1000) //something is probably horribly wrong.. fall back to used a fixed value to prevent exploding too badly
-                                curColumnName = "(broken_json)";
-                            else
-                            {
-                                curColumnName = StringJoin('.', columnNameStack.begin(), columnNameStack.end());
-                                StripSymbolPrefixFromString(curColumnName);
-                            }
-
-                            size_t colIndex = FindOrAddColumn(logs, sharedColumnIndex, mut, threadColumnIndex, curColumnName, std::string());
-
-                            if (start > MaxLogEntryDataIndex)
-                            {
-                                start = MaxLogEntryDataIndex;
-                                parseFailed = true;
-                            }
-
-                            if (end > MaxLogEntryDataIndex)
-                            {
-                                end = MaxLogEntryDataIndex;
-                                parseFailed = true;
-                            }
-
-                            LogEntryColumn *lce;
-                            if (emitAsExtra)
-                            {
-                                columnDataExtra.emplace_back();
-                                lce = &columnDataExtra.back();
-                            }
-                            else
-                            {
-                                columnDataOrig.emplace_back();
-                                lce = &columnDataOrig.back();
-                            }
-
-                            lce->ColumnNumber = (uint16_t)colIndex;
-                            lce->IndexDataBegin = (uint32_t)start;
-                            lce->IndexDataEnd = (uint32_t)end;
-
-                            if (!columnNameStack.empty())
-                                columnNameStack.pop_back();
-                        }
-                    };
-
-                    std::function<void(std::string_view blob, size_t start, size_t end, bool emitAsExtra)> walkBlob;
-                    walkBlob = [&](std::string_view blob, size_t start, size_t end, bool emitAsExtra)
-                    {
-                        bool isInLeftSide = true;
-                        size_t pos = start;
-                        while (pos < end && !parseFailed)
-                        {
-                            const char &cur = blob[pos];
-
-                            if (cur == '[') //NOTE: For now we will treat the entire contents as a "mega string".. may revisit this later..
-                            {
-                                if (pos != 0) //xpert exports the logs as a list, which screws up parsing the first logline.. just filter that out if it's the first thing
-                                {
-                                    size_t blobStart = pos + 1;
-                                    size_t blobEnd = WalkArrayMegaString(blob, blobStart);
-                                    pos = blobEnd;
-                                    emitValue(blob, blobStart, blobEnd, isInLeftSide, true);
-                                }
-                            }
-                            else if (cur == '\"')
-                            {
-                                size_t blobStart = pos + 1;
-                                size_t blobEnd = WalkQuotedString(blob, blobStart);
-                                int64_t blobSize = blobEnd - blobStart;
-                                pos = blobEnd;
-
-                                //The nested mode allows for json data inside of a nested string.. de-escape that and store it as extra data with the line
-                                if (allowNestedJson && !isInLeftSide && blobSize > 4 && blob[blobStart] == '{' && blob[blobStart + 1] == '\\' && blob[blobStart + 2] == '\"' && blob[blobEnd - 1] == '}')
-                                {
-                                    std::string nestedString = DeEscapeString(std::string_view(blob.data() + blobStart, blobEnd - blobStart));
-                                    size_t nestedBlobStart = extraData.size();
-                                    extraData.reserve(line.size()); //prevent re-alloc, since we should never exceed this
-                                    extraData += nestedString;
-                                    walkBlob(extraData, nestedBlobStart, extraData.size(), true);
-                                    isInLeftSide = true;
-                                }
-                                else
-                                    emitValue(blob, blobStart, blobEnd, isInLeftSide, emitAsExtra);
-                            }
-                            else if (IsValueChar(cur))
-                            {
-                                size_t blobStart = pos;
-                                size_t blobEnd = WalkValueString(blob, blobStart);
-                                pos = blobEnd - 1;
-                                emitValue(blob, blobStart, blobEnd, isInLeftSide, emitAsExtra);
-                            }
-                            else if (cur == '{')
-                            {
-                                isInLeftSide = true;
-                            }
-                            else if (cur == '}')
-                            {
-                                if (!columnNameStack.empty())
-                                    columnNameStack.pop_back();
-                            }
-
-                            ++pos;
-                        }
-                    };
-
-                    walkBlob(line, 0, line.size(), false);
+            brokenJson = brokenJson || columnRegistry.Size() > MaxJsonColumns;
+            chunkBegin = chunkEnd;
+        }
 
-                    if (!columnNameStack.empty())
-                        parseFailed = true;
+        //assign the final column numbers.  provisional numbers depend on which thread found a column first, so renumber them by first appearance in the input.
+        std::vector<uint16_t> provisionalToFinal;
+        std::vector<ConcurrentColumnRegistry::Column> finalColumns = columnRegistry.Finalize(provisionalToFinal);
+        for (auto &column : finalColumns)
+        {
+            logs.Columns.emplace_back(column.Name);
+            logs.Columns.back().Deferred = ShouldDeferColumn(column.Name, deferColumns, explodeArrays);
+        }
 
-                    //store data for the line
-                    LogEntry &le = logs.Lines[row];
-                    le.Set(line, extraData, columnDataOrig, columnDataExtra);
-                    le.ParseFailed = parseFailed;
-                    line = std::string(); //free old memory now to reduce max memory usage during parsing
-                }
-            }, cpu);
+        if (deferColumns || explodeArrays)
+        {
+            logs.DeferredColumnExtractor = [allowNestedJson, explodeArrays](const LogEntry &source, const std::unordered_map<std::string, uint16_t> &columns, LogEntry &dest)
+            {
+                //rows parsed after the logs looked broken have to resolve to (broken_json) again, rather than to their real names
+                JsonLineParser parser { columns, allowNestedJson, explodeArrays, source.CatchAllColumn };
+                parser.ExtractRow(source, dest);
+            };
         }
 
-        for (auto &t : threads)
-            t.join();
+        ParallelFor(AppStatusMonitor::Instance, cpuCountParse, 0, logs.Lines.size(), 1000, [&](size_t threadIndex, size_t blockStart, size_t blockEnd)
+        {
+            for (size_t row = blockStart; row < blockEnd; ++row)
+            {
+                LogEntry &le = logs.Lines[row];
+                if (le.IsEmpty() || le.ColumnCount() == 0)
+                    continue;
+
+                for (auto cvIter = le.ColumnDataBegin(); cvIter != le.ColumnDataEnd(); ++cvIter)
+                    cvIter->ColumnNumber = provisionalToFinal[cvIter->ColumnNumber];
+                std::sort(le.ColumnDataBegin(), le.ColumnDataEnd(), [](const LogEntryColumn &a, const LogEntryColumn &b) { return a.ColumnNumber != b.ColumnNumber ? a.ColumnNumber < b.ColumnNumber : a.IndexDataBegin < b.IndexDataBegin; });
+            }
+        });
 
         //select the default sort column
         int sortColumn = -1;
@@ -479,15 +742,40 @@ namespace JSON
         }
 
         if (sortColumn != -1)
-            logs.SortColumn = (uint16_t)sortColumn;
+            logs.SortOrder = { LogSortEntry { (uint16_t)sortColumn } };
 
-        //generate more readable display names for the columns
+        //generate more readable display names for the columns, unless the schema already has one
         for (auto &c : logs.Columns)
         {
-            size_t dot = c.UniqueName.find_last_of('.');
-            if (dot != std::string::npos)
+            auto known = knownColumns.find(c.UniqueName);
+            if (known != knownColumns.end() && !known->second.DisplayName.empty())
+                c.DisplayNameOverride = known->second.DisplayName;
+            else
             {
-                c.DisplayNameOverride = std::string(c.UniqueName.begin() + dot + 1, c.UniqueName.end()) + " (" + std::string(c.UniqueName.begin(), c.UniqueName.begin() + dot) + ")";
+                size_t dot = c.UniqueName.find_last_of('.');
+                if (dot != std::string::npos)
+                {
+                    c.DisplayNameOverride = std::string(c.UniqueName.begin() + dot + 1, c.UniqueName.end()) + " (" + std::string(c.UniqueName.begin(), c.UniqueName.begin() + dot) + ")";
+                }
+            }
+
+            if (known != knownColumns.end())
+                c.Description = known->second.Description;
+        }
+
+        //remember what was found for the next parse and for saving
+        if (!monitor.IsCancelling())
+        {
+            std::lock_guard<std::mutex> lock(knownSchemaMutex);
+            for (size_t cnum = 0; cnum < logs.Columns.size(); ++cnum)
+            {
+                if (logs.Columns[cnum].UniqueName == "(broken_json)")
+                    continue;
+
+                KnownColumn column;
+                column.Name = logs.Columns[cnum].UniqueName;
+                column.DisplayName = logs.Columns[cnum].DisplayNameOverride;
+                MergeKnownColumn(column, false);
             }
         }
 
@@ -14,6 +14,9 @@ namespace JSON
     void LoadSchemaData(AppStatusMonitor &monitor, const std::string &blob);
     std::string SaveSchemaData();
 
-    static ParserInterface NormalParser = ParserInterface::MakePreFilterTextParser("JSON", FilterLine, [](AppStatusMonitor &monitor, std::vector<std::string> &&linesToConsume){ return ParseLogs(monitor, std::move(linesToConsume), false); }, ParserInterface::NoopPreloadKnownSchemas, LoadSchemaData, SaveSchemaData, true, false);
-    static ParserInterface NestedParser = ParserInterface::MakePreFilterTextParser("JSON", FilterLine, [](AppStatusMonitor &monitor, std::vector<std::string> &&linesToConsume){ return ParseLogs(monitor, std::move(linesToConsume), true); }, ParserInterface::NoopPreloadKnownSchemas, LoadSchemaData, SaveSchemaData, true, true);
+    //forgets the columns learned from earlier logs and schema files, so they don't carry over to unrelated logs loaded in their place
+    void ForgetKnownSchema();
+
+    static ParserInterface NormalParser = ParserInterface::MakePreFilterTextParser("JSON", ParserInterface::BatchPreFilter<FilterLine>, [](AppStatusMonitor &monitor, std::vector<std::string> &&linesToConsume){ return ParseLogs(monitor, std::move(linesToConsume), false); }, ParserInterface::NoopPreloadKnownSchemas, LoadSchemaData, SaveSchemaData, true, false);
+    static ParserInterface NestedParser = ParserInterface::MakePreFilterTextParser("JSON", ParserInterface::BatchPreFilter<FilterLine>, [](AppStatusMonitor &monitor, std::vector<std::string> &&linesToConsume){ return ParseLogs(monitor, std::move(linesToConsume), true); }, ParserInterface::NoopPreloadKnownSchemas, LoadSchemaData, SaveSchemaData, true, true);
 }
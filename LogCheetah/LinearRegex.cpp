@@ -0,0 +1,984 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "LinearRegex.h"
+#include "CaseInsensitiveSearch.h"
+#include <algorithm>
+#include <map>
+#include <functional>
+
+namespace
+{
+    //limits that keep both compiling and matching bounded, since patterns come straight from the user
+    const size_t MaxNfaStates = 10000;
+    const size_t MaxDfaStates = 1000;
+    const size_t MaxLazyDfaStates = 2000;
+    const size_t MinBytesPerLazyState = 10; //when the cache fills having saved less than this, the pattern goes back to simulating the NFA
+
+    const uint32_t UnknownDfaState = UINT32_MAX;
+    const int MaxRepeatCount = 1000;
+    const int MaxNestingDepth = 100; //groups plus stacked quantifiers such as a**
+    const int MaxAstDepth = MaxNestingDepth * 4; //each level of nesting is at most an alternation, a sequence, and a repeat deep
+
+    struct AstNode
+    {
+        enum class Kind
+        {
+            Set,
+            Concat,
+            Alternate,
+            Repeat,
+            Begin,
+            End,
+            Empty
+        };
+
+        explicit AstNode(Kind kind) : NodeKind(kind)
+        {
+        }
+
+        Kind NodeKind;
+        std::bitset<256> Set;
+        std::vector<std::unique_ptr<AstNode>> Children;
+        int Min = 0;
+        int Max = -1; //-1 for unbounded
+    };
+
+    void AddOtherCases(std::bitset<256> &set)
+    {
+        for (int c = 'a'; c <= 'z'; ++c)
+        {
+            if (set[c] || set[c - 'a' + 'A'])
+            {
+                set[c] = true;
+                set[c - 'a' + 'A'] = true;
+            }
+        }
+    }
+
+    void AddRange(std::bitset<256> &set, int first, int last)
+    {
+        for (int c = first; c <= last; ++c)
+            set[c] = true;
+    }
+
+    class Parser
+    {
+    public:
+        Parser(std::string_view pattern, bool matchCase) : pattern(pattern), matchCase(matchCase)
+        {
+        }
+
+        std::unique_ptr<AstNode> Parse(std::string &outError)
+        {
+            std::unique_ptr<AstNode> root = ParseAlternate();
+            if (error.empty() && pos < pattern.size())
+                Fail("unmatched ')'");
+
+            outError = error;
+            return error.empty() ? std::move(root) : nullptr;
+        }
+
+    private:
+        std::unique_ptr<AstNode> Fail(const std::string &message)
+        {
+            if (error.empty())
+                error = message + " at position " + std::to_string(pos);
+            return nullptr;
+        }
+
+        std::unique_ptr<AstNode> ParseAlternate()
+        {
+            if (++depth > MaxNestingDepth)
+                return Fail("too deeply nested");
+
+            auto node = std::make_unique<AstNode>(AstNode::Kind::Alternate);
+            node->Children.emplace_back(ParseConcat());
+            while (error.empty() && pos < pattern.size() && pattern[pos] == '|')
+            {
+                ++pos;
+                node->Children.emplace_back(ParseConcat());
+            }
+
+            --depth;
+            if (!error.empty())
+                return nullptr;
+            if (node->Children.size() == 1)
+                return std::move(node->Children[0]);
+            return std::move(node);
+        }
+
+        std::unique_ptr<AstNode> ParseConcat()
+        {
+            auto node = std::make_unique<AstNode>(AstNode::Kind::Concat);
+            while (error.empty() && pos < pattern.size() && pattern[pos] != '|' && pattern[pos] != ')')
+                node->Children.emplace_back(ParseRepeat());
+
+            if (!error.empty())
+                return nullptr;
+            if (node->Children.empty())
+                return std::make_unique<AstNode>(AstNode::Kind::Empty);
+            if (node->Children.size() == 1)
+                return std::move(node->Children[0]);
+            return std::move(node);
+        }
+
+        std::unique_ptr<AstNode> ParseRepeat()
+        {
+            std::unique_ptr<AstNode> atom = ParseAtom();
+            int stacked = 0;
+            while (atom && pos < pattern.size())
+            {
+                int min = 0;
+                int max = -1;
+                char c = pattern[pos];
+                if (c == '*')
+                    ++pos;
+                else if (c == '+')
+                {
+                    min = 1;
+                    ++pos;
+                }
+                else if (c == '?')
+                {
+                    max = 1;
+                    ++pos;
+                }
+                else if (c != '{' || !ParseCounts(min, max))
+                    break;
+
+                if (max != -1 && min > max)
+                    return Fail("repeat count minimum is more than the maximum");
+                if (min > MaxRepeatCount || max > MaxRepeatCount)
+                    return Fail("repeat count is over " + std::to_string(MaxRepeatCount));
+
+                //lazy and greedy match the same text when all that matters is whether there's a match at all
+                if (pos < pattern.size() && pattern[pos] == '?')
+                    ++pos;
+
+                //each quantifier wraps the last in another node, so they count toward the nesting limit like groups do
+                ++stacked;
+                if (depth + stacked > MaxNestingDepth)
+                    return Fail("too deeply nested");
+
+                auto repeat = std::make_unique<AstNode>(AstNode::Kind::Repeat);
+                repeat->Min = min;
+                repeat->Max = max;
+                repeat->Children.emplace_back(std::move(atom));
+                atom = std::move(repeat);
+            }
+
+            return atom;
+        }
+
+        //reads {m}, {m,}, or {m,n}.  anything else leaves pos alone so the brace is taken literally.
+        bool ParseCounts(int &min, int &max)
+        {
+            size_t cur = pos + 1;
+            auto readNumber = [&](int &out)
+            {
+                size_t begin = cur;
+                out = 0;
+                while (cur < pattern.size() && pattern[cur] >= '0' && pattern[cur] <= '9' && cur - begin < 6)
+                    out = out * 10 + (pattern[cur++] - '0');
+                return cur != begin;
+            };
+
+            if (!readNumber(min))
+                return false;
+
+            max = min;
+            if (cur < pattern.size() && pattern[cur] == ',')
+            {
+                ++cur;
+                if (!readNumber(max))
+                    max = -1;
+            }
+
+            if (cur >= pattern.size() || pattern[cur] != '}')
+                return false;
+
+            pos = cur + 1;
+            return true;
+        }
+
+        std::unique_ptr<AstNode> ParseAtom()
+        {
+            char c = pattern[pos];
+            if (c == '(')
+            {
+                ++pos;
+                if (pattern.substr(pos, 2) == "?:")
+                    pos += 2;
+                else if (pos < pattern.size() && pattern[pos] == '?')
+                    return Fail("lookaround and group options aren't supported");
+
+                std::unique_ptr<AstNode> inner = ParseAlternate();
+                if (!inner)
+                    return nullptr;
+                if (pos >= pattern.size() || pattern[pos] != ')')
+                    return Fail("missing ')'");
+
+                ++pos;
+                return inner;
+            }
+            else if (c == '*' || c == '+' || c == '?')
+                return Fail("nothing to repeat");
+            else if (c == '^' || c == '$')
+            {
+                ++pos;
+                return std::make_unique<AstNode>(c == '^' ? AstNode::Kind::Begin : AstNode::Kind::End);
+            }
+
+            auto node = std::make_unique<AstNode>(AstNode::Kind::Set);
+            if (c == '[')
+            {
+                if (!ParseClass(node->Set))
+                    return nullptr;
+            }
+            else if (c == '.')
+            {
+                node->Set.set();
+                node->Set[(unsigned char)'\n'] = false;
+                ++pos;
+            }
+            else if (c == '\\')
+            {
+                if (!ParseEscape(node->Set))
+                    return nullptr;
+            }
+            else
+            {
+                node->Set[(unsigned char)c] = true;
+                ++pos;
+            }
+
+            if (!matchCase)
+                AddOtherCases(node->Set);
+            return std::move(node);
+        }
+
+        bool ParseClass(std::bitset<256> &set)
+        {
+            ++pos;
+            bool negate = false;
+            if (pos < pattern.size() && pattern[pos] == '^')
+            {
+                negate = true;
+                ++pos;
+            }
+
+            bool first = true;
+            while (pos < pattern.size() && (pattern[pos] != ']' || first))
+            {
+                first = false;
+
+                std::bitset<256> item;
+                int single = -1;
+                if (pattern[pos] == '\\')
+                {
+                    if (!ParseEscape(item))
+                        return false;
+                    if (item.count() == 1)
+                        single = FirstSetBit(item);
+                }
+                else
+                {
+                    single = (unsigned char)pattern[pos++];
+                    item[single] = true;
+                }
+
+                //a range, unless the '-' is the last thing in the class
+                if (single >= 0 && pos + 1 < pattern.size() && pattern[pos] == '-' && pattern[pos + 1] != ']')
+                {
+                    ++pos;
+                    int last;
+                    if (pattern[pos] == '\\')
+                    {
+                        std::bitset<256> lastItem;
+                        if (!ParseEscape(lastItem))
+                            return false;
+                        if (lastItem.count() != 1)
+                        {
+                            Fail("invalid range in class");
+                            return false;
+                        }
+                        last = FirstSetBit(lastItem);
+                    }
+                    else
+                        last = (unsigned char)pattern[pos++];
+
+                    if (last < single)
+                    {
+                        Fail("range out of order in class");
+                        return false;
+                    }
+                    AddRange(item, single, last);
+                }
+
+                set |= item;
+            }
+
+            if (pos >= pattern.size())
+            {
+                Fail("missing ']'");
+                return false;
+            }
+
+            ++pos;
+            if (!matchCase)
+                AddOtherCases(set);
+            if (negate)
+                set.flip();
+            return true;
+        }
+
+        bool ParseEscape(std::bitset<256> &set)
+        {
+            ++pos;
+            if (pos >= pattern.size())
+            {
+                Fail("pattern ends with '\\'");
+                return false;
+            }
+
+            char c = pattern[pos++];
+            switch (c)
+            {
+            case 'd':
+            case 'D':
+                AddRange(set, '0', '9');
+                break;
+            case 'w':
+            case 'W':
+                AddRange(set, '0', '9');
+                AddRange(set, 'a', 'z');
+                AddRange(set, 'A', 'Z');
+                set[(unsigned char)'_'] = true;
+                break;
+            case 's':
+            case 'S':
+                for (char space : { ' ', '\t', '\r', '\n', '\f', '\v' })
+                    set[(unsigned char)space] = true;
+                break;
+            case 't':
+                set[(unsigned char)'\t'] = true;
+                break;
+            case 'r':
+                set[(unsigned char)'\r'] = true;
+                break;
+            case 'n':
+                set[(unsigned char)'\n'] = true;
+                break;
+            case 'f':
+                set[(unsigned char)'\f'] = true;
+                break;
+            case 'v':
+                set[(unsigned char)'\v'] = true;
+                break;
+            case 'x':
+            {
+                int value = 0;
+                for (int digit = 0; digit < 2; ++digit)
+                {
+                    char h = pos < pattern.size() ? pattern[pos] : 0;
+                    if (h >= '0' && h <= '9')
+                        value = value * 16 + (h - '0');
+                    else if (h >= 'a' && h <= 'f')
+                        value = value * 16 + (h - 'a' + 10);
+                    else if (h >= 'A' && h <= 'F')
+                        value = value * 16 + (h - 'A' + 10);
+                    else
+                    {
+                        Fail("\\x needs two hex digits");
+                        return false;
+                    }
+                    ++pos;
+                }
+                set[value] = true;
+                break;
+            }
+            default:
+                //escaped punctuation is just itself.  other letters and digits are things like backreferences and word boundaries, which aren't supported.
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+                {
+                    Fail(std::string("unsupported escape '\\") + c + "'");
+                    return false;
+                }
+                set[(unsigned char)c] = true;
+                break;
+            }
+
+            if (c == 'D' || c == 'W' || c == 'S')
+                set.flip();
+            return true;
+        }
+
+        static int FirstSetBit(const std::bitset<256> &set)
+        {
+            for (int c = 0; c < 256; ++c)
+            {
+                if (set[c])
+                    return c;
+            }
+
+            return -1;
+        }
+
+        std::string_view pattern;
+        bool matchCase;
+        size_t pos = 0;
+        int depth = 0;
+        std::string error;
+    };
+
+    //a piece of the NFA under construction.  holes are the unconnected exits, as state * 2 + (0 for Out, 1 for Out1).
+    struct Fragment
+    {
+        int Start;
+        std::vector<int> Holes;
+    };
+
+    //the literal that every match starts with, if the pattern begins with one
+    std::string FindLiteralPrefix(const AstNode &root, bool matchCase)
+    {
+        std::vector<const AstNode*> sequence;
+        if (root.NodeKind == AstNode::Kind::Concat)
+        {
+            for (auto &child : root.Children)
+                sequence.push_back(child.get());
+        }
+        else
+            sequence.push_back(&root);
+
+        std::string prefix;
+        for (const AstNode *node : sequence)
+        {
+            if (node->NodeKind != AstNode::Kind::Set)
+                break;
+
+            //one byte, or when ignoring case, both cases of one letter
+            size_t count = node->Set.count();
+            int c = -1;
+            for (int i = 0; i < 256 && c < 0; ++i)
+            {
+                if (node->Set[i])
+                    c = i;
+            }
+
+            bool isLetterPair = !matchCase && count == 2 && c >= 'A' && c <= 'Z' && node->Set[c - 'A' + 'a'];
+            if (count != 1 && !isLetterPair)
+                break;
+
+            prefix.push_back((char)c);
+        }
+
+        return prefix;
+    }
+}
+
+std::shared_ptr<const LinearRegex> LinearRegex::Compile(std::string_view pattern, bool matchCase, std::string &outError)
+{
+    Parser parser { pattern, matchCase };
+    std::unique_ptr<AstNode> root = parser.Parse(outError);
+    if (!root)
+        return nullptr;
+
+    auto regex = std::make_shared<LinearRegex>();
+    regex->matchCase = matchCase;
+    regex->literalPrefix = FindLiteralPrefix(*root, matchCase);
+
+    //thompson construction
+    std::vector<NfaState> &nfa = regex->nfa;
+    bool tooLarge = false;
+    auto addState = [&](StateType type, int out, int out1, uint32_t charSet)
+    {
+        if (nfa.size() >= MaxNfaStates)
+            tooLarge = true;
+        nfa.push_back({ type, out, out1, charSet });
+        return (int)nfa.size() - 1;
+    };
+
+    auto patch = [&](const std::vector<int> &holes, int target)
+    {
+        for (int hole : holes)
+        {
+            if (hole & 1)
+                nfa[hole / 2].Out1 = target;
+            else
+                nfa[hole / 2].Out = target;
+        }
+    };
+
+    //the parser already limits nesting, but the tree is walked recursively so it's checked again here rather than trusting every path that builds one
+    int emitDepth = 0;
+    bool tooDeep = false;
+    std::function<Fragment(const AstNode&)> emit;
+    std::function<Fragment(const AstNode&)> emitNode = [&](const AstNode &node) -> Fragment
+    {
+        if (tooLarge)
+            return { 0, {} };
+
+        switch (node.NodeKind)
+        {
+        case AstNode::Kind::Set:
+        {
+            regex->charSets.push_back(node.Set);
+            int s = addState(StateType::Char, -1, -1, (uint32_t)regex->charSets.size() - 1);
+            return { s, { s * 2 } };
+        }
+        case AstNode::Kind::Begin:
+        case AstNode::Kind::End:
+        case AstNode::Kind::Empty:
+        {
+            int s = addState(node.NodeKind == AstNode::Kind::Begin ? StateType::AssertBegin : node.NodeKind == AstNode::Kind::End ? StateType::AssertEnd : StateType::Epsilon, -1, -1, 0);
+            return { s, { s * 2 } };
+        }
+        case AstNode::Kind::Concat:
+        {
+            Fragment whole = emit(*node.Children[0]);
+            for (size_t i = 1; i < node.Children.size(); ++i)
+            {
+                Fragment next = emit(*node.Children[i]);
+                patch(whole.Holes, next.Start);
+                whole.Holes = std::move(next.Holes);
+            }
+            return whole;
+        }
+        case AstNode::Kind::Alternate:
+        {
+            Fragment whole = emit(*node.Children.back());
+            for (size_t i = node.Children.size() - 1; i-- > 0;)
+            {
+                Fragment option = emit(*node.Children[i]);
+                int s = addState(StateType::Split, option.Start, whole.Start, 0);
+                whole.Start = s;
+                whole.Holes.insert(whole.Holes.end(), option.Holes.begin(), option.Holes.end());
+            }
+            return whole;
+        }
+        default: //repeat
+        {
+            const AstNode &child = *node.Children[0];
+            Fragment whole = { -1, {} };
+            auto append = [&](Fragment next)
+            {
+                if (whole.Start < 0)
+                    whole = std::move(next);
+                else
+                {
+                    patch(whole.Holes, next.Start);
+                    whole.Holes = std::move(next.Holes);
+                }
+            };
+
+            int required = node.Max == -1 ? std::max(node.Min - 1, 0) : node.Min;
+            for (int i = 0; i < required && !tooLarge; ++i)
+                append(emit(child));
+
+            if (node.Max == -1)
+            {
+                //a loop, entered once for + and optionally for *
+                Fragment body = emit(child);
+                int s = addState(StateType::Split, body.Start, -1, 0);
+                patch(body.Holes, s);
+                append({ node.Min == 0 ? s : body.Start, { s * 2 + 1 } });
+            }
+            else
+            {
+                for (int i = node.Min; i < node.Max && !tooLarge; ++i)
+                {
+                    Fragment body = emit(child);
+                    int s = addState(StateType::Split, body.Start, -1, 0);
+                    body.Holes.push_back(s * 2 + 1);
+                    append({ s, std::move(body.Holes) });
+                }
+            }
+
+            if (whole.Start < 0) //{0}
+            {
+                int s = addState(StateType::Epsilon, -1, -1, 0);
+                whole = { s, { s * 2 } };
+            }
+            return whole;
+        }
+        }
+    };
+
+    emit = [&](const AstNode &node) -> Fragment
+    {
+        if (tooLarge || tooDeep)
+            return { 0, {} };
+        if (emitDepth >= MaxAstDepth)
+        {
+            tooDeep = true;
+            return { 0, {} };
+        }
+
+        ++emitDepth;
+        Fragment fragment = emitNode(node);
+        --emitDepth;
+        return fragment;
+    };
+
+    Fragment whole = emit(*root);
+    int matchState = addState(StateType::Match, -1, -1, 0);
+    if (tooDeep)
+    {
+        outError = "pattern is too deeply nested";
+        return nullptr;
+    }
+    if (tooLarge)
+    {
+        outError = "pattern is too large";
+        return nullptr;
+    }
+
+    patch(whole.Holes, matchState);
+    regex->nfaStart = whole.Start;
+    StepScratch scratch;
+    std::vector<int> emptyMatchSet;
+    regex->Closure({ regex->nfaStart }, true, true, emptyMatchSet, scratch);
+    regex->matchesEmpty = regex->ContainsMatch(emptyMatchSet);
+    regex->BuildByteClasses();
+    regex->hasDfa = regex->BuildDfa();
+    return regex;
+}
+
+LinearRegex::~LinearRegex() = default;
+
+//a DFA built a state at a time as searches reach them
+struct LinearRegex::LazyDfa
+{
+    std::map<std::vector<int>, uint32_t> StateIds;
+    std::vector<const std::vector<int>*> States; //keys of StateIds
+    std::vector<uint32_t> Transitions; //UnknownDfaState until first taken
+    std::vector<uint8_t> Accepts;
+    std::vector<uint8_t> AcceptsAtEnd; //0 until first needed, then 1 for no and 2 for yes
+    uint32_t StartAtBegin = UnknownDfaState;
+    uint32_t StartInText = UnknownDfaState;
+    size_t Flushes = 0;
+    size_t BytesSinceFlush = 0;
+    bool GaveUp = false;
+
+    std::vector<int> Set;
+    std::vector<int> NextSet;
+    StepScratch Scratch;
+};
+
+void LinearRegex::AddClosure(int state, bool atBegin, bool atEnd, std::vector<int> &set, StepScratch &scratch) const
+{
+    std::vector<int> &pending = scratch.Pending;
+    pending.clear();
+    pending.push_back(state);
+    while (!pending.empty())
+    {
+        int s = pending.back();
+        pending.pop_back();
+        if (s < 0 || scratch.Marks[s] == scratch.Mark)
+            continue;
+        scratch.Marks[s] = scratch.Mark;
+
+        const NfaState &ns = nfa[s];
+        switch (ns.Type)
+        {
+        case StateType::Split:
+            pending.push_back(ns.Out1);
+            pending.push_back(ns.Out);
+            break;
+        case StateType::Epsilon:
+            pending.push_back(ns.Out);
+            break;
+        case StateType::AssertBegin:
+        case StateType::AssertEnd:
+            //unsatisfied assertions stay in the set, since the end assertion may still be satisfied once the text runs out
+            if (ns.Type == StateType::AssertBegin ? atBegin : atEnd)
+                pending.push_back(ns.Out);
+            else
+                set.push_back(s);
+            break;
+        default:
+            set.push_back(s);
+            break;
+        }
+    }
+}
+
+void LinearRegex::Closure(const std::vector<int> &states, bool atBegin, bool atEnd, std::vector<int> &outSet, StepScratch &scratch) const
+{
+    //each closure marks the states it visited with a new number, so the marks only need clearing when the numbers run out
+    if (scratch.Marks.size() != nfa.size() || scratch.Mark == UINT32_MAX)
+    {
+        scratch.Marks.assign(nfa.size(), 0);
+        scratch.Mark = 0;
+    }
+    ++scratch.Mark;
+
+    outSet.clear();
+    for (int s : states)
+        AddClosure(s, atBegin, atEnd, outSet, scratch);
+
+    std::sort(outSet.begin(), outSet.end());
+}
+
+void LinearRegex::Step(const std::vector<int> &set, uint8_t c, std::vector<int> &outSet, StepScratch &scratch) const
+{
+    //the start state is added back at every position, so a match can begin anywhere
+    std::vector<int> &next = scratch.Next;
+    next.clear();
+    next.push_back(nfaStart);
+    for (int s : set)
+    {
+        if (nfa[s].Type == StateType::Char && charSets[nfa[s].CharSet][c])
+            next.push_back(nfa[s].Out);
+    }
+
+    Closure(next, false, false, outSet, scratch);
+}
+
+bool LinearRegex::ContainsMatch(const std::vector<int> &set) const
+{
+    return std::any_of(set.begin(), set.end(), [&](int s) { return nfa[s].Type == StateType::Match; });
+}
+
+void LinearRegex::BuildByteClasses()
+{
+    //split the bytes into classes, refining by each set in the pattern
+    byteClasses.fill(0);
+    byteClassCount = 1;
+    for (const auto &charSet : charSets)
+    {
+        std::map<std::pair<uint8_t, bool>, uint8_t> refined;
+        for (int c = 0; c < 256; ++c)
+        {
+            auto key = std::make_pair(byteClasses[c], (bool)charSet[c]);
+            auto found = refined.find(key);
+            if (found == refined.end())
+                found = refined.emplace(key, (uint8_t)refined.size()).first;
+            byteClasses[c] = found->second;
+        }
+        byteClassCount = refined.size();
+    }
+}
+
+bool LinearRegex::BuildDfa()
+{
+    std::array<uint8_t, 256> classExample = {};
+    for (int c = 255; c >= 0; --c)
+        classExample[byteClasses[c]] = (uint8_t)c;
+
+    //subset construction over every reachable set, giving up if it gets too big
+    std::map<std::vector<int>, uint32_t> stateIds;
+    std::vector<std::vector<int>> states;
+    auto findOrAdd = [&](std::vector<int> &&set)
+    {
+        auto found = stateIds.find(set);
+        if (found != stateIds.end())
+            return found->second;
+
+        uint32_t id = (uint32_t)states.size();
+        stateIds.emplace(set, id);
+        states.emplace_back(std::move(set));
+        return id;
+    };
+
+    StepScratch scratch;
+    std::vector<int> set;
+    Closure({ nfaStart }, true, false, set, scratch);
+    dfaStartAtBegin = findOrAdd(std::move(set));
+    Closure({ nfaStart }, false, false, set, scratch);
+    dfaStartInText = findOrAdd(std::move(set));
+
+    for (size_t id = 0; id < states.size(); ++id)
+    {
+        if (states.size() > MaxDfaStates)
+        {
+            dfaTransitions.clear();
+            dfaAccepts.clear();
+            dfaAcceptsAtEnd.clear();
+            return false;
+        }
+
+        bool accepts = ContainsMatch(states[id]);
+        dfaAccepts.push_back(accepts);
+        Closure(states[id], false, true, set, scratch);
+        dfaAcceptsAtEnd.push_back(accepts || ContainsMatch(set));
+
+        for (size_t cls = 0; cls < byteClassCount; ++cls)
+        {
+            //searching stops at the first accepting state, so its transitions are never used
+            uint32_t next = (uint32_t)id;
+            if (!accepts)
+            {
+                Step(states[id], classExample[cls], set, scratch);
+                next = findOrAdd(std::move(set));
+            }
+            dfaTransitions.push_back(next);
+        }
+    }
+
+    return true;
+}
+
+uint32_t LinearRegex::AddLazyState(LazyDfa &dfa, const std::vector<int> &set) const
+{
+    auto found = dfa.StateIds.find(set);
+    if (found != dfa.StateIds.end())
+        return found->second;
+
+    //when the cache is full start it over, so memory stays bounded however many states the text walks through.  if hardly any bytes were matched from
+    //the cache before it filled, the text reaches new states nearly every byte and building them costs more than it saves.
+    if (dfa.States.size() >= MaxLazyDfaStates)
+    {
+        if (dfa.BytesSinceFlush < dfa.States.size() * MinBytesPerLazyState)
+            dfa.GaveUp = true;
+        dfa.BytesSinceFlush = 0;
+
+        dfa.StateIds.clear();
+        dfa.States.clear();
+        dfa.Transitions.clear();
+        dfa.Accepts.clear();
+        dfa.AcceptsAtEnd.clear();
+        dfa.StartAtBegin = UnknownDfaState;
+        dfa.StartInText = UnknownDfaState;
+        ++dfa.Flushes;
+    }
+
+    uint32_t id = (uint32_t)dfa.States.size();
+    dfa.States.push_back(&dfa.StateIds.emplace(set, id).first->first);
+    dfa.Transitions.resize(dfa.Transitions.size() + byteClassCount, UnknownDfaState);
+    dfa.Accepts.push_back(ContainsMatch(set));
+    dfa.AcceptsAtEnd.push_back(0);
+    return id;
+}
+
+uint32_t LinearRegex::LazyStart(LazyDfa &dfa, bool atBegin) const
+{
+    uint32_t start = atBegin ? dfa.StartAtBegin : dfa.StartInText;
+    if (start != UnknownDfaState)
+        return start;
+
+    Closure({ nfaStart }, atBegin, false, dfa.Set, dfa.Scratch);
+    start = AddLazyState(dfa, dfa.Set);
+    (atBegin ? dfa.StartAtBegin : dfa.StartInText) = start;
+    return start;
+}
+
+uint32_t LinearRegex::LazyTransition(LazyDfa &dfa, uint32_t state, uint8_t c) const
+{
+    Step(*dfa.States[state], c, dfa.Set, dfa.Scratch);
+
+    size_t flushes = dfa.Flushes;
+    uint32_t next = AddLazyState(dfa, dfa.Set);
+
+    //if the cache was started over, the state this came from is gone and there's nowhere to keep the transition
+    if (dfa.Flushes == flushes)
+        dfa.Transitions[state * byteClassCount + byteClasses[c]] = next;
+    return next;
+}
+
+bool LinearRegex::LazyAcceptsAtEnd(LazyDfa &dfa, uint32_t state) const
+{
+    if (dfa.AcceptsAtEnd[state] == 0)
+    {
+        Closure(*dfa.States[state], false, true, dfa.Set, dfa.Scratch);
+        dfa.AcceptsAtEnd[state] = dfa.Accepts[state] || ContainsMatch(dfa.Set) ? 2 : 1;
+    }
+
+    return dfa.AcceptsAtEnd[state] == 2;
+}
+
+bool LinearRegex::SearchLazyDfa(std::string_view text, size_t start, LazyDfa &dfa) const
+{
+    if (dfa.GaveUp)
+        return SimulateNfa(text, start, dfa);
+
+    uint32_t state = LazyStart(dfa, start == 0);
+    size_t countedPos = start;
+    for (size_t pos = start; pos < text.size(); ++pos)
+    {
+        if (dfa.Accepts[state])
+            return true;
+
+        uint8_t c = (uint8_t)text[pos];
+        uint32_t next = dfa.Transitions[state * byteClassCount + byteClasses[c]];
+        if (next == UnknownDfaState)
+        {
+            dfa.BytesSinceFlush += pos - countedPos;
+            countedPos = pos;
+
+            next = LazyTransition(dfa, state, c);
+            if (dfa.GaveUp)
+                return SimulateNfa(text, start, dfa);
+        }
+        state = next;
+    }
+
+    dfa.BytesSinceFlush += text.size() - countedPos;
+    return LazyAcceptsAtEnd(dfa, state);
+}
+
+bool LinearRegex::SimulateNfa(std::string_view text, size_t start, LazyDfa &dfa) const
+{
+    std::vector<int> &set = dfa.Set;
+    std::vector<int> &next = dfa.NextSet;
+    next.assign(1, nfaStart);
+    Closure(next, start == 0, false, set, dfa.Scratch);
+    for (size_t pos = start; pos < text.size(); ++pos)
+    {
+        if (ContainsMatch(set))
+            return true;
+        Step(set, (uint8_t)text[pos], next, dfa.Scratch);
+        set.swap(next);
+    }
+
+    Closure(set, false, true, next, dfa.Scratch);
+    return ContainsMatch(next);
+}
+
+bool LinearRegex::Search(std::string_view text) const
+{
+    if (text.empty())
+        return matchesEmpty;
+
+    //nothing can match before the first place the prefix appears, and the automaton finds matches starting anywhere after that
+    size_t start = 0;
+    if (!literalPrefix.empty())
+    {
+        start = matchCase ? text.find(literalPrefix) : CaseInsensitiveSearch::Find(text, literalPrefix);
+        if (start == std::string_view::npos)
+            return false;
+    }
+
+    if (!hasDfa)
+    {
+        std::unique_ptr<LazyDfa> dfa;
+        {
+            std::lock_guard<std::mutex> lock(lazyDfaMutex);
+            if (!idleLazyDfas.empty())
+            {
+                dfa = std::move(idleLazyDfas.back());
+                idleLazyDfas.pop_back();
+            }
+        }
+
+        if (!dfa)
+            dfa = std::make_unique<LazyDfa>();
+
+        bool found = SearchLazyDfa(text, start, *dfa);
+
+        std::lock_guard<std::mutex> lock(lazyDfaMutex);
+        idleLazyDfas.push_back(std::move(dfa));
+        return found;
+    }
+
+    uint32_t state = start == 0 ? dfaStartAtBegin : dfaStartInText;
+    for (size_t pos = start; pos < text.size(); ++pos)
+    {
+        if (dfaAccepts[state])
+            return true;
+        state = dfaTransitions[state * byteClassCount + byteClasses[(uint8_t)text[pos]]];
+    }
+
+    return dfaAcceptsAtEnd[state] != 0;
+}
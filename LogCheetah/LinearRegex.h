@@ -0,0 +1,96 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+//Regular expressions for filtering, matched without backtracking so the time taken is linear in the length of the text whatever the pattern is.  Patterns are
+//compiled to an NFA, which is turned into a DFA up front when that stays small enough.  Otherwise DFA states are built as the text reaches them, into a cache of
+//bounded size that's thrown away and started over when it fills, or when it keeps filling, the NFA is simulated directly.
+//Supports literals, '.', classes such as [a-f0-9] and [^,], the escapes \d \w \s (and \D \W \S), \t \r \n \xHH, groups, '|', '*', '+', '?', {m}, {m,}, {m,n},
+//and '^' and '$' anchored to the start and end of the text.  Backreferences and lookaround can't be matched in linear time, so they're rejected.
+class LinearRegex
+{
+public:
+    //returns null, with a description of the problem in outError, if the pattern isn't valid.  case folding is ASCII only.
+    static std::shared_ptr<const LinearRegex> Compile(std::string_view pattern, bool matchCase, std::string &outError);
+
+    ~LinearRegex();
+
+    //true if the pattern matches anywhere in text
+    bool Search(std::string_view text) const;
+
+private:
+    enum class StateType : uint8_t
+    {
+        Char,
+        Split,
+        Epsilon,
+        AssertBegin,
+        AssertEnd,
+        Match
+    };
+
+    struct NfaState
+    {
+        StateType Type;
+        int Out;
+        int Out1;
+        uint32_t CharSet;
+    };
+
+    //buffers kept from one step to the next, so matching doesn't allocate for each byte
+    struct StepScratch
+    {
+        std::vector<int> Pending;
+        std::vector<int> Next;
+        std::vector<uint32_t> Marks;
+        uint32_t Mark = 0;
+    };
+
+    struct LazyDfa;
+
+    void AddClosure(int state, bool atBegin, bool atEnd, std::vector<int> &set, StepScratch &scratch) const;
+    void Closure(const std::vector<int> &states, bool atBegin, bool atEnd, std::vector<int> &outSet, StepScratch &scratch) const;
+    void Step(const std::vector<int> &set, uint8_t c, std::vector<int> &outSet, StepScratch &scratch) const;
+    bool ContainsMatch(const std::vector<int> &set) const;
+    void BuildByteClasses();
+    bool BuildDfa();
+    uint32_t AddLazyState(LazyDfa &dfa, const std::vector<int> &set) const;
+    uint32_t LazyStart(LazyDfa &dfa, bool atBegin) const;
+    uint32_t LazyTransition(LazyDfa &dfa, uint32_t state, uint8_t c) const;
+    bool LazyAcceptsAtEnd(LazyDfa &dfa, uint32_t state) const;
+    bool SearchLazyDfa(std::string_view text, size_t start, LazyDfa &dfa) const;
+    bool SimulateNfa(std::string_view text, size_t start, LazyDfa &dfa) const;
+
+    std::vector<NfaState> nfa;
+    std::vector<std::bitset<256>> charSets;
+    int nfaStart = 0;
+    bool matchesEmpty = false;
+
+    //a literal every match has to start with, found with a plain substring search before running the automaton
+    std::string literalPrefix;
+    bool matchCase = true;
+
+    //the DFA works on classes of bytes that no part of the pattern tells apart
+    bool hasDfa = false;
+    std::array<uint8_t, 256> byteClasses = {};
+    size_t byteClassCount = 0;
+    std::vector<uint32_t> dfaTransitions;
+    std::vector<uint8_t> dfaAccepts;
+    std::vector<uint8_t> dfaAcceptsAtEnd;
+    uint32_t dfaStartAtBegin = 0;
+    uint32_t dfaStartInText = 0;
+
+    //caches for patterns whose DFA is too big to build up front.  each search takes one to itself, since lines are filtered on many threads at once.
+    mutable std::mutex lazyDfaMutex;
+    mutable std::vector<std::unique_ptr<LazyDfa>> idleLazyDfas;
+};
@@ -3,103 +3,580 @@
 
 #include "LogParserCommon.h"
 #include "SharedGlobals.h"
+#include "ThreadPool.h"
+#include "RowSorter.h"
+#include "CaseInsensitiveSearch.h"
+#include "TrigramIndex.h"
+#include "FilterExpression.h"
+#include "TypedColumn.h"
 #include <atomic>
-#include <thread>
+#include <sstream>
 #include <cctype>
 #include <cassert>
+#include <cmath>
+#include <limits>
 
 namespace
 {
-    bool DoesStringMatchFilter(const ExternalSubstring<const char> &str, const LogFilterEntry &filter)
+    //how many rows, spread evenly through the logs, are used to estimate how often each filter passes
+    const size_t PlannerSampleRows = 256;
+
+    //operators as the filter list and FilterExpression write them, by CompiledLogFilter::MatchKind
+    const char *matchKindNames[] = { "==", "~=", "=", "~", "/", "in" };
+
+    inline char FoldCase(char c)
+    {
+        return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+    }
+
+    //the extractor only rebuilds columns from the original log, so columns added to the row after parsing (like DNS lookups) are copied over from the old row
+    void CarryOverAddedColumns(const LogEntry &source, LogEntry &dest)
     {
-        if (str.empty() && filter.Value.empty())
+        std::string extraData;
+        std::vector<LogEntryColumn> extraColumns;
+        for (auto cv = source.ColumnDataBegin(); cv != source.ColumnDataEnd(); ++cv)
         {
-            bool match = !filter.Not;
-            if (!match)
-                return false;
+            const LogEntryColumn *found = std::lower_bound(dest.ColumnDataBegin(), dest.ColumnDataEnd(), cv->ColumnNumber, [](const LogEntryColumn &a, uint16_t b) { return a.ColumnNumber < b; });
+            if (found != dest.ColumnDataEnd() && found->ColumnNumber == cv->ColumnNumber)
+                continue;
+
+            uint32_t begin = (uint32_t)extraData.size();
+            extraData.append((const char*)source.ColumnDataBegin() + cv->IndexDataBegin, cv->IndexDataEnd - cv->IndexDataBegin);
+            extraColumns.emplace_back(cv->ColumnNumber, begin, (uint32_t)extraData.size());
         }
-        else
+
+        if (!extraColumns.empty())
+            dest.AppendExtra(extraData, extraColumns);
+    }
+
+    //find the lowest log index within haystack that is above the lowest low within needles, based on date (or whatever column is the sort priority)
+    size_t FindMinDateOverlapIndex(const std::vector<LogEntry> &haystack, const std::vector<LogEntry> &needles, const std::vector<LogSortEntry> &sortOrder)
+    {
+        if (needles.empty() || haystack.empty())
+            return haystack.size();
+
+        //compare the way the haystack was sorted, so a merge can't put rows out of order
+        auto before = [&sortOrder](const LogEntry &a, const LogEntry &b) { return RowSorter::CompareRows(a, b, sortOrder) < 0; };
+
+        auto lowestNeedleIter = std::min_element(needles.begin(), needles.end(), before);
+
+        size_t ind = haystack.size() - 1;
+        while (ind > 0)
         {
-            bool compareResult;
-            if (filter.MatchSubstring)
+            if (before(haystack[ind], *lowestNeedleIter))
+                break;
+
+            --ind;
+        }
+
+        return ind;
+    }
+}
+
+CompiledLogFilter::Test CompiledLogFilter::CompileTest(const LogFilterEntry &filter, const LogCollection &logs)
+{
+    Test test;
+    test.Column = filter.Column;
+    test.Not = filter.Not;
+    test.Value = filter.Value;
+    if (filter.Comparison != FilterComparison::Match)
+    {
+        const double infinity = std::numeric_limits<double>::infinity();
+        const int64_t minTicks = std::numeric_limits<int64_t>::min();
+        const int64_t maxTicks = std::numeric_limits<int64_t>::max();
+
+        test.Kind = MatchKind::Range;
+        switch (filter.Comparison)
+        {
+        case FilterComparison::Less:
+            test.Value = "(.., " + filter.Value + ")";
+            break;
+        case FilterComparison::LessEqual:
+            test.Value = "(.., " + filter.Value + "]";
+            break;
+        case FilterComparison::Greater:
+            test.Value = "(" + filter.Value + ", ..)";
+            break;
+        case FilterComparison::GreaterEqual:
+            test.Value = "[" + filter.Value + ", ..)";
+            break;
+        default:
+            test.Value = "[" + filter.Value + ", " + filter.UpperValue + "]";
+            break;
+        }
+
+        if (!TypedColumn::FindRangeType(filter, test.RangeType))
+            return test;
+
+        //strict comparisons become inclusive ones against the next value over
+        if (test.RangeType == RangeValueType::Number)
+        {
+            double value = 0, upperValue = 0;
+            TypedColumn::ParseNumber(filter.Value, value);
+            TypedColumn::ParseNumber(filter.UpperValue, upperValue);
+            switch (filter.Comparison)
             {
-                if (filter.MatchCase)
-                    compareResult = (str.find(filter.Value) != std::string::npos);
-                else
-                    compareResult = (std::search(str.begin(), str.end(), filter.Value.begin(), filter.Value.end(), [](char c0, char c1) {return std::toupper(c0) == std::toupper(c1); }) != str.end());
+            case FilterComparison::Less:
+                test.Lower = -infinity;
+                test.Upper = std::nextafter(value, -infinity);
+                break;
+            case FilterComparison::LessEqual:
+                test.Lower = -infinity;
+                test.Upper = value;
+                break;
+            case FilterComparison::Greater:
+                test.Lower = std::nextafter(value, infinity);
+                test.Upper = infinity;
+                break;
+            case FilterComparison::GreaterEqual:
+                test.Lower = value;
+                test.Upper = infinity;
+                break;
+            default:
+                test.Lower = value;
+                test.Upper = upperValue;
+                break;
             }
-            else
+        }
+        else
+        {
+            int64_t ticks = 0, upperTicks = 0;
+            TypedColumn::ParseTime(filter.Value, ticks);
+            TypedColumn::ParseTime(filter.UpperValue, upperTicks);
+            switch (filter.Comparison)
             {
-                if (filter.MatchCase)
-                    compareResult = (str == filter.Value);
-                else
-                    compareResult = str.CaseInsensitiveCompare(filter.Value);
+            case FilterComparison::Less:
+                test.LowerTicks = minTicks;
+                test.UpperTicks = ticks - 1;
+                break;
+            case FilterComparison::LessEqual:
+                test.LowerTicks = minTicks;
+                test.UpperTicks = ticks;
+                break;
+            case FilterComparison::Greater:
+                test.LowerTicks = ticks + 1;
+                test.UpperTicks = maxTicks;
+                break;
+            case FilterComparison::GreaterEqual:
+                test.LowerTicks = ticks;
+                test.UpperTicks = maxTicks;
+                break;
+            default:
+                test.LowerTicks = ticks;
+                test.UpperTicks = upperTicks;
+                break;
             }
+        }
 
-            if (filter.Not)
-                compareResult = !compareResult;
+        if (filter.Column >= 0)
+            test.Typed = logs.FindTypedColumn((uint16_t)filter.Column, test.RangeType);
 
-            if (!compareResult)
-                return false;
+        if (test.RangeType == RangeValueType::Time && test.Typed)
+        {
+            test.Lower = (test.LowerTicks == minTicks ? -infinity : test.Typed->StoredTime(test.LowerTicks));
+            test.Upper = (test.UpperTicks == maxTicks ? infinity : test.Typed->StoredTime(test.UpperTicks));
         }
 
-        return true;
+        return test;
     }
 
-    //find the lowest log index within haystack that is above the lowest low within needles, based on date (or whatever column is the sort priority)
-    size_t FindMinDateOverlapIndex(const LogCollection &haystack, const LogCollection &needles, uint16_t sortColumn, bool sortAscending)
+    if (filter.Regex)
     {
-        if (needles.Lines.empty() || haystack.Lines.empty())
-            return haystack.Lines.size();
+        std::string error;
+        test.Kind = MatchKind::Pattern;
+        test.Pattern = LinearRegex::Compile(filter.MatchSubstring ? filter.Value : "^(?:" + filter.Value + ")$", filter.MatchCase, error);
+        return test;
+    }
+
+    if (filter.MatchSubstring)
+        test.Kind = filter.MatchCase ? MatchKind::Substring : MatchKind::SubstringFolded;
+    else
+        test.Kind = filter.MatchCase ? MatchKind::Exact : MatchKind::ExactFolded;
 
-        auto lowestNeedleIter = std::min_element(needles.Lines.begin(), needles.Lines.end(), [sortColumn, sortAscending](const LogEntry &a, const LogEntry &b) { return a.Compare(b, sortColumn, sortAscending); });
+    if (!filter.MatchCase)
+        std::transform(test.Value.begin(), test.Value.end(), test.Value.begin(), FoldCase);
 
-        size_t ind = haystack.Lines.size() - 1;
-        while (ind > 0)
+    return test;
+}
+
+void CompiledLogFilter::AddEntry(Node &parent, const LogFilterEntry &filter, const LogCollection &logs)
+{
+    if (!filter.Expression)
+    {
+        parent.Children.emplace_back();
+        parent.Children.back().Kind = NodeKind::Test;
+        parent.Children.back().Leaf = CompileTest(filter, logs);
+        return;
+    }
+
+    //a query that no longer parses (the columns it named are gone) matches nothing, as an empty OR
+    FilterExpression expression;
+    std::string error;
+    Node compiled;
+    compiled.Kind = NodeKind::Or;
+    if (FilterExpression::Parse(filter.Value, logs.Columns, expression, error))
+    {
+        std::function<void(const FilterExpression&, Node&)> convert = [&](const FilterExpression &from, Node &to)
         {
-            if (haystack.Lines[ind].Compare(*lowestNeedleIter, sortColumn, sortAscending))
+            switch (from.Kind)
+            {
+            case FilterExpression::NodeKind::Test:
+                to.Kind = NodeKind::Test;
+                to.Leaf = CompileTest(from.Test, logs);
+                break;
+            case FilterExpression::NodeKind::And:
+                to.Kind = NodeKind::And;
                 break;
+            case FilterExpression::NodeKind::Or:
+                to.Kind = NodeKind::Or;
+                break;
+            default:
+                to.Kind = NodeKind::Not;
+                break;
+            }
 
-            --ind;
+            to.Children.resize(from.Children.size());
+            for (size_t i = 0; i < from.Children.size(); ++i)
+                convert(from.Children[i], to.Children[i]);
+        };
+        convert(expression, compiled);
+    }
+
+    if (filter.Not)
+    {
+        Node negated;
+        negated.Kind = NodeKind::Not;
+        negated.Children.emplace_back(std::move(compiled));
+        compiled = std::move(negated);
+    }
+
+    //the parts of an AND join the other filters, so they're all ordered together
+    if (compiled.Kind == NodeKind::And && parent.Kind == NodeKind::And)
+    {
+        for (auto &c : compiled.Children)
+            parent.Children.emplace_back(std::move(c));
+    }
+    else
+        parent.Children.emplace_back(std::move(compiled));
+}
+
+CompiledLogFilter::CompiledLogFilter(const std::vector<LogFilterEntry> &filters, const LogCollection &logs)
+{
+    for (const LogFilterEntry &f : filters)
+        AddEntry(root, f, logs);
+
+    std::vector<size_t> sampleRows;
+    size_t sampleCount = std::min(logs.Lines.size(), PlannerSampleRows);
+    for (size_t i = 0; i < sampleCount; ++i)
+        sampleRows.push_back(i * logs.Lines.size() / sampleCount);
+
+    std::vector<bool> samplePasses;
+    Plan(root, logs, sampleRows, samplePasses);
+}
+
+void CompiledLogFilter::Plan(Node &node, const LogCollection &logs, const std::vector<size_t> &sampleRows, std::vector<bool> &outSamplePasses)
+{
+    auto shareOf = [&](const std::vector<bool> &passes)
+    {
+        return (std::count(passes.begin(), passes.end(), true) + 0.5) / (passes.size() + 1.0);
+    };
+
+    outSamplePasses.assign(sampleRows.size(), node.Kind == NodeKind::And);
+
+    if (node.Kind == NodeKind::Test)
+    {
+        //exact matches mostly fail on the length alone, and searching a whole raw line costs the most.  a range on a typed column is just two comparisons.
+        if (node.Leaf.Kind == MatchKind::Range)
+            node.Cost = (node.Leaf.Typed ? 1.0 : 4.0);
+        else
+            node.Cost = 1.0 + (int)node.Leaf.Kind + (node.Leaf.Column < 0 ? 5.0 : 0.0);
+        for (size_t i = 0; i < sampleRows.size(); ++i)
+            outSamplePasses[i] = TestPasses(node.Leaf, logs.Lines[sampleRows[i]], sampleRows[i]);
+        node.Selectivity = shareOf(outSamplePasses);
+        return;
+    }
+
+    std::vector<std::vector<bool>> childPasses(node.Children.size());
+    for (size_t c = 0; c < node.Children.size(); ++c)
+        Plan(node.Children[c], logs, sampleRows, childPasses[c]);
+
+    if (node.Kind == NodeKind::Not)
+    {
+        node.Cost = node.Children[0].Cost;
+        outSamplePasses = childPasses[0];
+        outSamplePasses.flip();
+        node.Selectivity = shareOf(outSamplePasses);
+        return;
+    }
+
+    //an AND stops at the first failure, so cheap tests that fail a lot go first.  an OR stops at the first pass, so cheap tests that pass a lot go first.
+    bool isAnd = (node.Kind == NodeKind::And);
+    std::vector<size_t> order(node.Children.size());
+    for (size_t c = 0; c < order.size(); ++c)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        const Node &na = node.Children[a];
+        const Node &nb = node.Children[b];
+        double aSettles = isAnd ? 1.0 - na.Selectivity : na.Selectivity;
+        double bSettles = isAnd ? 1.0 - nb.Selectivity : nb.Selectivity;
+        return na.Cost * bSettles < nb.Cost * aSettles;
+    });
+
+    //each child only costs anything for the sampled rows the ones before it didn't settle
+    std::vector<Node> ordered;
+    ordered.reserve(order.size());
+    node.Cost = 0;
+    double unsettled = 1.0;
+    std::vector<bool> settled(sampleRows.size(), false);
+    for (size_t c : order)
+    {
+        node.Cost += unsettled * node.Children[c].Cost;
+        for (size_t i = 0; i < sampleRows.size(); ++i)
+        {
+            if (!settled[i] && childPasses[c][i] != isAnd)
+            {
+                settled[i] = true;
+                outSamplePasses[i] = !isAnd;
+            }
         }
+        unsettled = 1.0 - shareOf(settled);
+        ordered.emplace_back(std::move(node.Children[c]));
+    }
 
-        return ind;
+    node.Children = std::move(ordered);
+    node.Selectivity = shareOf(outSamplePasses);
+}
+
+bool CompiledLogFilter::DoesStringMatch(const ExternalSubstring<const char> &str, const Test &test)
+{
+    bool match;
+    if (test.Kind == MatchKind::Pattern)
+        match = test.Pattern && test.Pattern->Search(std::string_view(str.begin(), str.size()));
+    else if (str.empty() && test.Value.empty())
+        match = true;
+    else
+    {
+        switch (test.Kind)
+        {
+        case MatchKind::Exact:
+            match = (str == test.Value);
+            break;
+        case MatchKind::ExactFolded:
+            match = (str.size() == test.Value.size() && std::equal(str.begin(), str.end(), test.Value.begin(), [](char c0, char c1) { return FoldCase(c0) == c1; }));
+            break;
+        case MatchKind::Substring:
+            match = (str.find(test.Value) != std::string::npos);
+            break;
+        default:
+            match = (CaseInsensitiveSearch::Find(std::string_view(str.begin(), str.size()), test.Value) != std::string_view::npos);
+            break;
+        }
     }
+
+    return match != test.Not;
 }
 
-bool DoesLogEntryPassFilters(const LogEntry &entry, const std::vector<LogFilterEntry> &filters)
+bool CompiledLogFilter::IsInRange(const ExternalSubstring<const char> &str, const Test &test)
 {
-    for (auto &f : filters)
+    std::string_view text { str.begin(), str.size() };
+    if (test.RangeType == RangeValueType::Number)
+    {
+        double value = 0;
+        return TypedColumn::ParseNumber(text, value) && value >= test.Lower && value <= test.Upper;
+    }
+
+    int64_t ticks = 0;
+    return TypedColumn::ParseTime(text, ticks) && ticks >= test.LowerTicks && ticks <= test.UpperTicks;
+}
+
+bool CompiledLogFilter::TestPasses(const Test &test, const LogEntry &entry, size_t row)
+{
+    if (test.Kind == MatchKind::Range)
+    {
+        if (test.Typed && row < test.Typed->RowCount())
+        {
+            double value = test.Typed->Value(row);
+            return (value >= test.Lower && value <= test.Upper) != test.Not;
+        }
+
+        if (test.Column < 0)
+            return IsInRange(ExternalSubstring<const char>(entry.OriginalLogBegin(), entry.OriginalLogEnd()), test) != test.Not;
+
+        return IsInRange(entry.GetColumnNumberValue((uint16_t)test.Column), test) != test.Not;
+    }
+
+    if (test.Column < 0) //raw line - check both original log data and extra data
+    {
+        bool match = DoesStringMatch(ExternalSubstring<const char>(entry.OriginalLogBegin(), entry.OriginalLogEnd()), test);
+        if (!match && !test.Not)
+            match = DoesStringMatch(ExternalSubstring<const char>(entry.ExtraDataBegin(), entry.ExtraDataEnd()), test);
+
+        return match;
+    }
+
+    return DoesStringMatch(entry.GetColumnNumberValue((uint16_t)test.Column), test);
+}
+
+bool CompiledLogFilter::NodePasses(const Node &node, const LogEntry &entry, size_t row)
+{
+    switch (node.Kind)
     {
-        ExternalSubstring<const char> entryString;
-        if (f.Column < 0) //raw line - check both original log data and extra data
+    case NodeKind::Test:
+        return TestPasses(node.Leaf, entry, row);
+    case NodeKind::And:
+        for (const Node &c : node.Children)
         {
-            entryString = ExternalSubstring<const char>(entry.OriginalLogBegin(), entry.OriginalLogEnd());
-            bool match = DoesStringMatchFilter(entryString, f);
-            if (f.Not && !match)
+            if (!NodePasses(c, entry, row))
                 return false;
+        }
+        return true;
+    case NodeKind::Or:
+        for (const Node &c : node.Children)
+        {
+            if (NodePasses(c, entry, row))
+                return true;
+        }
+        return false;
+    default:
+        return !NodePasses(node.Children[0], entry, row);
+    }
+}
 
-            if (!match)
+bool CompiledLogFilter::Passes(const LogEntry &entry, size_t row) const
+{
+    return NodePasses(root, entry, row);
+}
+
+bool CompiledLogFilter::CollectCandidateBlocks(const Node &node, const TrigramIndex &index, std::vector<uint32_t> &outBlocks)
+{
+    //column values are slices of the raw text, so whatever a positive test matches is in there too.  negated tests, patterns, and ranges can't narrow anything.
+    if (node.Kind == NodeKind::Test)
+        return !node.Leaf.Not && node.Leaf.Kind != MatchKind::Pattern && node.Leaf.Kind != MatchKind::Range && index.FindCandidateBlocks(node.Leaf.Value, outBlocks);
+
+    //an AND can only pass where all of the children that narrow anything can, and an OR only narrows things down when every child does
+    std::vector<uint32_t> childBlocks;
+    std::vector<uint32_t> combined;
+    bool anyNarrowed = false;
+    outBlocks.clear();
+    if (node.Kind == NodeKind::And)
+    {
+        for (const Node &c : node.Children)
+        {
+            if (!CollectCandidateBlocks(c, index, childBlocks))
+                continue;
+
+            if (anyNarrowed)
             {
-                entryString = ExternalSubstring<const char>(entry.ExtraDataBegin(), entry.ExtraDataEnd());
-                match = DoesStringMatchFilter(entryString, f);
+                combined.clear();
+                std::set_intersection(outBlocks.begin(), outBlocks.end(), childBlocks.begin(), childBlocks.end(), std::back_inserter(combined));
+                outBlocks.swap(combined);
             }
+            else
+                outBlocks.swap(childBlocks);
 
-            if (!match)
-                return false;
+            anyNarrowed = true;
         }
-        else
+
+        return anyNarrowed;
+    }
+    else if (node.Kind == NodeKind::Or)
+    {
+        for (const Node &c : node.Children)
         {
-            entryString = entry.GetColumnNumberValue((uint16_t)f.Column);
-            if (!DoesStringMatchFilter(entryString, f))
+            if (!CollectCandidateBlocks(c, index, childBlocks))
                 return false;
+
+            combined.clear();
+            std::set_union(outBlocks.begin(), outBlocks.end(), childBlocks.begin(), childBlocks.end(), std::back_inserter(combined));
+            outBlocks.swap(combined);
         }
+
+        return true;
     }
 
-    return true;
+    return false;
 }
 
-std::tuple<bool, int64_t> FindNextLogline(int64_t initialPosition, int direction, const std::vector<LogFilterEntry> &filters, const LogCollection &logs, const std::vector<uint32_t> &rowVisibilityMap)
+bool CompiledLogFilter::FindCandidateRows(const LogCollection &logs, RowBitmap &outRows) const
+{
+    outRows.clear();
+    bool anyNarrowed = false;
+    auto narrow = [&](RowBitmap &&rows)
+    {
+        outRows = anyNarrowed ? RowBitmap::And(outRows, rows) : std::move(rows);
+        anyNarrowed = true;
+    };
+
+    //a range on a typed column that every row has to pass gives its rows directly
+    for (const Node &c : root.Children)
+    {
+        bool negated = (c.Kind == NodeKind::Not);
+        const Node &n = negated ? c.Children[0] : c;
+        if (n.Kind != NodeKind::Test || n.Leaf.Kind != MatchKind::Range || !n.Leaf.Typed || n.Leaf.Typed->RowCount() != logs.Lines.size())
+            continue;
+
+        RowBitmap rows = n.Leaf.Typed->FindRange(n.Leaf.Lower, n.Leaf.Upper);
+        if (negated != n.Leaf.Not)
+            rows = RowBitmap::AndNot(RowBitmap::AllRows(logs.Lines.size()), rows);
+        narrow(std::move(rows));
+    }
+
+    //when a good share of the blocks could match, testing every row is just as quick
+    std::vector<uint32_t> blocks;
+    if (logs.IsSearchIndexCurrent() && CollectCandidateBlocks(root, *logs.SearchIndex, blocks) && blocks.size() <= logs.SearchIndex->BlockCount() / 4)
+    {
+        RowBitmap blockRows;
+        for (uint32_t block : blocks)
+        {
+            size_t rowBegin = block * TrigramIndex::RowsPerBlock;
+            size_t rowEnd = std::min(rowBegin + TrigramIndex::RowsPerBlock, logs.Lines.size());
+            for (size_t row = rowBegin; row < rowEnd; ++row)
+                blockRows.Append((uint32_t)row);
+        }
+        narrow(std::move(blockRows));
+    }
+
+    return anyNarrowed;
+}
+
+void CompiledLogFilter::DescribeNode(const Node &node, const LogCollection &logs, std::string &out)
+{
+    std::ostringstream ss;
+    ss.precision(3);
+    if (node.Kind == NodeKind::Test)
+    {
+        ss << (node.Leaf.Column >= 0 && node.Leaf.Column < (int)logs.Columns.size() ? logs.Columns[node.Leaf.Column].UniqueName : "*") << " ";
+        ss << (node.Leaf.Not ? "!" : "") << matchKindNames[(int)node.Leaf.Kind] << " " << node.Leaf.Value;
+        if (node.Leaf.Kind == MatchKind::Range)
+            ss << (node.Leaf.RangeType == RangeValueType::Number ? " as numbers" : " as times") << (node.Leaf.Typed ? ", typed" : "");
+    }
+    else
+    {
+        ss << (node.Kind == NodeKind::And ? "AND(" : node.Kind == NodeKind::Or ? "OR(" : "NOT(");
+        out += ss.str();
+        ss.str("");
+        for (size_t c = 0; c < node.Children.size(); ++c)
+        {
+            if (c)
+                out += ", ";
+            DescribeNode(node.Children[c], logs, out);
+        }
+        ss << ")";
+    }
+
+    ss << " [cost " << node.Cost << ", passes " << node.Selectivity * 100.0 << "%]";
+    out += ss.str();
+}
+
+std::string CompiledLogFilter::DescribePlan(const LogCollection &logs) const
+{
+    std::string out;
+    DescribeNode(root, logs, out);
+    return out;
+}
+
+std::tuple<bool, int64_t> FindNextLogline(int64_t initialPosition, int direction, const CompiledLogFilter &compiledFilter, const LogCollection &logs, const RowBitmap &rowVisibilityMap)
 {
     int64_t bestFound = -1;
     if (!(initialPosition < 0 || initialPosition >= (int64_t)rowVisibilityMap.size()))
@@ -109,39 +586,56 @@ std::tuple<bool, int64_t> FindNextLogline(int64_t initialPosition, int direction
         threadResults.resize(cpuCountFilter, -1);
         std::atomic<bool> anyFound = false;
 
-        std::vector<std::thread> threads;
-        threads.reserve(cpuCountFilter);
-        for (int cpu = 0; cpu < cpuCountFilter; ++cpu)
+        //with a search index only the visible candidate rows need testing, walking from the starting row
+        RowBitmap candidateRows;
+        if (compiledFilter.FindCandidateRows(logs, candidateRows))
         {
-            threads.emplace_back([&](int threadIndex)
+            candidateRows = RowBitmap::And(rowVisibilityMap, candidateRows);
+            int64_t c = (int64_t)candidateRows.Rank(rowVisibilityMap[initialPosition]) - (direction > 0 ? 0 : 1);
+            if (direction < 0 && candidateRows.Contains(rowVisibilityMap[initialPosition]))
+                ++c;
+
+            for (auto candidateIter = candidateRows.IteratorAt((size_t)c); c >= 0 && c < (int64_t)candidateRows.size(); c += direction)
             {
-                while (!anyFound)
-                {
-                    int64_t currentThreadBlockStart = nextThreadStart.fetch_add(direction * 100);
-                    int64_t currentThreadBlockEnd = currentThreadBlockStart + direction * 100;
-                    currentThreadBlockEnd = std::clamp(currentThreadBlockEnd, -1ll, (int64_t)rowVisibilityMap.size());
+                uint32_t dataRow = *candidateIter;
+                if (compiledFilter.Passes(logs.Lines[dataRow], dataRow))
+                    return { true, (int64_t)rowVisibilityMap.Rank(dataRow) };
 
-                    if (currentThreadBlockStart < 0 || currentThreadBlockStart >= (int64_t)rowVisibilityMap.size())
-                        break;
+                if (c + direction >= 0 && c + direction < (int64_t)candidateRows.size())
+                    direction > 0 ? ++candidateIter : --candidateIter;
+            }
+
+            return { false, -1 };
+        }
+
+        ThreadPool::Instance().Run(cpuCountFilter, [&](size_t threadIndex)
+        {
+            while (!anyFound)
+            {
+                int64_t currentThreadBlockStart = nextThreadStart.fetch_add(direction * 100);
+                int64_t currentThreadBlockEnd = currentThreadBlockStart + direction * 100;
+                currentThreadBlockEnd = std::clamp(currentThreadBlockEnd, -1ll, (int64_t)rowVisibilityMap.size());
 
-                    for (int64_t visibleRow = currentThreadBlockStart; visibleRow != currentThreadBlockEnd; visibleRow += direction)
+                if (currentThreadBlockStart < 0 || currentThreadBlockStart >= (int64_t)rowVisibilityMap.size())
+                    break;
+
+                auto visibleIter = rowVisibilityMap.IteratorAt((size_t)currentThreadBlockStart);
+                for (int64_t visibleRow = currentThreadBlockStart; visibleRow != currentThreadBlockEnd; visibleRow += direction)
+                {
+                    uint32_t dataRow = *visibleIter;
+                    if (visibleRow + direction != currentThreadBlockEnd)
+                        direction > 0 ? ++visibleIter : --visibleIter;
+                    const LogEntry &le = logs.Lines[dataRow];
+
+                    if (compiledFilter.Passes(le, dataRow))
                     {
-                        uint32_t dataRow = rowVisibilityMap[visibleRow];
-                        const LogEntry &le = logs.Lines[dataRow];
-
-                        if (DoesLogEntryPassFilters(le, filters))
-                        {
-                            anyFound = true;
-                            threadResults[threadIndex] = visibleRow;
-                            break;
-                        }
+                        anyFound = true;
+                        threadResults[threadIndex] = visibleRow;
+                        break;
                     }
                 }
-            }, cpu);
-        }
-
-        for (auto &t : threads)
-            t.join();
+            }
+        });
 
         for (int64_t f : threadResults)
         {
@@ -250,6 +744,8 @@ void LogEntry::Clear()
     extraDataEnd = 0;
     ParseFailed = false;
     Tagged = false;
+    HasDeferredColumns = false;
+    CatchAllColumn = false;
 }
 
 void LogEntry::AppendExtra(const std::string &extraData, const std::vector<LogEntryColumn> &extraDataColumns)
@@ -341,6 +837,16 @@ void LogCollection::MoveAndMergeInLogs(AppStatusMonitor &monitor, LogCollection
 #endif
 
     outBeginRowAffected = outEndRowAffected = 0;
+    InvalidateRowIndexes();
+
+    //rows with deferred columns can only be kept that way if their extractor comes along with them
+    if (other.DeferredColumnExtractor)
+    {
+        if (!DeferredColumnExtractor || Parser == other.Parser)
+            DeferredColumnExtractor = other.DeferredColumnExtractor;
+        else
+            other.ExtractAllDeferredColumns(monitor);
+    }
 
     monitor.SetControlFeatures(true);
     monitor.SetProgressFeatures(other.Lines.size(), "kiloline", 1000);
@@ -348,13 +854,9 @@ void LogCollection::MoveAndMergeInLogs(AppStatusMonitor &monitor, LogCollection
     auto tpBegin = std::chrono::high_resolution_clock::now();
 
     //if the destination is empty then take the sources supplemental data
+    bool takeSortOrder = Lines.empty();
     if (Lines.empty())
-    {
-        SortColumn = other.SortColumn;
-        SortAscending = other.SortAscending;
-
         Parser = std::move(other.Parser);
-    }
     else if (Parser != other.Parser) //different parsers were used, so just clear this optional field
         Parser = nullptr;
 
@@ -385,19 +887,40 @@ void LogCollection::MoveAndMergeInLogs(AppStatusMonitor &monitor, LogCollection
         {
             if (Columns[existing].Description.empty() && !otherColumn.Description.empty())
                 Columns[existing].Description = otherColumn.Description;
+            if (otherColumn.Deferred)
+                Columns[existing].Deferred = true;
         }
 
         otherColumnToExistingColumnMapping.emplace_back(existing);
     }
 
+    if (takeSortOrder)
+    {
+        SortOrder = other.SortOrder;
+        for (LogSortEntry &entry : SortOrder)
+            entry.Column = (uint16_t)otherColumnToExistingColumnMapping[entry.Column];
+    }
+
+    //remap the column indices of the new lines, so they can be compared with ours
+    std::vector<LogEntry> lines = std::move(other.Lines);
+    for (auto &entry : lines)
+    {
+        for (auto cvIter = entry.ColumnDataBegin(); cvIter != entry.ColumnDataEnd(); ++cvIter)
+        {
+            LogEntryColumn &cv = *cvIter;
+            cv.ColumnNumber = (uint16_t)otherColumnToExistingColumnMapping[cv.ColumnNumber];
+        }
+
+        if (!entry.IsEmpty() && entry.ColumnCount() > 0)
+            std::sort(entry.ColumnDataBegin(), entry.ColumnDataEnd());
+    }
+
     //deduplicate if needed
     size_t minIndexToAlter = 0;
     if (resortLogs || filterDuplicateLogs)
-        minIndexToAlter = FindMinDateOverlapIndex(*this, other, SortColumn, SortAscending);
+        minIndexToAlter = FindMinDateOverlapIndex(Lines, lines, SortOrder);
     outBeginRowAffected = minIndexToAlter;
 
-    std::vector<LogEntry> lines = std::move(other.Lines);
-
     if (filterDuplicateLogs)
     {
         std::vector<LogEntry> uniqueLines;
@@ -421,21 +944,10 @@ void LogCollection::MoveAndMergeInLogs(AppStatusMonitor &monitor, LogCollection
         lines = std::move(uniqueLines);
     }
 
-    //merge in the lines and remap their column indices
+    //merge in the lines
     for (auto &sourceEntry : lines)
     {
         Lines.emplace_back(std::move(sourceEntry));
-        auto &destEntry = Lines.back();
-
-        for (auto cvIter = destEntry.ColumnDataBegin(); cvIter != destEntry.ColumnDataEnd(); ++cvIter)
-        {
-            LogEntryColumn &cv = *cvIter;
-            cv.ColumnNumber = (uint16_t)otherColumnToExistingColumnMapping[cv.ColumnNumber];
-        }
-
-        if (!destEntry.IsEmpty() && destEntry.ColumnCount() > 0)
-            std::sort(destEntry.ColumnDataBegin(), destEntry.ColumnDataEnd());
-
         monitor.AddProgress(1);
     }
 
@@ -453,46 +965,181 @@ void LogCollection::MoveAndMergeInLogs(AppStatusMonitor &monitor, LogCollection
 
 void LogCollection::SortRange(size_t lineStart, size_t lineEnd)
 {
-    //tiny case
-    if (lineEnd - lineStart < cpuCountSort)
+    InvalidateRowIndexes();
+    std::vector<uint32_t> sortColumns;
+    for (const LogSortEntry &entry : SortOrder)
+        sortColumns.emplace_back(entry.Column);
+    ExtractDeferredColumns(AppStatusMonitor::Instance, sortColumns);
+
+    //rows merged in later keep the order the whole collection was given, even if they'd look like another type on their own
+    if (lineStart == 0)
     {
-        std::stable_sort(Lines.begin() + lineStart, Lines.begin() + lineEnd, [this](const LogEntry &a, const LogEntry &b) { return a.Compare(b, SortColumn, SortAscending); });
+        for (LogSortEntry &entry : SortOrder)
+            entry.Type = RowSorter::InferType(Lines, lineStart, lineEnd, entry.Column);
+    }
+
+    RowSorter::Sort(Lines, lineStart, lineEnd, SortOrder, cpuCountSort);
+}
+
+void LogCollection::ExtractDeferredColumns(AppStatusMonitor &monitor, const std::vector<uint32_t> &columns)
+{
+    if (!DeferredColumnExtractor)
         return;
+
+    bool anyNewColumns = false;
+    for (uint32_t c : columns)
+    {
+        if (c < Columns.size() && Columns[c].Deferred)
+        {
+            Columns[c].Deferred = false;
+            anyNewColumns = true;
+        }
     }
 
-    //determine the ranges to divide among the CPUs
-    std::vector<std::pair<size_t, size_t>> ranges;
-    for (int cpu = 0; cpu < cpuCountSort; ++cpu)
+    if (!anyNewColumns)
+        return;
+
+    InvalidateRowIndexes();
+    auto tpBegin = std::chrono::high_resolution_clock::now();
+
+    //rows are rebuilt with everything that's available so far plus the new columns
+    std::unordered_map<std::string, uint16_t> availableColumns;
+    for (size_t c = 0; c < Columns.size(); ++c)
     {
-        ranges.emplace_back();
-        ranges.back().first = lineStart + (lineEnd - lineStart) / cpuCountSort * cpu;
-        ranges.back().second = ranges.back().first + (lineEnd - lineStart) / cpuCountSort;
-        if (cpu == cpuCountSort - 1)
-            ranges.back().second = lineEnd;
+        if (!Columns[c].Deferred)
+            availableColumns.emplace(Columns[c].UniqueName, (uint16_t)c);
     }
 
-    //sort chunks seperately
-    if (lineEnd - lineStart > cpuCountSort)
+    //not cancellable, since the columns are already marked as extracted
+    ParallelFor(AppStatusMonitor::Instance, cpuCountParse, 0, Lines.size(), 1000, [&](size_t threadIndex, size_t blockStart, size_t blockEnd)
     {
-        std::vector<std::thread> threads;
-        threads.reserve(cpuCountSort);
-        for (int cpu = 0; cpu < cpuCountSort; ++cpu)
+        for (size_t row = blockStart; row < blockEnd; ++row)
         {
-            threads.emplace_back([&](int threadIndex)
-            {
-                size_t myStart = ranges[threadIndex].first;
-                size_t myEnd = ranges[threadIndex].second;
-                std::stable_sort(Lines.begin() + myStart, Lines.begin() + myEnd, [this](const LogEntry &a, const LogEntry &b) { return a.Compare(b, SortColumn, SortAscending); });
-            }, cpu);
+            LogEntry &le = Lines[row];
+            if (!le.HasDeferredColumns)
+                continue;
+
+            LogEntry extracted;
+            DeferredColumnExtractor(le, availableColumns, extracted);
+            CarryOverAddedColumns(le, extracted);
+            extracted.ParseFailed = le.ParseFailed;
+            extracted.Tagged = le.Tagged;
+            extracted.CatchAllColumn = le.CatchAllColumn;
+            le = std::move(extracted);
         }
+    });
+
+    auto tpEnd = std::chrono::high_resolution_clock::now();
+    monitor.AddDebugOutputTime("ExtractDeferredColumns", std::chrono::duration_cast<std::chrono::microseconds>(tpEnd - tpBegin).count() / 1000.0);
+}
+
+void LogCollection::ExtractDeferredColumns(AppStatusMonitor &monitor, const std::vector<LogFilterEntry> &filters)
+{
+    std::vector<uint32_t> columns;
+    for (auto &f : filters)
+    {
+        FilterExpression expression;
+        std::string error;
+        if (!f.Expression && f.Column >= 0)
+            columns.push_back((uint32_t)f.Column);
+        else if (f.Expression && FilterExpression::Parse(f.Value, Columns, expression, error))
+            expression.CollectColumns(columns);
+    }
+
+    ExtractDeferredColumns(monitor, columns);
+}
+
+void LogCollection::ExtractAllDeferredColumns(AppStatusMonitor &monitor)
+{
+    std::vector<uint32_t> columns;
+    for (size_t c = 0; c < Columns.size(); ++c)
+        columns.push_back((uint32_t)c);
+
+    ExtractDeferredColumns(monitor, columns);
+}
+
+void LogCollection::UpdateSearchIndex(AppStatusMonitor &monitor)
+{
+    if (!indexRawTextForSearch || Lines.empty() || IsSearchIndexCurrent())
+        return;
+
+    SearchIndex = TrigramIndex::Build(monitor, *this);
+}
 
-        for (auto &t : threads)
-            t.join();
+bool LogCollection::IsSearchIndexCurrent() const
+{
+    return SearchIndex && SearchIndex->RowCount() == Lines.size();
+}
+
+void LogCollection::UpdateTypedColumns(AppStatusMonitor &monitor, const std::vector<LogFilterEntry> &filters)
+{
+    std::vector<std::pair<uint16_t, RangeValueType>> rangeColumns;
+    auto addRange = [&](const LogFilterEntry &f)
+    {
+        RangeValueType type;
+        if (f.Comparison != FilterComparison::Match && f.Column >= 0 && TypedColumn::FindRangeType(f, type))
+            rangeColumns.emplace_back((uint16_t)f.Column, type);
+    };
+
+    std::function<void(const FilterExpression&)> addExpressionRanges = [&](const FilterExpression &expression)
+    {
+        if (expression.Kind == FilterExpression::NodeKind::Test)
+            addRange(expression.Test);
+
+        for (auto &c : expression.Children)
+            addExpressionRanges(c);
+    };
+
+    for (auto &f : filters)
+    {
+        FilterExpression expression;
+        std::string error;
+        if (!f.Expression)
+            addRange(f);
+        else if (FilterExpression::Parse(f.Value, Columns, expression, error))
+            addExpressionRanges(expression);
+    }
+
+    for (auto [column, type] : rangeColumns)
+    {
+        if (FindTypedColumn(column, type))
+            continue;
+
+        std::shared_ptr<const TypedColumn> typed = TypedColumn::Build(monitor, *this, column, type);
+        if (!typed)
+            return;
+
+        std::erase_if(TypedColumns, [&](const std::shared_ptr<const TypedColumn> &t) { return t->Column() == column && t->Type() == type; });
+        TypedColumns.emplace_back(std::move(typed));
+    }
+}
+
+std::shared_ptr<const TypedColumn> LogCollection::FindTypedColumn(uint16_t column, RangeValueType type) const
+{
+    for (auto &t : TypedColumns)
+    {
+        if (t->Column() == column && t->Type() == type && t->RowCount() == Lines.size())
+            return t;
     }
 
-    //merge sorted chunks together
-    for (int i = 1; i < cpuCountSort; ++i)
-        std::inplace_merge(Lines.begin(), Lines.begin() + ranges[i].first, Lines.begin() + ranges[i].second, [this](const LogEntry &a, const LogEntry &b) { return a.Compare(b, SortColumn, SortAscending); });
+    return nullptr;
+}
+
+bool LogCollection::ExtractFullRow(size_t row, LogEntry &dest) const
+{
+    if (!DeferredColumnExtractor || !Lines[row].HasDeferredColumns)
+        return false;
+
+    std::unordered_map<std::string, uint16_t> allColumns;
+    for (size_t c = 0; c < Columns.size(); ++c)
+        allColumns.emplace(Columns[c].UniqueName, (uint16_t)c);
+
+    DeferredColumnExtractor(Lines[row], allColumns, dest);
+    CarryOverAddedColumns(Lines[row], dest);
+    dest.ParseFailed = Lines[row].ParseFailed;
+    dest.Tagged = Lines[row].Tagged;
+    dest.CatchAllColumn = Lines[row].CatchAllColumn;
+    return true;
 }
 
 bool ParserFilter::PassesLineFilters(const ExternalSubstring<const char> &line) const
@@ -500,10 +1147,12 @@ bool ParserFilter::PassesLineFilters(const ExternalSubstring<const char> &line)
     for (auto &pf : LineFilters)
     {
         bool lineMatch;
-        if (pf.MatchCase)
+        if (pf.Regex)
+            lineMatch = pf.Pattern && pf.Pattern->Search(std::string_view(line.begin(), line.size()));
+        else if (pf.MatchCase)
             lineMatch = (line.find(pf.Value) != std::string::npos);
         else
-            lineMatch = (std::search(line.begin(), line.end(), pf.Value.begin(), pf.Value.end(), [](char c0, char c1) {return std::toupper(c0) == std::toupper(c1); }) != line.end());
+            lineMatch = (CaseInsensitiveSearch::Find(std::string_view(line.begin(), line.size()), pf.Value) != std::string_view::npos);
 
         if (pf.Not)
             lineMatch = !lineMatch;
@@ -515,6 +1164,28 @@ bool ParserFilter::PassesLineFilters(const ExternalSubstring<const char> &line)
     return true;
 }
 
+bool ParseLineBatches(AppStatusMonitor &monitor, std::vector<std::string> &lines, std::vector<LogEntry> &rows, size_t begin, size_t end, size_t batchSize, const std::function<std::unique_ptr<LineBatchParseWorker>(size_t threadIndex)> &makeWorker)
+{
+    assert(lines.size() == rows.size());
+    assert(begin <= end && end <= lines.size());
+
+    size_t batchCount = (end - begin + batchSize - 1) / batchSize;
+    size_t threadCount = std::max<size_t>(1, std::min<size_t>(cpuCountParse, batchCount));
+
+    //workers are made on first use, by whichever thread ends up running that worker index
+    std::vector<std::unique_ptr<LineBatchParseWorker>> workers(threadCount);
+    ParallelFor(monitor, threadCount, begin, end, batchSize, [&](size_t threadIndex, size_t batchBegin, size_t batchEnd)
+    {
+        if (!workers[threadIndex])
+            workers[threadIndex] = makeWorker(threadIndex);
+
+        monitor.AddProgress(batchEnd - batchBegin);
+        workers[threadIndex]->ParseBatch(std::span<std::string>(lines.data() + batchBegin, batchEnd - batchBegin), std::span<LogEntry>(rows.data() + batchBegin, batchEnd - batchBegin), batchBegin);
+    });
+
+    return !monitor.IsCancelling();
+}
+
 LogCollection ParserInterface::ProcessRawData(AppStatusMonitor &monitorLineParse, AppStatusMonitor &monitorLogParser, AppStatusMonitor &monitorMergeCompact, LogCollection &&existingLogsToMerge, std::vector<char> &&rawDataToConsume, const ParserFilter &filter)
 {
     if (monitorLineParse.IsCancelling())
@@ -614,13 +1285,22 @@ std::vector<std::string> ParserInterface::ParseRawToLines(AppStatusMonitor &moni
     std::vector<std::string> allLines;
     allLines.reserve(rawData.size() / 500); //stab in the dark
 
+    //lines are prefiltered a batch at a time, so only a batch worth of rejected lines are ever held onto
+    const size_t preFilterBatchSize = 4096;
+    size_t unfilteredBegin = 0;
+    auto preFilterPendingLines = [&]()
+    {
+        PreFilterLines(allLines, unfilteredBegin, filter);
+        unfilteredBegin = allLines.size();
+    };
+
     auto emitCurrentData = [&](decltype(rawData.begin()) start, decltype(rawData.begin()) end)
     {
         if (start < rawData.end() && start < end)
         {
             allLines.emplace_back(start, end);
-            if (!PreFilterLine(ExternalSubstring<const char>(allLines.back().begin(), allLines.back().end()), filter))
-                allLines.pop_back();
+            if (allLines.size() - unfilteredBegin >= preFilterBatchSize)
+                preFilterPendingLines();
         }
 
         auto skipTo = end;
@@ -648,6 +1328,7 @@ std::vector<std::string> ParserInterface::ParseRawToLines(AppStatusMonitor &moni
     }
 
     emitCurrentData(curStart, rawData.end());
+    preFilterPendingLines();
 
     auto tpAfterLines = std::chrono::high_resolution_clock::now();
     monitor.AddDebugOutputTime(Name + " - ParseRawToLines", std::chrono::duration_cast<std::chrono::microseconds>(tpAfterLines - tpBegin).count() / 1000.0);
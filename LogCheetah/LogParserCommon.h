@@ -8,10 +8,19 @@
 #include <vector>
 #include <array>
 #include <functional>
+#include <memory>
+#include <span>
+#include <algorithm>
+#include <unordered_map>
 #include "StringUtils.h"
 #include "SharedGlobals.h"
+#include "LinearRegex.h"
+#include "RowBitmap.h"
 
 class ParserInterface;
+struct LogFilterEntry;
+class TrigramIndex;
+class TypedColumn;
 
 // Packed data uses 16-bit column indices, with 24-bit data indices
 const size_t MaxLogEntryColumnIndex = 0x0000ffff;
@@ -54,13 +63,15 @@ private:
 public:
     bool ParseFailed : 1;
     bool Tagged : 1;
+    bool HasDeferredColumns : 1; //some column values are still only in the original log, see LogCollection::ExtractDeferredColumns
+    bool CatchAllColumn : 1; //the parser put every value in one column instead of naming them, so extracting deferred columns has to do the same
 
     //
-    inline LogEntry() : columnDataEnd(0), extraDataEnd(0), ParseFailed(false), Tagged(false)
+    inline LogEntry() : columnDataEnd(0), extraDataEnd(0), ParseFailed(false), Tagged(false), HasDeferredColumns(false), CatchAllColumn(false)
     {
     }
 
-    inline LogEntry(const std::string &originalLog, const std::string &extraData, const std::vector<LogEntryColumn> &originalLogColumns, const std::vector<LogEntryColumn> &extraDataColumns) : ParseFailed(false), Tagged(false)
+    inline LogEntry(const std::string &originalLog, const std::string &extraData, const std::vector<LogEntryColumn> &originalLogColumns, const std::vector<LogEntryColumn> &extraDataColumns) : ParseFailed(false), Tagged(false), HasDeferredColumns(false), CatchAllColumn(false)
     {
         Set(originalLog, extraData, originalLogColumns, extraDataColumns);
     }
@@ -129,6 +140,7 @@ struct ColumnInformation
     std::string UniqueName;
     std::string DisplayNameOverride;
     std::string Description;
+    bool Deferred = false; //values haven't been pulled out of the original logs yet, see LogCollection::ExtractDeferredColumns
 
     inline const std::string& GetDisplayName()
     {
@@ -139,6 +151,42 @@ struct ColumnInformation
     }
 };
 
+//how a range filter compares values: as numbers, or as ISO-8601 or US style times
+enum class RangeValueType : uint8_t
+{
+    Number,
+    Time
+};
+
+//how SortRange orders the values of a sort column.  the typed orders put empty values first and values that aren't of the type last, in text order.
+enum class SortType : uint8_t
+{
+    Text,
+    Number,
+    Time, //ISO-8601 or US style
+    Version //runs of digits compare as numbers, so 1.9 comes before 1.10
+};
+
+//one column rows are sorted by.  rows that tie on it are ordered by the next one, and rows that tie on all of them keep their order.
+struct LogSortEntry
+{
+    uint16_t Column = 0;
+    bool Ascending = true;
+    SortType Type = SortType::Text; //picked from the values whenever every row is sorted, and kept for sorting in rows merged later
+
+    bool operator==(const LogSortEntry &o) const = default;
+};
+
+enum class FilterComparison : uint8_t
+{
+    Match, //Value is matched as text, using MatchCase, MatchSubstring, and Regex
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Between //from Value to UpperValue, inclusive
+};
+
 struct LogCollection
 {
     //these are set by the parsers and should only be read by the application
@@ -149,9 +197,18 @@ struct LogCollection
     //this is set by ParserInterface and should only be read by the application.  it may be nullptr if logs from different parsers are merged
     ParserInterface* Parser = nullptr;
 
+    //set by parsers that leave the values of some columns in the original log text until they're needed.  rebuilds dest from the original log of source,
+    //with column data for just the given columns (by unique name), and sets dest.HasDeferredColumns if anything else was left out.
+    std::function<void(const LogEntry &source, const std::unordered_map<std::string, uint16_t> &columns, LogEntry &dest)> DeferredColumnExtractor;
+
+    //an index of the raw text of every row for narrowing down searches, or null.  it's dropped whenever rows are changed, and built again by UpdateSearchIndex.
+    std::shared_ptr<const TrigramIndex> SearchIndex;
+
+    //columns parsed into numbers or times for range filters, built by UpdateTypedColumns for the columns the filters compare that way.  dropped along with SearchIndex.
+    std::vector<std::shared_ptr<const TypedColumn>> TypedColumns;
+
     //run-time adjustable options
-    uint16_t SortColumn = 0;
-    bool SortAscending = true;
+    std::vector<LogSortEntry> SortOrder { LogSortEntry {} };
 
     //
     LogCollection() = default;
@@ -164,6 +221,28 @@ struct LogCollection
     void MoveAndMergeInLogs(AppStatusMonitor &monitor, LogCollection &&other, bool filterDuplicateLogs, bool resortLogs, size_t &outBeginRowAffected, size_t &outEndRowAffected);
 
     void SortRange(size_t lineStart, size_t lineEnd);
+
+    //makes sure every row has the values of the given columns, pulling any deferred ones out of the original logs.  once pulled out they stay that way.
+    //rows are rewritten, so this must only be called on the UI thread or from work in a write section, which stops the views from painting.  columns added to rows
+    //after parsing are kept.
+    void ExtractDeferredColumns(AppStatusMonitor &monitor, const std::vector<uint32_t> &columns);
+    void ExtractDeferredColumns(AppStatusMonitor &monitor, const std::vector<LogFilterEntry> &filters);
+    void ExtractAllDeferredColumns(AppStatusMonitor &monitor);
+
+    //fills dest with a copy of a row that has every column, without changing the collection.  returns false (leaving dest alone) if the row has nothing deferred.
+    bool ExtractFullRow(size_t row, LogEntry &dest) const;
+
+    //builds the search index if indexRawTextForSearch is set and there isn't an up to date one already.  anything that rewrites rows must call InvalidateSearchIndex.
+    void UpdateSearchIndex(AppStatusMonitor &monitor);
+    bool IsSearchIndexCurrent() const;
+    inline void InvalidateSearchIndex() { SearchIndex.reset(); }
+
+    //builds a typed column for each column a range filter compares, unless there's an up to date one already
+    void UpdateTypedColumns(AppStatusMonitor &monitor, const std::vector<LogFilterEntry> &filters);
+    std::shared_ptr<const TypedColumn> FindTypedColumn(uint16_t column, RangeValueType type) const;
+
+    //drops everything built from the rows, for anything that changes or reorders them
+    inline void InvalidateRowIndexes() { InvalidateSearchIndex(); TypedColumns.clear(); }
 };
 
 struct LogFilterEntry
@@ -173,16 +252,102 @@ struct LogFilterEntry
     bool Not = false;
     bool MatchCase = false;
     bool MatchSubstring = true;
+    bool Regex = false; //Value is a LinearRegex pattern, which has to match the whole value unless MatchSubstring is set
+    bool Expression = false; //Value is a FilterExpression query, which has its own columns and matching options, so only Not applies
+    FilterComparison Comparison = FilterComparison::Match; //anything else compares the column as numbers or times, and rows without one never pass
+    std::string UpperValue;
+
+    bool operator==(const LogFilterEntry &o) const = default;
+};
+
+//a set of filters compiled for testing lots of rows.  case folding of the values is done once up front, and filter expressions become a tree of tests.
+//the tests under each AND and OR are put in the order that settles a row for the least work, using how often each passes on a sample of the rows.
+class CompiledLogFilter
+{
+public:
+    CompiledLogFilter() = default;
+    CompiledLogFilter(const std::vector<LogFilterEntry> &filters, const LogCollection &logs);
+
+    //row is where entry is in the logs the filter was compiled for, which lets range tests read their typed columns instead of parsing the text
+    bool Passes(const LogEntry &entry, size_t row) const;
+    inline bool Passes(const LogEntry &entry) const { return Passes(entry, SIZE_MAX); }
+    inline bool Empty() const { return root.Kind == NodeKind::And && root.Children.empty(); }
+
+    //uses the search index and typed columns of logs to fill outRows with the rows that could pass, which still need testing with Passes.  returns false
+    //if there's nothing current in the filters they can help with, in which case every row has to be tested.
+    bool FindCandidateRows(const LogCollection &logs, RowBitmap &outRows) const;
+
+    //the tests in the order they'll run, with their estimated cost and share of rows passing, for debug output
+    std::string DescribePlan(const LogCollection &logs) const;
+
+private:
+    enum class MatchKind : uint8_t
+    {
+        Exact,
+        ExactFolded,
+        Substring,
+        SubstringFolded,
+        Pattern,
+        Range
+    };
+
+    struct Test
+    {
+        int Column = -1; //negative for the raw line
+        MatchKind Kind = MatchKind::Substring;
+        bool Not = false;
+        std::string Value; //uppercased for folded kinds
+        std::shared_ptr<const LinearRegex> Pattern; //null for an invalid pattern, which matches nothing
+
+        //range tests pass values from Lower to Upper inclusive, as numbers or as times in ticks (LowerTicks and UpperTicks).  Lower and Upper are in the
+        //form Typed stores them, when there's a typed column to read.  bounds that don't parse leave Lower above Upper, which matches nothing.
+        RangeValueType RangeType = RangeValueType::Number;
+        double Lower = 1;
+        double Upper = 0;
+        int64_t LowerTicks = 0;
+        int64_t UpperTicks = 0;
+        std::shared_ptr<const TypedColumn> Typed;
+    };
+
+    enum class NodeKind : uint8_t
+    {
+        Test,
+        And,
+        Or,
+        Not
+    };
+
+    struct Node
+    {
+        NodeKind Kind = NodeKind::And;
+        Test Leaf; //only used by Test nodes
+        std::vector<Node> Children; //an AND with none passes everything, and an OR with none passes nothing
+        double Cost = 1; //estimated work to evaluate it for one row
+        double Selectivity = 0.5; //estimated share of rows that pass it
+    };
+
+    static Test CompileTest(const LogFilterEntry &filter, const LogCollection &logs);
+    static void AddEntry(Node &parent, const LogFilterEntry &filter, const LogCollection &logs);
+    static void Plan(Node &node, const LogCollection &logs, const std::vector<size_t> &sampleRows, std::vector<bool> &outSamplePasses);
+    static bool DoesStringMatch(const ExternalSubstring<const char> &str, const Test &test);
+    static bool IsInRange(const ExternalSubstring<const char> &str, const Test &test);
+    static bool TestPasses(const Test &test, const LogEntry &entry, size_t row);
+    static bool NodePasses(const Node &node, const LogEntry &entry, size_t row);
+    static bool CollectCandidateBlocks(const Node &node, const TrigramIndex &index, std::vector<uint32_t> &outBlocks);
+    static void DescribeNode(const Node &node, const LogCollection &logs, std::string &out);
+
+    Node root;
 };
 
-bool DoesLogEntryPassFilters(const LogEntry &entry, const std::vector<LogFilterEntry> &filters);
-std::tuple<bool, int64_t> FindNextLogline(int64_t initialPosition, int direction, const std::vector<LogFilterEntry> &filters, const LogCollection &logs, const std::vector<uint32_t> &rowVisibilityMap);
+std::tuple<bool, int64_t> FindNextLogline(int64_t initialPosition, int direction, const CompiledLogFilter &compiledFilter, const LogCollection &logs, const RowBitmap &rowVisibilityMap);
 
 struct ParserLineFilterEntry
 {
     std::string Value;
     bool Not = false;
     bool MatchCase = true;
+    bool Regex = false;
+    std::shared_ptr<const LinearRegex> Pattern; //compiled from Value by whoever sets Regex, since lines are filtered on many threads at once
 };
 
 struct ParserFilter
@@ -201,11 +366,26 @@ struct ParserFilter
     bool PassesLineFilters(const ExternalSubstring<const char> &line) const;
 };
 
+//One worker thread's half of a batch parser.  Each thread gets its own worker, so it can keep scratch space around between batches without locking.
+//It's only called through the virtual once per batch, leaving the loop over lines inside ParseBatch free to be templated and inlined.
+class LineBatchParseWorker
+{
+public:
+    virtual ~LineBatchParseWorker() = default;
+
+    //parses each line into the row at the same position, and may consume the lines.  firstRow is where the batch starts in the whole set of lines.
+    virtual void ParseBatch(std::span<std::string> lines, std::span<LogEntry> rows, size_t firstRow) = 0;
+};
+
+//hands out batches of lines begin to end to parser threads, each with its own worker from makeWorker.  rows must already be the same size as lines.
+//progress is reported in lines.  returns false if cancelled, in which case some rows may be left unparsed.
+bool ParseLineBatches(AppStatusMonitor &monitor, std::vector<std::string> &lines, std::vector<LogEntry> &rows, size_t begin, size_t end, size_t batchSize, const std::function<std::unique_ptr<LineBatchParseWorker>(size_t threadIndex)> &makeWorker);
+
 class ParserInterface
 {
 public:
     inline ParserInterface(const std::string &name)
-        : Name(name), PreFilterLine(NoopPreFilterLine), PostFilterLines(NoopPostFilterLines), ParseRaw(NoopParseRaw), ParseLines(NoopParseLines), PreloadKnownSchemas(NoopPreloadKnownSchemas), LoadSchemaData(NoopLoadSchemaData), SaveSchemaData(NoopSaveSchemaData)
+        : Name(name), PreFilterLines(NoopPreFilterLines), PostFilterLines(NoopPostFilterLines), ParseRaw(NoopParseRaw), ParseLines(NoopParseLines), PreloadKnownSchemas(NoopPreloadKnownSchemas), LoadSchemaData(NoopLoadSchemaData), SaveSchemaData(NoopSaveSchemaData)
     {
     }
 
@@ -215,7 +395,7 @@ public:
     ParserInterface& operator=(ParserInterface&&) = default;
 
     inline static ParserInterface MakePreFilterTextParser(const std::string &name,
-        std::function<bool(const ExternalSubstring<const char> &line, const ParserFilter &filter)> preFilterLine,
+        std::function<void(std::vector<std::string> &lines, size_t firstLine, const ParserFilter &filter)> preFilterLines,
         std::function<LogCollection(AppStatusMonitor &monitor, std::vector<std::string> &&linesToConsume)> parseLogs,
         std::function<void(AppStatusMonitor &monitor)> preloadKnownSchemas,
         std::function<void(AppStatusMonitor &monitor, const std::string &blob)> loadSchemaData,
@@ -224,7 +404,7 @@ public:
         bool producesFakeJson = false)
     {
         ParserInterface pi { name };
-        pi.PreFilterLine = preFilterLine;
+        pi.PreFilterLines = preFilterLines;
         pi.ParseLines = parseLogs;
         pi.PreloadKnownSchemas = preloadKnownSchemas;
         pi.LoadSchemaData = loadSchemaData;
@@ -277,18 +457,26 @@ public:
     inline static void NoopLoadSchemaData(AppStatusMonitor &monitor, const std::string &blob) {}
     inline static std::string NoopSaveSchemaData() { return std::string(); }
     inline static void NoopPreloadKnownSchemas(AppStatusMonitor &monitor) {}
-    inline static bool NoopPreFilterLine(const ExternalSubstring<const char> &line, const ParserFilter &filter) { return true; }
+    inline static void NoopPreFilterLines(std::vector<std::string> &lines, size_t firstLine, const ParserFilter &filter) {}
     inline static void NoopPostFilterLines(std::vector<LogEntry> &lines, const std::vector<ColumnInformation> &columns, const ParserFilter &filter) {}
     inline static LogCollection NoopParseRaw(AppStatusMonitor &monitor, const std::vector<char> &rawData, const ParserFilter &filter) { return LogCollection(); }
     inline static LogCollection NoopParseLines(AppStatusMonitor &monitor, std::vector<std::string> &&linesToConsume) { return LogCollection(); }
 
+    //adapts a per-line filter to a batch one, so it's a direct call that can be inlined rather than a std::function call per line
+    template <bool(*filterLine)(const ExternalSubstring<const char> &line, const ParserFilter &filter)>
+    inline static void BatchPreFilter(std::vector<std::string> &lines, size_t firstLine, const ParserFilter &filter)
+    {
+        auto kept = std::remove_if(lines.begin() + firstLine, lines.end(), [&](const std::string &line) { return !filterLine(ExternalSubstring<const char>(line.data(), line.data() + line.size()), filter); });
+        lines.erase(kept, lines.end());
+    }
+
 private:
     //for text-line-based logs ParseRaw will call ParseRawToLines then call ParseLines followed by PostFilterLines.  For binary-based logs ParseRaw will parse and filter, leaving ParseLines as a Noop.
     std::function<LogCollection(AppStatusMonitor &monitor, std::vector<char> &&rawDataToConsume, const ParserFilter &filter)> ParseRaw;
     std::function<LogCollection(AppStatusMonitor &monitor, std::vector<std::string> &&linesToConsume)> ParseLines;
 
     //exactly one of these will be implemented, the other will be noop
-    std::function<bool(const ExternalSubstring<const char> &line, const ParserFilter &filter)> PreFilterLine; //returns true if the line should be accepted
+    std::function<void(std::vector<std::string> &lines, size_t firstLine, const ParserFilter &filter)> PreFilterLines; //removes any lines from firstLine on that shouldn't be accepted
     std::function<void(std::vector<LogEntry> &lines, const std::vector<ColumnInformation> columns, const ParserFilter &filter)> PostFilterLines; //clears out any lines that don't match
 
     //internal helpers
@@ -23,6 +23,9 @@
 #include "DebugWindow.h"
 #include "Globals.h"
 #include "WinMain.h"
+#include "CaseInsensitiveSearch.h"
+#include "ThreadPool.h"
+#include "FilterExpression.h"
 
 #include <chrono>
 #include <vector>
@@ -72,12 +75,18 @@ namespace
     const DWORD CONTEXTMENU_SHOWHISTOGRAM = 12109;
 
     const DWORD CONTEXTMENU_DNSLOOKUP = 12111;
+    const DWORD CONTEXTMENU_THENSORTROWS_ASCENDING = 12112;
+    const DWORD CONTEXTMENU_THENSORTROWS_DESCENDING = 12113;
 
     const std::vector<std::string> IGNORABLE_STRINGS { "0", "\\0", "00000000-0000-0000-0000-000000000000" };
 
     UINT_PTR CustomEditId_Normal = 0;
     UINT_PTR CustomEditId_ReadOnly = 1;
 
+    //a search regex is compiled once typing pauses for this long rather than on every keystroke, since a big pattern can take a while to compile
+    const UINT_PTR SearchPatternTimerId = 1;
+    const UINT SearchPatternDelayMs = 300;
+
     enum class DetailViewFormat
     {
         Default,
@@ -89,6 +98,25 @@ namespace
 
     size_t nextViewNumber = 0;
 
+    //how many earlier filter results each view keeps around, see MainLogView::filterResultCache
+    const size_t MaxCachedFilterResults = 4;
+
+    //if every filter in subset is also in filters, returns true and fills outRemaining with the filters that aren't in subset
+    bool IsFilterSubset(const std::vector<LogFilterEntry> &subset, const std::vector<LogFilterEntry> &filters, std::vector<LogFilterEntry> &outRemaining)
+    {
+        outRemaining = filters;
+        for (const LogFilterEntry &f : subset)
+        {
+            auto found = std::find(outRemaining.begin(), outRemaining.end(), f);
+            if (found == outRemaining.end())
+                return false;
+
+            outRemaining.erase(found);
+        }
+
+        return true;
+    }
+
     bool didRegistorWindowClass = false;
     void RegisterLogViewWindowClasses()
     {
@@ -133,6 +161,8 @@ namespace
         HWND hwndFilterListCase = 0;
         HWND hwndFilterListNot = 0;
         HWND hwndFilterListSubstring = 0;
+        HWND hwndFilterListRegex = 0;
+        HWND hwndFilterListQuery = 0;
         HWND hwndFilterListAdd = 0;
         HWND hwndFilterListRemove = 0;
         HWND hwndFilterList = 0;
@@ -147,11 +177,24 @@ namespace
         HWND hwndSearchString = 0;
         HWND hwndSearchNext = 0;
         HWND hwndSearchPrev = 0;
+        HWND hwndSearchRegex = 0;
 
         std::vector<uint32_t> columnVisibilityMap;
-        std::vector<uint32_t> rowVisibilityMap;
+        RowBitmap rowVisibilityMap;
         std::vector<LogFilterEntry> rowFilters;
 
+        //the rows that passed earlier sets of filters, so narrowing one down or going back to it only tests what changed.  cleared whenever the data does.
+        struct CachedFilterResult
+        {
+            std::vector<LogFilterEntry> Filters;
+            RowBitmap Rows;
+        };
+        std::vector<CachedFilterResult> filterResultCache;
+
+        //the last Find Next/Prev search compiled, so searching again for the same thing doesn't compile and plan it over.  cleared whenever the data is.
+        std::vector<LogFilterEntry> searchFilters;
+        std::shared_ptr<const CompiledLogFilter> searchCompiledFilter;
+
         bool logHeaderMouseTrackingActive = false;
         TOOLINFO logHeaderTooltipInfo = { 0 };
         int logHeaderTooltipLastX = -1;
@@ -173,6 +216,9 @@ namespace
         std::map<std::string, int> previousColumnWidths;
 
         std::string searchString;
+        std::shared_ptr<const LinearRegex> searchPattern; //set when searching by regex and searchString is a valid pattern
+        std::string searchPatternError;
+        bool searchPatternPending = false; //searchString changed and searchPattern hasn't been compiled for it yet
 
         MainLogView()
         {
@@ -222,8 +268,11 @@ namespace
                         if (Header_GetItem(hwndLogsHeaderSort, i, &item))
                         {
                             item.fmt &= ~(HDF_SORTDOWN | HDF_SORTUP);
-                            if (columnVisibilityMap[i] == globalLogs.SortColumn)
-                                item.fmt |= (globalLogs.SortAscending ? HDF_SORTDOWN : HDF_SORTUP);
+                            for (const LogSortEntry &entry : globalLogs.SortOrder)
+                            {
+                                if (columnVisibilityMap[i] == entry.Column)
+                                    item.fmt |= (entry.Ascending ? HDF_SORTDOWN : HDF_SORTUP);
+                            }
                             Header_SetItem(hwndLogsHeaderSort, i, &item);
                         }
                     }
@@ -356,6 +405,23 @@ namespace
             ComboBox_SetCurSel(hwndFilterListColumns, 0);
         }
 
+        void UpdateSearchPattern()
+        {
+            KillTimer(hwndWindow, SearchPatternTimerId);
+            searchPatternPending = false;
+            searchPatternError.clear();
+            searchPattern.reset();
+            if (Button_GetCheck(hwndSearchRegex) && !searchString.empty())
+                searchPattern = LinearRegex::Compile(searchString, false, searchPatternError);
+        }
+
+        void UpdateSearchPatternLater()
+        {
+            searchPatternPending = true;
+            searchPattern.reset();
+            SetTimer(hwndWindow, SearchPatternTimerId, SearchPatternDelayMs, nullptr);
+        }
+
         void SyncFilterListToWindow()
         {
             while (ListBox_GetCount(hwndFilterList) > 0)
@@ -363,6 +429,12 @@ namespace
 
             for (auto &f : rowFilters)
             {
+                if (f.Expression)
+                {
+                    ListBox_AddString(hwndFilterList, ((f.Not ? "!(" : "(") + f.Value + ")").c_str());
+                    continue;
+                }
+
                 std::string s = "<raw log>";
                 if (f.Column >= 0 && f.Column < globalLogs.Columns.size())
                     s = globalLogs.Columns[f.Column].UniqueName;
@@ -370,15 +442,37 @@ namespace
                 s += " ";
                 if (f.Not)
                     s += "!";
-                if (f.MatchCase)
-                    s += "=";
-                else
-                    s += "~";
-                if (!f.MatchSubstring)
-                    s += "=";
-                s += " ";
-
-                s += f.Value;
+                switch (f.Comparison)
+                {
+                case FilterComparison::Less:
+                    s += "< " + f.Value;
+                    break;
+                case FilterComparison::LessEqual:
+                    s += "<= " + f.Value;
+                    break;
+                case FilterComparison::Greater:
+                    s += "> " + f.Value;
+                    break;
+                case FilterComparison::GreaterEqual:
+                    s += ">= " + f.Value;
+                    break;
+                case FilterComparison::Between:
+                    s += "BETWEEN " + f.Value + " AND " + f.UpperValue;
+                    break;
+                default:
+                    if (f.MatchCase)
+                        s += "=";
+                    else
+                        s += "~";
+                    if (!f.MatchSubstring)
+                        s += "=";
+                    if (f.Regex)
+                        s += "/";
+                    s += " ";
+
+                    s += f.Value;
+                    break;
+                }
 
                 ListBox_AddString(hwndFilterList, s.c_str());
             }
@@ -399,6 +493,7 @@ namespace
 
         void SyncVisibleColumnsToWindow()
         {
+            globalLogs.ExtractDeferredColumns(DebugStatusOnlyMonitor::Instance, columnVisibilityMap);
             RecreateColumns();
 
             while (ListBox_GetCount(hwndColumnList) > 0)
@@ -425,64 +520,108 @@ namespace
             SyncVisibleRowsToWindow();
         }
 
+        //moves the current filter results into filterResultCache, dropping the oldest once there are too many
+        void CacheCurrentFilterResult()
+        {
+            //the unfiltered view is just every row, so there's nothing worth keeping
+            if (rowFilters.empty())
+                return;
+
+            std::vector<LogFilterEntry> unused;
+            filterResultCache.erase(std::remove_if(filterResultCache.begin(), filterResultCache.end(), [&](const CachedFilterResult &c) { return c.Filters.size() == rowFilters.size() && IsFilterSubset(c.Filters, rowFilters, unused); }), filterResultCache.end());
+            filterResultCache.push_back({ std::move(rowFilters), rowVisibilityMap });
+            rowFilters.clear();
+
+            if (filterResultCache.size() > MaxCachedFilterResults)
+                filterResultCache.erase(filterResultCache.begin());
+        }
+
         void ApplyFilterWithStatusDialog(const std::vector<LogFilterEntry> &filters)
         {
             GuiStatusManager::ShowBusyDialogAndRunMonitor("Applying filters", true, [&](GuiStatusMonitor &monitor)
             {
                 std::chrono::time_point<std::chrono::high_resolution_clock> timerStart = std::chrono::high_resolution_clock::now();
+                CacheCurrentFilterResult();
                 rowFilters = filters;
+                globalLogs.ExtractDeferredColumns(monitor, rowFilters);
+
+                //start from every earlier result that these filters only narrow down, so just the filters none of them had need testing
+                RowBitmap baseRows;
+                bool hasBaseRows = false;
+                std::vector<LogFilterEntry> remainingFilters = rowFilters;
+                std::vector<LogFilterEntry> unused;
+                for (auto &cached : filterResultCache)
+                {
+                    if (!IsFilterSubset(cached.Filters, rowFilters, unused))
+                        continue;
+
+                    baseRows = hasBaseRows ? RowBitmap::And(baseRows, cached.Rows) : cached.Rows;
+                    hasBaseRows = true;
+                    for (auto &f : cached.Filters)
+                    {
+                        auto found = std::find(remainingFilters.begin(), remainingFilters.end(), f);
+                        if (found != remainingFilters.end())
+                            remainingFilters.erase(found);
+                    }
+                }
 
-                rowVisibilityMap.clear();
+                if (!remainingFilters.empty())
+                {
+                    globalLogs.UpdateSearchIndex(monitor);
+                    globalLogs.UpdateTypedColumns(monitor, remainingFilters);
+                }
 
                 if (rowFilters.empty())
                 {
                     monitor.SetProgressFeatures(1);
-                    for (int i = 0; i < (int)globalLogs.Lines.size(); ++i)
-                        rowVisibilityMap.push_back(i);
-
-                    rowVisibilityMap.shrink_to_fit();
+                    rowVisibilityMap = RowBitmap::AllRows(globalLogs.Lines.size());
+                }
+                else if (remainingFilters.empty())
+                {
+                    monitor.SetProgressFeatures(1);
+                    rowVisibilityMap = baseRows;
                 }
                 else
                 {
-                    monitor.SetProgressFeatures(globalLogs.Lines.size(), "kiloline", 1000);
-
-                    //break task into chunks and run in parallel
-                    std::vector<std::thread> allThreads;
-                    std::vector<std::vector<int>> separateRowPools;
-                    separateRowPools.resize(cpuCountFilter);
-                    for (int cpu = 0; cpu < cpuCountFilter; ++cpu)
-                        separateRowPools[cpu].reserve(globalLogs.Lines.size() / 4);
-                    for (int cpu = 0; cpu < cpuCountFilter; ++cpu)
-                    {
-                        allThreads.emplace_back([&](int threadIndex)
-                        {
-                            size_t chunkSize = globalLogs.Lines.size() / cpuCountFilter;
-                            if (!chunkSize)
-                                chunkSize = 1;
+                    CompiledLogFilter compiledFilter { remainingFilters, globalLogs };
+                    monitor.AddDebugOutput("Filter plan: " + compiledFilter.DescribePlan(globalLogs));
 
-                            size_t rowStartIndex = chunkSize * threadIndex;
-                            size_t rowEndIndex = chunkSize * (threadIndex + 1);
-                            if (rowEndIndex > globalLogs.Lines.size() || threadIndex == cpuCountFilter - 1)
-                                rowEndIndex = globalLogs.Lines.size();
+                    //the search index can rule out most rows without looking at them
+                    RowBitmap candidateRows;
+                    bool useCandidates = compiledFilter.FindCandidateRows(globalLogs, candidateRows);
+                    if (hasBaseRows)
+                        candidateRows = useCandidates ? RowBitmap::And(baseRows, candidateRows) : baseRows;
 
-                            for (size_t row = rowStartIndex; row < rowEndIndex; ++row)
-                            {
-                                monitor.AddProgress(1);
+                    const RowBitmap *testRows = (useCandidates || hasBaseRows) ? &candidateRows : nullptr;
+                    size_t rowsToTest = testRows ? testRows->size() : globalLogs.Lines.size();
+                    monitor.SetProgressFeatures(rowsToTest, "kiloline", 1000);
 
-                                const LogEntry &entry = globalLogs.Lines[row];
-                                bool match = DoesLogEntryPassFilters(entry, rowFilters);
-                                if (match)
-                                    separateRowPools[threadIndex].push_back((int)row);
-                            }
-                        }, cpu);
-                    }
+                    //test batches in parallel, each making a bitmap that gets merged into its worker's result
+                    rowVisibilityMap = ParallelReduce(monitor, cpuCountFilter, 0, rowsToTest, 4096, RowBitmap(), [&](RowBitmap &&workerRows, size_t batchBegin, size_t batchEnd)
+                    {
+                        monitor.AddProgress(batchEnd - batchBegin);
+
+                        RowBitmap::const_iterator testIter;
+                        if (testRows)
+                            testIter = testRows->IteratorAt(batchBegin);
+
+                        RowBitmap batchRows;
+                        for (size_t i = batchBegin; i < batchEnd; ++i)
+                        {
+                            uint32_t row = testRows ? *testIter++ : (uint32_t)i;
+                            if (compiledFilter.Passes(globalLogs.Lines[row], row))
+                                batchRows.Append(row);
+                        }
 
-                    for (auto &t : allThreads)
-                        t.join();
+                        return workerRows.empty() ? std::move(batchRows) : RowBitmap::Or(workerRows, batchRows);
+                    }, [](RowBitmap &&a, RowBitmap &&b) { return RowBitmap::Or(a, b); });
 
-                    //merge chunks back into one list
-                    for (int cpu = 0; cpu < cpuCountFilter; ++cpu)
-                        rowVisibilityMap.insert(rowVisibilityMap.end(), separateRowPools[cpu].begin(), separateRowPools[cpu].end());
+                    //cancelling leaves only some of the rows tested, so go back to showing everything rather than keep (and later cache) a partial result
+                    if (monitor.IsCancelling())
+                    {
+                        rowFilters.clear();
+                        rowVisibilityMap = RowBitmap::AllRows(globalLogs.Lines.size());
+                    }
                 }
 
                 std::chrono::time_point<std::chrono::high_resolution_clock> timerEnd = std::chrono::high_resolution_clock::now();
@@ -738,7 +877,9 @@ namespace
 
             for (auto row : selectedRows)
             {
-                const auto &log = globalLogs.Lines[row];
+                //rows with deferred columns are shown in full without pulling those columns out for every row
+                LogEntry fullRow;
+                const auto &log = globalLogs.ExtractFullRow(row, fullRow) ? fullRow : globalLogs.Lines[row];
 
                 for (const LogEntryColumn *colInfo = log.ColumnDataBegin(); colInfo != log.ColumnDataEnd(); ++colInfo)
                 {
@@ -854,14 +995,22 @@ namespace
         {
             std::vector<uint32_t> rows;
 
+            //selected items come in order, so walk to each one from the last rather than looking every one up
             LVITEMINDEX ii = { 0 };
             ii.iItem = -1;
+            int prevItem = -1;
+            auto rowIter = rowVisibilityMap.end();
             while (ListView_GetNextItemIndex(hwndLogs, &ii, LVNI_SELECTED))
             {
                 if (ii.iItem >= 0 && ii.iItem < rowVisibilityMap.size())
                 {
-                    uint32_t rowIndex = rowVisibilityMap[ii.iItem];
-                    rows.emplace_back(rowIndex);
+                    if (prevItem >= 0 && ii.iItem == prevItem + 1)
+                        ++rowIter;
+                    else
+                        rowIter = rowVisibilityMap.IteratorAt(ii.iItem);
+                    prevItem = ii.iItem;
+
+                    rows.emplace_back(*rowIter);
                 }
             }
 
@@ -1094,22 +1243,78 @@ bool LogViewInitialize()
 
 void LogViewNotifyDataChanged(size_t beginRow, size_t endRow, size_t beginColumn, size_t endColumn)
 {
-    for (auto &lv : logViews)
+    //update rows, testing every view's filters in a single parallel pass over the changed rows
+    std::vector<size_t> prevRowMapSizes;
+    if (beginRow != endRow)
     {
-        //update rows
-        if (beginRow != endRow)
-        {
-            size_t prevRowMapSize = lv.rowVisibilityMap.size();
+        auto tpBegin = std::chrono::high_resolution_clock::now();
 
-            while (!lv.rowVisibilityMap.empty() && lv.rowVisibilityMap.back() >= beginRow)
-                lv.rowVisibilityMap.pop_back();
+        std::vector<LogFilterEntry> allFilters;
+        for (auto &lv : logViews)
+            allFilters.insert(allFilters.end(), lv.rowFilters.begin(), lv.rowFilters.end());
+        globalLogs.ExtractDeferredColumns(DebugStatusOnlyMonitor::Instance, allFilters);
 
-            for (size_t r = beginRow; r < endRow; ++r)
+        //views without filters just get every new row
+        std::vector<MainLogView*> filteredViews;
+        std::vector<CompiledLogFilter> compiledFilters;
+        for (auto &lv : logViews)
+        {
+            prevRowMapSizes.push_back(lv.rowVisibilityMap.size());
+            lv.rowVisibilityMap.TruncateFrom((uint32_t)beginRow);
+
+            CompiledLogFilter compiledFilter { lv.rowFilters, globalLogs };
+            if (compiledFilter.Empty())
+                lv.rowVisibilityMap = RowBitmap::Or(lv.rowVisibilityMap, RowBitmap::AndNot(RowBitmap::AllRows(endRow), RowBitmap::AllRows(beginRow)));
+            else
             {
-                if (DoesLogEntryPassFilters(globalLogs.Lines[r], lv.rowFilters))
-                    lv.rowVisibilityMap.emplace_back((uint32_t)r);
+                filteredViews.push_back(&lv);
+                compiledFilters.emplace_back(std::move(compiledFilter));
             }
+        }
+
+        //not cancellable, since the views have already been cut back to beginRow
+        if (!filteredViews.empty())
+        {
+            std::vector<RowBitmap> newRows = ParallelReduce(AppStatusMonitor::Instance, cpuCountFilter, beginRow, endRow, 4096, std::vector<RowBitmap>(filteredViews.size()), [&](std::vector<RowBitmap> &&workerRows, size_t batchBegin, size_t batchEnd)
+            {
+                std::vector<RowBitmap> batchRows(filteredViews.size());
+                for (size_t r = batchBegin; r < batchEnd; ++r)
+                {
+                    const LogEntry &le = globalLogs.Lines[r];
+                    for (size_t v = 0; v < compiledFilters.size(); ++v)
+                    {
+                        if (compiledFilters[v].Passes(le, r))
+                            batchRows[v].Append((uint32_t)r);
+                    }
+                }
 
+                for (size_t v = 0; v < workerRows.size(); ++v)
+                    workerRows[v] = workerRows[v].empty() ? std::move(batchRows[v]) : RowBitmap::Or(workerRows[v], batchRows[v]);
+                return std::move(workerRows);
+            }, [](std::vector<RowBitmap> &&a, std::vector<RowBitmap> &&b)
+            {
+                for (size_t v = 0; v < a.size(); ++v)
+                    a[v] = RowBitmap::Or(a[v], b[v]);
+                return std::move(a);
+            });
+
+            for (size_t v = 0; v < filteredViews.size(); ++v)
+                filteredViews[v]->rowVisibilityMap = RowBitmap::Or(filteredViews[v]->rowVisibilityMap, newRows[v]);
+        }
+
+        auto tpEnd = std::chrono::high_resolution_clock::now();
+        DebugStatusOnlyMonitor::Instance.AddDebugOutputTime("LogViewNotifyDataChanged", std::chrono::duration_cast<std::chrono::microseconds>(tpEnd - tpBegin).count() / 1000.0);
+    }
+
+    size_t viewIndex = 0;
+    for (auto &lv : logViews)
+    {
+        lv.filterResultCache.clear();
+        lv.searchCompiledFilter.reset();
+
+        if (beginRow != endRow)
+        {
+            size_t prevRowMapSize = prevRowMapSizes[viewIndex];
             lv.SyncVisibleRowsToWindow();
             lv.KeepScrolledToEndIfPreviously(prevRowMapSize > 0 ? prevRowMapSize - 1 : 0);
         }
@@ -1132,6 +1337,7 @@ void LogViewNotifyDataChanged(size_t beginRow, size_t endRow, size_t beginColumn
         }
 
         RedrawWindow(lv.hwndWindow, nullptr, 0, RDW_INVALIDATE | RDW_ALLCHILDREN);
+        ++viewIndex;
     }
 }
 
@@ -1299,10 +1505,12 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
         lvp->hwndFilterListNot = CreateWindow(WC_BUTTON, "Not", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 159, 125, 37, 22, hwnd, 0, hInstance, 0);
         lvp->hwndFilterListSubstring = CreateWindow(WC_BUTTON, "Substring", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 90, 125, 66, 22, hwnd, 0, hInstance, 0);
         Button_SetCheck(lvp->hwndFilterListSubstring, true);
-        lvp->hwndFilterListAdd = CreateWindow(WC_BUTTON, "Add", WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON, 10, 147, 85, 25, hwnd, 0, hInstance, 0);
-        lvp->hwndFilterListRemove = CreateWindow(WC_BUTTON, "Remove", WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON, 105, 147, 85, 25, hwnd, 0, hInstance, 0);
+        lvp->hwndFilterListRegex = CreateWindow(WC_BUTTON, "Regex", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 45, 147, 55, 22, hwnd, 0, hInstance, 0);
+        lvp->hwndFilterListQuery = CreateWindow(WC_BUTTON, "Query", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 102, 147, 55, 22, hwnd, 0, hInstance, 0);
+        lvp->hwndFilterListAdd = CreateWindow(WC_BUTTON, "Add", WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON, 10, 170, 85, 25, hwnd, 0, hInstance, 0);
+        lvp->hwndFilterListRemove = CreateWindow(WC_BUTTON, "Remove", WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON, 105, 170, 85, 25, hwnd, 0, hInstance, 0);
         EnableWindow(lvp->hwndFilterListRemove, false);
-        lvp->hwndFilterList = CreateWindow(WC_LISTBOX, "", WS_VISIBLE | WS_CHILD | WS_BORDER | LBS_NOTIFY | WS_VSCROLL | WS_HSCROLL, 10, 175, 180, 205, hwnd, 0, hInstance, 0);
+        lvp->hwndFilterList = CreateWindow(WC_LISTBOX, "", WS_VISIBLE | WS_CHILD | WS_BORDER | LBS_NOTIFY | WS_VSCROLL | WS_HSCROLL, 10, 198, 180, 182, hwnd, 0, hInstance, 0);
 
         lvp->SyncFilterChoicesToWindow();
 
@@ -1332,6 +1540,7 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
         lvp->hwndSearchString = CreateWindow(WC_EDIT, "", WS_VISIBLE | WS_CHILD | WS_BORDER | ES_AUTOHSCROLL, 450, 2, 250, 21, hwnd, 0, hInstance, 0);
         lvp->hwndSearchNext = CreateWindow(WC_BUTTON, "Next", WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON, 705, 2, 60, 22, hwnd, 0, hInstance, 0);
         lvp->hwndSearchPrev = CreateWindow(WC_BUTTON, "Previous", WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON, 765, 2, 60, 22, hwnd, 0, hInstance, 0);
+        lvp->hwndSearchRegex = CreateWindow(WC_BUTTON, "Regex", WS_VISIBLE | WS_CHILD | BS_CHECKBOX, 832, 2, 55, 22, hwnd, 0, hInstance, 0);
 
         //
         lvp->ResizeChildren();
@@ -1383,12 +1592,12 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
                 desc = "Main Window";
             else
                 desc = "LogView #" + std::to_string(lv.viewNumber);
-            DoSaveLogsDialog(desc, lv.rowVisibilityMap, lv.GetSelectedRows(), lv.columnVisibilityMap);
+            DoSaveLogsDialog(desc, lv.rowVisibilityMap.ToVector(), lv.GetSelectedRows(), lv.columnVisibilityMap);
             return 0;
         }
         else if ((HWND)lParam == lv.hwndOpenQosVisualizer)
         {
-            ShowQosVisualizer(lv.rowVisibilityMap);
+            ShowQosVisualizer(lv.rowVisibilityMap.ToVector());
         }
         else if ((HWND)lParam == lv.hwndColumnList) //visible column list window
         {
@@ -1459,11 +1668,22 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
             ShowBlocklistedDefaultColumnsEditor();
             return 0;
         }
-        else if ((HWND)lParam == lv.hwndFilterListCase || (HWND)lParam == lv.hwndFilterListNot || (HWND)lParam == lv.hwndFilterListSubstring)
+        else if ((HWND)lParam == lv.hwndFilterListCase || (HWND)lParam == lv.hwndFilterListNot || (HWND)lParam == lv.hwndFilterListSubstring || (HWND)lParam == lv.hwndFilterListRegex)
         {
             Button_SetCheck((HWND)lParam, !Button_GetCheck((HWND)lParam));
             return 0;
         }
+        else if ((HWND)lParam == lv.hwndFilterListQuery)
+        {
+            //a query names its own columns and matching options, so only Not still applies
+            bool isQuery = !Button_GetCheck(lv.hwndFilterListQuery);
+            Button_SetCheck(lv.hwndFilterListQuery, isQuery);
+            EnableWindow(lv.hwndFilterListColumns, !isQuery);
+            EnableWindow(lv.hwndFilterListCase, !isQuery);
+            EnableWindow(lv.hwndFilterListSubstring, !isQuery);
+            EnableWindow(lv.hwndFilterListRegex, !isQuery);
+            return 0;
+        }
         else if ((HWND)lParam == lv.hwndFilterListAdd)
         {
             std::vector<char> columnNameBuffer;
@@ -1491,6 +1711,30 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
                 currentFilters.back().MatchCase = (0 != Button_GetCheck(lv.hwndFilterListCase));
                 currentFilters.back().Not = (0 != Button_GetCheck(lv.hwndFilterListNot));
                 currentFilters.back().MatchSubstring = (0 != Button_GetCheck(lv.hwndFilterListSubstring));
+                currentFilters.back().Regex = (0 != Button_GetCheck(lv.hwndFilterListRegex));
+
+                std::string error;
+                if (Button_GetCheck(lv.hwndFilterListQuery))
+                {
+                    LogFilterEntry query;
+                    query.Column = -1;
+                    query.Value = currentFilters.back().Value;
+                    query.Not = currentFilters.back().Not;
+                    query.Expression = true;
+                    currentFilters.back() = query;
+
+                    FilterExpression expression;
+                    if (!FilterExpression::Parse(query.Value, globalLogs.Columns, expression, error))
+                    {
+                        MessageBox(hwnd, ("Invalid query: " + error).c_str(), "", MB_OK);
+                        return 0;
+                    }
+                }
+                else if (currentFilters.back().Regex && !LinearRegex::Compile(currentFilters.back().Value, currentFilters.back().MatchCase, error))
+                {
+                    MessageBox(hwnd, ("Invalid regex: " + error).c_str(), "", MB_OK);
+                    return 0;
+                }
             }
 
             Edit_SetText(lv.hwndFilterListValue, "");
@@ -1534,9 +1778,20 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
                 while (!lv.searchString.empty() && lv.searchString.back() == '\0')
                     lv.searchString.pop_back();
 
+                if (Button_GetCheck(lv.hwndSearchRegex))
+                    lv.UpdateSearchPatternLater();
+                else
+                    lv.UpdateSearchPattern();
                 RedrawWindow(lv.hwndLogs, nullptr, 0, RDW_INVALIDATE);
             }
         }
+        else if ((HWND)lParam == lv.hwndSearchRegex)
+        {
+            Button_SetCheck((HWND)lParam, !Button_GetCheck((HWND)lParam));
+            lv.UpdateSearchPattern();
+            RedrawWindow(lv.hwndLogs, nullptr, 0, RDW_INVALIDATE);
+            return 0;
+        }
         else if ((HWND)lParam == lv.hwndSearchNext || (HWND)lParam == lv.hwndSearchPrev)
         {
             if (lv.searchString.empty())
@@ -1548,11 +1803,25 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
             if (lv.rowVisibilityMap.empty())
                 return 0;
 
+            bool searchRegex = (0 != Button_GetCheck(lv.hwndSearchRegex));
+            if (lv.searchPatternPending)
+            {
+                lv.UpdateSearchPattern();
+                RedrawWindow(lv.hwndLogs, nullptr, 0, RDW_INVALIDATE);
+            }
+
+            if (searchRegex && !lv.searchPattern)
+            {
+                GlobalDebugOutput("Invalid search regex: " + lv.searchPatternError);
+                return 0;
+            }
+
             std::vector<LogFilterEntry> matchFilter;
             matchFilter.emplace_back();
             matchFilter.back().Column = -1;
             matchFilter.back().MatchCase = false;
             matchFilter.back().MatchSubstring = true;
+            matchFilter.back().Regex = searchRegex;
             matchFilter.back().Value = lv.searchString;
 
             int direction = ((HWND)lParam == lv.hwndSearchNext) ? 1 : -1;
@@ -1563,8 +1832,24 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
             else
                 initialSel += direction;
 
+            globalLogs.ExtractDeferredColumns(DebugStatusOnlyMonitor::Instance, matchFilter);
+            if (indexRawTextForSearch && !globalLogs.IsSearchIndexCurrent())
+            {
+                GuiStatusManager::ShowBusyDialogAndRunMonitor("Indexing for search", true, [&](GuiStatusMonitor &monitor)
+                {
+                    globalLogs.UpdateSearchIndex(monitor);
+                    monitor.Complete();
+                });
+            }
+
             auto timerStart = std::chrono::high_resolution_clock::now();
-            auto[found, where] = FindNextLogline(initialSel, direction, matchFilter, globalLogs, lv.rowVisibilityMap);
+            if (!lv.searchCompiledFilter || lv.searchFilters != matchFilter)
+            {
+                lv.searchCompiledFilter = std::make_shared<const CompiledLogFilter>(matchFilter, globalLogs);
+                lv.searchFilters = std::move(matchFilter);
+            }
+
+            auto[found, where] = FindNextLogline(initialSel, direction, *lv.searchCompiledFilter, globalLogs, lv.rowVisibilityMap);
             auto timeToRun = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - timerStart);
             GlobalDebugOutput("Search time: " + std::to_string(timeToRun.count()) + "us");
             if (found)
@@ -1627,6 +1912,7 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
             case CONTEXTMENU_FILTERNONEMPTYNONZEROCOLUMNS:
             {
                 lv.columnVisibilityMap.clear();
+                globalLogs.ExtractAllDeferredColumns(DebugStatusOnlyMonitor::Instance);
 
                 //enable all columns that apply to the selected rows
                 for (uint32_t rowIndex : lv.GetSelectedRows())
@@ -1785,14 +2071,23 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
             return 0;
             case CONTEXTMENU_SORTROWS_ASCENDING:
             case CONTEXTMENU_SORTROWS_DESCENDING:
+            case CONTEXTMENU_THENSORTROWS_ASCENDING:
+            case CONTEXTMENU_THENSORTROWS_DESCENDING:
             {
-                bool ascending = (LOWORD(wParam) == CONTEXTMENU_SORTROWS_ASCENDING);
+                bool ascending = (LOWORD(wParam) == CONTEXTMENU_SORTROWS_ASCENDING || LOWORD(wParam) == CONTEXTMENU_THENSORTROWS_ASCENDING);
+                bool thenSort = (LOWORD(wParam) == CONTEXTMENU_THENSORTROWS_ASCENDING || LOWORD(wParam) == CONTEXTMENU_THENSORTROWS_DESCENDING);
 
-                //sort
+                //sort, by this column alone or after the ones already sorted by
                 GuiStatusManager::ShowBusyDialogAndRunMonitor("Sorting Logs", true, [&](GuiStatusMonitor &monitor)
                 {
-                    globalLogs.SortColumn = (uint16_t)lv.columnContextDataCol;
-                    globalLogs.SortAscending = ascending;
+                    LogSortEntry entry;
+                    entry.Column = (uint16_t)lv.columnContextDataCol;
+                    entry.Ascending = ascending;
+
+                    if (!thenSort)
+                        globalLogs.SortOrder.clear();
+                    std::erase_if(globalLogs.SortOrder, [&](const LogSortEntry &e) { return e.Column == entry.Column; });
+                    globalLogs.SortOrder.emplace_back(entry);
 
                     std::chrono::time_point<std::chrono::high_resolution_clock> timerStart = std::chrono::high_resolution_clock::now();
                     globalLogs.SortRange(0, globalLogs.Lines.size());
@@ -1821,13 +2116,13 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
             case CONTEXTMENU_SHOWFREQUENCY:
             {
                 lv.columnOperationStack.emplace_back(lv.columnContextDataCol);
-                ShowFrequencyChart(lv.columnOperationStack, lv.rowVisibilityMap);
+                ShowFrequencyChart(lv.columnOperationStack, lv.rowVisibilityMap.ToVector());
                 lv.columnOperationStack.clear();
             }
             return 0;
             case CONTEXTMENU_SHOWHISTOGRAM:
             {
-                ShowHistogramChart(lv.columnContextDataCol, lv.rowVisibilityMap);
+                ShowHistogramChart(lv.columnContextDataCol, lv.rowVisibilityMap.ToVector());
             }
             return 0;
             case CONTEXTMENU_DNSLOOKUP:
@@ -2111,7 +2406,8 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
                             if (!lv.searchString.empty())
                             {
                                 //ideally we would search and highlight the whole row, but that's more expensive.  for now we'll just do it per-column since that's how windows draws us.
-                                if (str.find_insensitive(lv.searchString) != std::string::npos)
+                                std::string_view cellText { str.begin(), str.size() };
+                                if (Button_GetCheck(lv.hwndSearchRegex) ? (lv.searchPattern && lv.searchPattern->Search(cellText)) : CaseInsensitiveSearch::Find(cellText, lv.searchString) != std::string_view::npos)
                                     bgColor2 = RGB(255, 210, 190);
 
                                 //if nothing else was set to be highlighted for the first color (or the row is selected), the whole thing should be the search color
@@ -2283,6 +2579,22 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
                                 ss << "Sort Rows Descending by " << globalLogs.Columns[dataCol].UniqueName;
                                 InsertMenu(menu, (UINT)-1, MF_BYPOSITION | MF_STRING, CONTEXTMENU_SORTROWS_DESCENDING, ss.str().c_str());
                             }
+                            if (!globalLogs.SortOrder.empty() && globalLogs.SortOrder[0].Column != dataCol)
+                            {
+                                std::vector<LogSortEntry> thenSortOrder;
+                                std::copy_if(globalLogs.SortOrder.begin(), globalLogs.SortOrder.end(), std::back_inserter(thenSortOrder), [&](const LogSortEntry &e) { return e.Column != dataCol; });
+                                std::string sortedBy = StringJoin(", ", thenSortOrder.begin(), thenSortOrder.end(), [&](const LogSortEntry &e) {return globalLogs.Columns[e.Column].UniqueName; });
+                                {
+                                    std::stringstream ss;
+                                    ss << "Sort Rows by " << sortedBy << ", then Ascending by " << globalLogs.Columns[dataCol].UniqueName;
+                                    InsertMenu(menu, (UINT)-1, MF_BYPOSITION | MF_STRING, CONTEXTMENU_THENSORTROWS_ASCENDING, ss.str().c_str());
+                                }
+                                {
+                                    std::stringstream ss;
+                                    ss << "Sort Rows by " << sortedBy << ", then Descending by " << globalLogs.Columns[dataCol].UniqueName;
+                                    InsertMenu(menu, (UINT)-1, MF_BYPOSITION | MF_STRING, CONTEXTMENU_THENSORTROWS_DESCENDING, ss.str().c_str());
+                                }
+                            }
                             {
                                 InsertMenu(menu, (UINT)-1, MF_BYPOSITION | MF_SEPARATOR, 0, "");
                                 {
@@ -2347,7 +2659,18 @@ LRESULT CALLBACK MainLogViewWindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPAR
         }
     }
     break;
+    case WM_TIMER:
+    {
+        if (wParam == SearchPatternTimerId)
+        {
+            lv.UpdateSearchPattern();
+            RedrawWindow(lv.hwndLogs, nullptr, 0, RDW_INVALIDATE);
+            return 0;
+        }
+    }
+    break;
     case WM_DESTROY: case WM_QUIT: case WM_CLOSE:
+        KillTimer(hwnd, SearchPatternTimerId);
         logViews.remove_if([&](auto &p) {return &p == lvp; });
         return 0;
     }
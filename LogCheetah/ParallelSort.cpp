@@ -0,0 +1,164 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "ParallelSort.h"
+#include "RowSorter.h"
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+void ParallelSort::RadixSort(std::vector<RadixItem> &items, size_t workerCount)
+{
+    size_t count = items.size();
+    if (count < 2)
+        return;
+
+    //only bytes that differ somewhere need a pass
+    uint64_t firstKey = items[0].Key;
+    uint64_t differing = ParallelReduce(AppStatusMonitor::Instance, workerCount, 0, count, 65536, (uint64_t)0, [&](uint64_t bits, size_t batchBegin, size_t batchEnd)
+    {
+        for (size_t i = batchBegin; i < batchEnd; ++i)
+            bits |= items[i].Key ^ firstKey;
+        return bits;
+    }, [](uint64_t a, uint64_t b) { return a | b; });
+
+    //each chunk counts its own digits, then scatters them to where its share of each digit goes: after every smaller digit, and after earlier chunks' share of
+    //the same digit, which keeps the sort stable
+    size_t chunkCount = std::max<size_t>(1, std::min(workerCount, count / MinRunSize));
+    std::vector<size_t> offsets(chunkCount * 256);
+    std::vector<RadixItem> buffer(count);
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        if (((differing >> shift) & 0xff) == 0)
+            continue;
+
+        ThreadPool::Instance().Run(chunkCount, [&](size_t c)
+        {
+            size_t *histogram = &offsets[c * 256];
+            std::fill(histogram, histogram + 256, 0);
+            for (size_t i = count * c / chunkCount; i < count * (c + 1) / chunkCount; ++i)
+                ++histogram[(items[i].Key >> shift) & 0xff];
+        });
+
+        size_t total = 0;
+        for (size_t digit = 0; digit < 256; ++digit)
+        {
+            for (size_t c = 0; c < chunkCount; ++c)
+            {
+                size_t digitCount = offsets[c * 256 + digit];
+                offsets[c * 256 + digit] = total;
+                total += digitCount;
+            }
+        }
+
+        ThreadPool::Instance().Run(chunkCount, [&](size_t c)
+        {
+            size_t *next = &offsets[c * 256];
+            for (size_t i = count * c / chunkCount; i < count * (c + 1) / chunkCount; ++i)
+                buffer[next[(items[i].Key >> shift) & 0xff]++] = items[i];
+        });
+
+        items.swap(buffer);
+    }
+}
+
+bool ParallelSort::VerifySort(AppStatusMonitor &monitor)
+{
+    std::mt19937 rng(2016);
+    size_t mismatches = 0;
+    size_t cases = 0;
+
+    //keys with lots of ties, carrying their original position so stability shows
+    const size_t sizes[] = { 0, 1, MinRunSize - 1, MinRunSize * 2 + 1, 100000, 333333 };
+    for (size_t size : sizes)
+    {
+        for (size_t workerCount = 1; workerCount <= 9; workerCount += 2)
+        {
+            std::vector<std::pair<uint32_t, uint32_t>> items(size);
+            for (size_t i = 0; i < size; ++i)
+                items[i] = { (uint32_t)(rng() % (1 + size / 16)), (uint32_t)i };
+
+            std::vector<std::pair<uint32_t, uint32_t>> expected = items;
+            auto byKey = [](const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b) { return a.first < b.first; };
+            std::stable_sort(expected.begin(), expected.end(), byKey);
+            StableSort(items.begin(), items.end(), workerCount, byKey);
+
+            ++cases;
+            if (items != expected)
+                ++mismatches;
+
+            //the same keys spread across several bytes, some of which never change
+            std::vector<RadixItem> radixItems(size);
+            for (size_t i = 0; i < size; ++i)
+                radixItems[i] = { 0x1200000000000000ull | ((uint64_t)(expected[i].first * 2654435761u) << 8), (uint32_t)i };
+            std::shuffle(radixItems.begin(), radixItems.end(), rng);
+
+            std::vector<RadixItem> radixExpected = radixItems;
+            std::stable_sort(radixExpected.begin(), radixExpected.end(), [](const RadixItem &a, const RadixItem &b) { return a.Key < b.Key; });
+            RadixSort(radixItems, workerCount);
+
+            ++cases;
+            if (!std::equal(radixItems.begin(), radixItems.end(), radixExpected.begin(), radixExpected.end(), [](const RadixItem &a, const RadixItem &b) { return a.Key == b.Key && a.Row == b.Row; }))
+                ++mismatches;
+        }
+    }
+
+    std::stringstream ss;
+    ss << "ParallelSort verification: " << cases << " cases, " << mismatches << " mismatches";
+    monitor.AddDebugOutput(ss.str());
+
+    return mismatches == 0;
+}
+
+void ParallelSort::BenchmarkSort(AppStatusMonitor &monitor)
+{
+    size_t rowCount = 1000000;
+#ifdef _DEBUG
+    rowCount = 50000;
+#endif
+
+    size_t maxThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    std::stringstream ss;
+    ss << "Sort benchmark (" << rowCount << " rows by timestamp):";
+    for (size_t threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        //the same shuffled rows every time, as a timestamp column and a message column
+        std::mt19937 rng(2016);
+        std::vector<LogEntry> rows;
+        rows.reserve(rowCount);
+        for (size_t r = 0; r < rowCount; ++r)
+        {
+            char timestamp[64];
+            uint32_t second = rng() % 864000;
+            snprintf(timestamp, sizeof(timestamp), "2016-05-%02uT%02u:%02u:%02u.%07uZ", 1 + second / 86400, (second / 3600) % 24, (second / 60) % 60, second % 60, (uint32_t)(rng() % 10000000));
+
+            std::string line = std::string(timestamp) + " message " + std::to_string(r);
+            size_t timestampLength = strlen(timestamp);
+            rows.emplace_back(line, "", std::vector<LogEntryColumn> { LogEntryColumn(0, 0, timestampLength), LogEntryColumn(1, timestampLength + 1, line.size()) }, std::vector<LogEntryColumn> {});
+        }
+
+        auto tpBegin = std::chrono::high_resolution_clock::now();
+        RowSorter::Sort(rows, 0, rows.size(), { { 0, true, RowSorter::InferType(rows, 0, rows.size(), 0) } }, threads);
+        auto tpEnd = std::chrono::high_resolution_clock::now();
+
+        ss << " " << threads << (threads == 1 ? " thread " : " threads ") << std::chrono::duration_cast<std::chrono::microseconds>(tpEnd - tpBegin).count() / 1000.0 << "ms";
+
+        //sorting them again is what loading logs that were already in order costs
+        if (threads == maxThreads)
+        {
+            tpBegin = std::chrono::high_resolution_clock::now();
+            RowSorter::Sort(rows, 0, rows.size(), { { 0, true, SortType::Time } }, threads);
+            tpEnd = std::chrono::high_resolution_clock::now();
+
+            ss << ", already sorted " << std::chrono::duration_cast<std::chrono::microseconds>(tpEnd - tpBegin).count() / 1000.0 << "ms";
+            break;
+        }
+        ss << ",";
+    }
+
+    monitor.AddDebugOutput(ss.str());
+}
@@ -0,0 +1,158 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+#include "ThreadPool.h"
+
+//Stable sorting spread across the thread pool.  The range is cut into a run per worker and the runs are sorted at the same time, then neighbouring runs
+//are merged in pairs until one is left.  Every round of merging is cut into equal slices of output by merge path, which finds where a slice starts in both
+//of its inputs with a binary search, so all the workers stay busy through the merges instead of one thread walking the whole range once per run.
+//Integer keys can instead be radix sorted, a byte at a time from the lowest, which never compares anything.
+namespace ParallelSort
+{
+    //ranges smaller than this aren't worth splitting
+    const size_t MinRunSize = 4096;
+
+    //how many of the first diagonal outputs of a stable merge of a and b come from a.  ties go to a.
+    template <typename ItA, typename ItB, typename Compare>
+    size_t MergePathSplit(ItA a, size_t aSize, ItB b, size_t bSize, size_t diagonal, Compare &comp)
+    {
+        size_t lo = diagonal > bSize ? diagonal - bSize : 0;
+        size_t hi = std::min(diagonal, aSize);
+        while (lo < hi)
+        {
+            //a[mid] goes before b[diagonal - mid - 1] unless it's greater, in which case fewer come from a
+            size_t mid = lo + (hi - lo) / 2;
+            if (!comp(b[diagonal - mid - 1], a[mid]))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+        return lo;
+    }
+
+    //merges each pair of neighbouring runs of source (the first run is bounds[0] to bounds[1], and so on) into the same place in dest
+    template <typename SourceIt, typename DestIt, typename Compare>
+    void MergeRound(SourceIt source, DestIt dest, const std::vector<size_t> &bounds, size_t workerCount, Compare &comp)
+    {
+        struct Slice
+        {
+            size_t ABegin, AEnd, BBegin, BEnd, Out;
+        };
+
+        size_t sliceSize = std::max(MinRunSize, (bounds.back() - bounds.front()) / (workerCount * 4));
+        std::vector<Slice> slices;
+        for (size_t r = 0; r + 1 < bounds.size(); r += 2)
+        {
+            //an odd run out has nothing to merge with, and is just moved across
+            size_t aBegin = bounds[r];
+            size_t bBegin = bounds[r + 1];
+            size_t bEnd = (r + 2 < bounds.size()) ? bounds[r + 2] : bBegin;
+            size_t aSize = bBegin - aBegin;
+            size_t bSize = bEnd - bBegin;
+
+            size_t prevSplit = 0;
+            for (size_t diagonal = 0; diagonal < aSize + bSize;)
+            {
+                size_t nextDiagonal = std::min(diagonal + sliceSize, aSize + bSize);
+                size_t nextSplit = MergePathSplit(source + aBegin, aSize, source + bBegin, bSize, nextDiagonal, comp);
+                slices.push_back({ aBegin + prevSplit, aBegin + nextSplit, bBegin + (diagonal - prevSplit), bBegin + (nextDiagonal - nextSplit), aBegin + diagonal });
+                diagonal = nextDiagonal;
+                prevSplit = nextSplit;
+            }
+        }
+
+        ParallelFor(AppStatusMonitor::Instance, workerCount, 0, slices.size(), 1, [&](size_t threadIndex, size_t sliceBegin, size_t sliceEnd)
+        {
+            for (size_t s = sliceBegin; s < sliceEnd; ++s)
+            {
+                const Slice &slice = slices[s];
+                std::merge(std::make_move_iterator(source + slice.ABegin), std::make_move_iterator(source + slice.AEnd), std::make_move_iterator(source + slice.BBegin), std::make_move_iterator(source + slice.BEnd), dest + slice.Out, comp);
+            }
+        });
+    }
+
+    //merges runs that are already sorted into one, like std::stable_sort would sort them.  the first run is first + bounds[0] to first + bounds[1], and so on,
+    //where bounds[0] is 0.  elements must be default constructible and movable.
+    template <typename RandomIt, typename Compare>
+    void MergeRuns(RandomIt first, std::vector<size_t> bounds, size_t workerCount, Compare comp)
+    {
+        if (bounds.size() <= 2)
+            return;
+
+        //each round halves the runs, moving everything between the range and the buffer
+        size_t count = bounds.back();
+        std::vector<typename std::iterator_traits<RandomIt>::value_type> buffer(count);
+        bool inBuffer = false;
+        while (bounds.size() > 2)
+        {
+            if (inBuffer)
+                MergeRound(buffer.begin(), first, bounds, workerCount, comp);
+            else
+                MergeRound(first, buffer.begin(), bounds, workerCount, comp);
+            inBuffer = !inBuffer;
+
+            std::vector<size_t> mergedBounds;
+            for (size_t r = 0; r < bounds.size(); r += 2)
+                mergedBounds.push_back(bounds[r]);
+            if (mergedBounds.back() != bounds.back())
+                mergedBounds.push_back(bounds.back());
+            bounds.swap(mergedBounds);
+        }
+
+        if (inBuffer)
+        {
+            ParallelFor(AppStatusMonitor::Instance, workerCount, 0, count, 65536, [&](size_t threadIndex, size_t batchBegin, size_t batchEnd)
+            {
+                std::move(buffer.begin() + batchBegin, buffer.begin() + batchEnd, first + batchBegin);
+            });
+        }
+    }
+
+    //sorts first to last like std::stable_sort, using up to workerCount threads.  elements must be default constructible and movable.
+    template <typename RandomIt, typename Compare>
+    void StableSort(RandomIt first, RandomIt last, size_t workerCount, Compare comp)
+    {
+        size_t count = last - first;
+        size_t runCount = std::min(workerCount, count / MinRunSize);
+        if (runCount <= 1)
+        {
+            std::stable_sort(first, last, comp);
+            return;
+        }
+
+        std::vector<size_t> bounds;
+        for (size_t r = 0; r <= runCount; ++r)
+            bounds.push_back(count * r / runCount);
+
+        ThreadPool::Instance().Run(runCount, [&](size_t r)
+        {
+            std::stable_sort(first + bounds[r], first + bounds[r + 1], comp);
+        });
+
+        MergeRuns(first, std::move(bounds), workerCount, comp);
+    }
+
+    //an integer key and the row it belongs to, for RadixSort
+    struct RadixItem
+    {
+        uint64_t Key = 0;
+        uint32_t Row = 0;
+    };
+
+    //stable sorts items by Key, using up to workerCount threads.  bytes that are the same in every key are skipped, so keys that only differ in a few bytes
+    //(like times within a few days of each other) take a few passes rather than eight.
+    void RadixSort(std::vector<RadixItem> &items, size_t workerCount);
+
+    //checks StableSort and RadixSort against std::stable_sort on generated keys with lots of ties, for a range of sizes and worker counts.  returns true if they agreed.
+    bool VerifySort(AppStatusMonitor &monitor);
+
+    //times sorting generated rows by a timestamp column (the way SortRange does) at each power of two threads up to the hardware's count, and reports the results
+    void BenchmarkSort(AppStatusMonitor &monitor);
+}
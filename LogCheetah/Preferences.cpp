@@ -137,6 +137,9 @@ namespace Preferences
             ForceCats = (TrimString(forceCatsString) == "1");
 
         allowMemoryUseChecks = ini.GetValue("General", "PromptWhenMemoryFull") != "false";
+        deferUnusedJsonColumns = ini.GetValue("General", "DeferUnusedJsonColumns") == "true";
+        explodeJsonArrays = ini.GetValue("General", "ExplodeJsonArrays") == "true";
+        indexRawTextForSearch = ini.GetValue("General", "IndexRawTextForSearch") == "true";
 
         DefaultPrefilter.Clear();
         if (ini.ValueExists("AP", "DefaultPrefilter"))
@@ -146,12 +149,19 @@ namespace Preferences
             {
                 if (part.size() >= 2)
                 {
-                    uint8_t bits = part[0] & 0x3;
+                    uint8_t bits = part[0] & 0x7;
                     DefaultPrefilter.LineFilters.emplace_back();
                     DefaultPrefilter.LineFilters.back().MatchCase = (bits & 1) != 0;
                     DefaultPrefilter.LineFilters.back().Not = (bits & 2) != 0;
                     DefaultPrefilter.LineFilters.back().Value = std::string(part.begin() + 1, part.end());
                     std::transform(DefaultPrefilter.LineFilters.back().Value.begin(), DefaultPrefilter.LineFilters.back().Value.end(), DefaultPrefilter.LineFilters.back().Value.begin(), [](char c) {return c != 0x1f ? c : ','; });
+
+                    if (bits & 4)
+                    {
+                        std::string error;
+                        DefaultPrefilter.LineFilters.back().Regex = true;
+                        DefaultPrefilter.LineFilters.back().Pattern = LinearRegex::Compile(DefaultPrefilter.LineFilters.back().Value, DefaultPrefilter.LineFilters.back().MatchCase, error);
+                    }
                 }
             }
         }
@@ -209,6 +219,9 @@ namespace Preferences
         ini.SetValue("Cats", "Force", ForceCats ? "1" : "0");
 
         ini.SetValue("General", "PromptWhenMemoryFull", allowMemoryUseChecks ? "true" : "false");
+        ini.SetValue("General", "DeferUnusedJsonColumns", deferUnusedJsonColumns ? "true" : "false");
+        ini.SetValue("General", "ExplodeJsonArrays", explodeJsonArrays ? "true" : "false");
+        ini.SetValue("General", "IndexRawTextForSearch", indexRawTextForSearch ? "true" : "false");
 
         std::vector<std::string> defPrefilterParts;
         for (const auto &pf : DefaultPrefilter.LineFilters)
@@ -217,6 +230,7 @@ namespace Preferences
             part.push_back((char)0x30); //put the special bits byte into the common ascii character range
             part[0] |= pf.MatchCase ? 1 : 0;
             part[0] |= pf.Not ? 2 : 0;
+            part[0] |= pf.Regex ? 4 : 0;
             part += pf.Value;
             std::transform(part.begin(), part.end(), part.begin(), [](char c) {return c != ',' ? c : (char)0x1f; });
             defPrefilterParts.emplace_back(std::move(part));
@@ -0,0 +1,575 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "RowBitmap.h"
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <cassert>
+
+namespace
+{
+    //past this many rows a chunk's array would be bigger than its bits
+    const size_t MaxArrayRows = 4096;
+    const size_t ChunkWords = 65536 / 64;
+}
+
+struct RowBitmap::Chunk
+{
+    std::vector<uint16_t> Array; //sorted low bits of each row, used when Bits is empty
+    std::vector<uint64_t> Bits;
+    std::vector<uint16_t> WordRanks; //with Bits, the number of rows in the words before each one, up to RankedWords
+    size_t RankedWords = 0; //how many words WordRanks is filled in for, which covers every word with a row in it
+    uint32_t Count = 0;
+
+    inline bool IsBits() const { return !Bits.empty(); }
+
+    inline bool Contains(uint16_t low) const
+    {
+        if (IsBits())
+            return (Bits[low >> 6] >> (low & 63)) & 1;
+
+        return std::binary_search(Array.begin(), Array.end(), low);
+    }
+
+    size_t Rank(uint16_t low) const
+    {
+        if (!IsBits())
+            return std::lower_bound(Array.begin(), Array.end(), low) - Array.begin();
+
+        size_t w = low >> 6;
+        if (w >= RankedWords)
+            return Count;
+
+        return WordRanks[w] + std::popcount(Bits[w] & ((1ull << (low & 63)) - 1));
+    }
+
+    uint16_t Select(size_t position) const
+    {
+        if (!IsBits())
+            return Array[position];
+
+        //the last word with no more rows before it than position is the one holding it, since any empty words before it have the same rank
+        size_t w = std::upper_bound(WordRanks.begin(), WordRanks.begin() + RankedWords, position) - WordRanks.begin() - 1;
+        uint64_t bits = Bits[w];
+        for (position -= WordRanks[w]; position > 0; --position)
+            bits &= bits - 1;
+
+        return (uint16_t)(w * 64 + std::countr_zero(bits));
+    }
+
+    //fills in the ranks of the words up to and including w for rows about to be added to it.  rows are only added after the last one, so every word from
+    //RankedWords on is empty and has every row before it.
+    inline void ExtendRanks(size_t w)
+    {
+        for (; RankedWords <= w; ++RankedWords)
+            WordRanks[RankedWords] = (uint16_t)Count;
+    }
+
+    //the first set bit at or after low, which has to exist
+    uint16_t NextBit(uint32_t low) const
+    {
+        size_t w = low >> 6;
+        uint64_t bits = Bits[w] & (~0ull << (low & 63));
+        while (!bits)
+            bits = Bits[++w];
+
+        return (uint16_t)(w * 64 + std::countr_zero(bits));
+    }
+
+    //the last set bit at or before low, which has to exist
+    uint16_t PrevBit(uint32_t low) const
+    {
+        size_t w = low >> 6;
+        uint64_t bits = Bits[w] & (~0ull >> (63 - (low & 63)));
+        while (!bits)
+            bits = Bits[--w];
+
+        return (uint16_t)(w * 64 + 63 - std::countl_zero(bits));
+    }
+
+    inline uint16_t First() const { return IsBits() ? NextBit(0) : Array.front(); }
+    inline uint16_t Last() const { return IsBits() ? PrevBit(65535) : Array.back(); }
+
+    void Add(uint16_t low)
+    {
+        if (IsBits())
+        {
+            ExtendRanks(low >> 6);
+            Bits[low >> 6] |= 1ull << (low & 63);
+        }
+        else
+            Array.push_back(low);
+
+        ++Count;
+        if (Array.size() > MaxArrayRows)
+            Optimize();
+    }
+
+    //switches to whichever representation is smaller for the number of rows
+    void Optimize()
+    {
+        if (IsBits() && Count <= MaxArrayRows)
+        {
+            Array.clear();
+            Array.reserve(Count);
+            for (size_t w = 0; w < ChunkWords; ++w)
+            {
+                for (uint64_t bits = Bits[w]; bits; bits &= bits - 1)
+                    Array.push_back((uint16_t)(w * 64 + std::countr_zero(bits)));
+            }
+
+            Bits.clear();
+            Bits.shrink_to_fit();
+            WordRanks.clear();
+            WordRanks.shrink_to_fit();
+            RankedWords = 0;
+        }
+        else if (!IsBits() && Array.size() > MaxArrayRows)
+        {
+            Bits.assign(ChunkWords, 0);
+            for (uint16_t low : Array)
+                Bits[low >> 6] |= 1ull << (low & 63);
+
+            Array.clear();
+            Array.shrink_to_fit();
+            RecountBits();
+        }
+    }
+
+    //counts the rows and ranks every word again, after the bits were changed anywhere
+    void RecountBits()
+    {
+        WordRanks.resize(ChunkWords);
+        RankedWords = 0;
+
+        Count = 0;
+        for (size_t w = 0; w < ChunkWords; ++w)
+        {
+            WordRanks[w] = (uint16_t)Count;
+            Count += std::popcount(Bits[w]);
+            if (Bits[w])
+                RankedWords = w + 1;
+        }
+    }
+
+    std::vector<uint64_t> ToBits() const
+    {
+        if (IsBits())
+            return Bits;
+
+        std::vector<uint64_t> bits(ChunkWords, 0);
+        for (uint16_t low : Array)
+            bits[low >> 6] |= 1ull << (low & 63);
+
+        return bits;
+    }
+
+    static std::shared_ptr<Chunk> And(const std::shared_ptr<Chunk> &a, const std::shared_ptr<Chunk> &b)
+    {
+        if (a == b)
+            return a;
+
+        auto result = std::make_shared<Chunk>();
+        if (!a->IsBits() || !b->IsBits())
+        {
+            //the array side can only shrink, so go through it
+            const Chunk &arrayChunk = a->IsBits() ? *b : *a;
+            const Chunk &other = a->IsBits() ? *a : *b;
+            for (uint16_t low : arrayChunk.Array)
+            {
+                if (other.Contains(low))
+                    result->Array.push_back(low);
+            }
+
+            result->Count = (uint32_t)result->Array.size();
+        }
+        else
+        {
+            result->Bits.resize(ChunkWords);
+            for (size_t w = 0; w < ChunkWords; ++w)
+                result->Bits[w] = a->Bits[w] & b->Bits[w];
+
+            result->RecountBits();
+            result->Optimize();
+        }
+
+        return result->Count ? result : nullptr;
+    }
+
+    static std::shared_ptr<Chunk> Or(const std::shared_ptr<Chunk> &a, const std::shared_ptr<Chunk> &b)
+    {
+        if (a == b)
+            return a;
+
+        auto result = std::make_shared<Chunk>();
+        if (!a->IsBits() && !b->IsBits())
+        {
+            std::set_union(a->Array.begin(), a->Array.end(), b->Array.begin(), b->Array.end(), std::back_inserter(result->Array));
+            result->Count = (uint32_t)result->Array.size();
+            result->Optimize();
+        }
+        else
+        {
+            result->Bits = a->ToBits();
+            if (b->IsBits())
+            {
+                for (size_t w = 0; w < ChunkWords; ++w)
+                    result->Bits[w] |= b->Bits[w];
+            }
+            else
+            {
+                for (uint16_t low : b->Array)
+                    result->Bits[low >> 6] |= 1ull << (low & 63);
+            }
+
+            result->RecountBits();
+        }
+
+        return result;
+    }
+
+    static std::shared_ptr<Chunk> AndNot(const std::shared_ptr<Chunk> &a, const std::shared_ptr<Chunk> &b)
+    {
+        if (a == b)
+            return nullptr;
+
+        auto result = std::make_shared<Chunk>();
+        if (!a->IsBits())
+        {
+            for (uint16_t low : a->Array)
+            {
+                if (!b->Contains(low))
+                    result->Array.push_back(low);
+            }
+
+            result->Count = (uint32_t)result->Array.size();
+        }
+        else
+        {
+            result->Bits = a->Bits;
+            if (b->IsBits())
+            {
+                for (size_t w = 0; w < ChunkWords; ++w)
+                    result->Bits[w] &= ~b->Bits[w];
+            }
+            else
+            {
+                for (uint16_t low : b->Array)
+                    result->Bits[low >> 6] &= ~(1ull << (low & 63));
+            }
+
+            result->RecountBits();
+            result->Optimize();
+        }
+
+        return result->Count ? result : nullptr;
+    }
+};
+
+RowBitmap::const_iterator& RowBitmap::const_iterator::operator++()
+{
+    const Chunk &c = *owner->chunks[chunk];
+    if (index + 1 < c.Count)
+    {
+        ++index;
+        low = c.IsBits() ? c.NextBit((uint32_t)low + 1) : c.Array[index];
+    }
+    else
+    {
+        ++chunk;
+        index = 0;
+        low = chunk < owner->chunks.size() ? owner->chunks[chunk]->First() : 0;
+    }
+
+    return *this;
+}
+
+RowBitmap::const_iterator& RowBitmap::const_iterator::operator--()
+{
+    if (chunk < owner->chunks.size() && index > 0)
+    {
+        const Chunk &c = *owner->chunks[chunk];
+        --index;
+        low = c.IsBits() ? c.PrevBit((uint32_t)low - 1) : c.Array[index];
+    }
+    else
+    {
+        --chunk;
+        const Chunk &c = *owner->chunks[chunk];
+        index = c.Count - 1;
+        low = c.Last();
+    }
+
+    return *this;
+}
+
+RowBitmap RowBitmap::FromSorted(const std::vector<uint32_t> &rows)
+{
+    RowBitmap result;
+    for (uint32_t row : rows)
+        result.Append(row);
+
+    return result;
+}
+
+RowBitmap RowBitmap::AllRows(size_t rowCount)
+{
+    RowBitmap result;
+    for (size_t chunkStart = 0; chunkStart < rowCount; chunkStart += 65536)
+    {
+        size_t rowsInChunk = std::min<size_t>(rowCount - chunkStart, 65536);
+        auto chunk = std::make_shared<Chunk>();
+        chunk->Bits.assign(ChunkWords, 0);
+        std::fill(chunk->Bits.begin(), chunk->Bits.begin() + rowsInChunk / 64, ~0ull);
+        if (rowsInChunk % 64)
+            chunk->Bits[rowsInChunk / 64] = (1ull << (rowsInChunk % 64)) - 1;
+        chunk->RecountBits();
+        chunk->Optimize();
+
+        result.AddChunk((uint16_t)(chunkStart >> 16), std::move(chunk));
+    }
+
+    return result;
+}
+
+void RowBitmap::clear()
+{
+    keys.clear();
+    chunks.clear();
+    rowsBefore.clear();
+    count = 0;
+}
+
+void RowBitmap::Append(uint32_t row)
+{
+    assert(empty() || row > *--end());
+
+    uint16_t key = (uint16_t)(row >> 16);
+    if (keys.empty() || keys.back() != key)
+        AddChunk(key, std::make_shared<Chunk>());
+
+    MutableChunk(chunks.size() - 1).Add((uint16_t)row);
+    ++count;
+}
+
+void RowBitmap::AppendBits(uint32_t firstRow, uint64_t bits)
+{
+    assert(firstRow % 64 == 0);
+    if (!bits)
+        return;
+
+    assert(empty() || firstRow + std::countr_zero(bits) > *--end());
+
+    uint16_t key = (uint16_t)(firstRow >> 16);
+    if (keys.empty() || keys.back() != key)
+        AddChunk(key, std::make_shared<Chunk>());
+
+    Chunk &c = MutableChunk(chunks.size() - 1);
+    uint32_t added = (uint32_t)std::popcount(bits);
+    if (c.IsBits())
+    {
+        c.ExtendRanks((uint16_t)firstRow >> 6);
+        c.Bits[(uint16_t)firstRow >> 6] |= bits;
+        c.Count += added;
+    }
+    else
+    {
+        for (; bits; bits &= bits - 1)
+            c.Add((uint16_t)(firstRow + std::countr_zero(bits)));
+    }
+
+    count += added;
+}
+
+void RowBitmap::TruncateFrom(uint32_t row)
+{
+    size_t i = std::lower_bound(keys.begin(), keys.end(), (uint16_t)(row >> 16)) - keys.begin();
+    size_t keep = i;
+    if (i < keys.size() && keys[i] == (row >> 16) && (uint16_t)row != 0)
+    {
+        Chunk &c = MutableChunk(i);
+        uint16_t low = (uint16_t)row;
+        if (c.IsBits())
+        {
+            c.Bits[low >> 6] &= (1ull << (low & 63)) - 1;
+            std::fill(c.Bits.begin() + (low >> 6) + 1, c.Bits.end(), 0);
+            c.RecountBits();
+            c.Optimize();
+        }
+        else
+        {
+            c.Array.erase(std::lower_bound(c.Array.begin(), c.Array.end(), low), c.Array.end());
+            c.Count = (uint32_t)c.Array.size();
+        }
+
+        if (c.Count)
+            keep = i + 1;
+    }
+
+    keys.resize(keep);
+    chunks.resize(keep);
+    rowsBefore.resize(keep);
+    RecountRows();
+}
+
+bool RowBitmap::Contains(uint32_t row) const
+{
+    auto found = std::lower_bound(keys.begin(), keys.end(), (uint16_t)(row >> 16));
+    return found != keys.end() && *found == (row >> 16) && chunks[found - keys.begin()]->Contains((uint16_t)row);
+}
+
+size_t RowBitmap::Rank(uint32_t row) const
+{
+    size_t i = std::lower_bound(keys.begin(), keys.end(), (uint16_t)(row >> 16)) - keys.begin();
+    if (i == keys.size())
+        return count;
+    if (keys[i] != (row >> 16))
+        return rowsBefore[i];
+
+    return rowsBefore[i] + chunks[i]->Rank((uint16_t)row);
+}
+
+uint32_t RowBitmap::Select(size_t position) const
+{
+    assert(position < count);
+
+    size_t i = std::upper_bound(rowsBefore.begin(), rowsBefore.end(), position) - rowsBefore.begin() - 1;
+    return ((uint32_t)keys[i] << 16) | chunks[i]->Select(position - rowsBefore[i]);
+}
+
+RowBitmap RowBitmap::And(const RowBitmap &a, const RowBitmap &b)
+{
+    RowBitmap result;
+    size_t ia = 0, ib = 0;
+    while (ia < a.keys.size() && ib < b.keys.size())
+    {
+        if (a.keys[ia] < b.keys[ib])
+            ++ia;
+        else if (b.keys[ib] < a.keys[ia])
+            ++ib;
+        else
+        {
+            if (auto chunk = Chunk::And(a.chunks[ia], b.chunks[ib]))
+                result.AddChunk(a.keys[ia], std::move(chunk));
+            ++ia;
+            ++ib;
+        }
+    }
+
+    return result;
+}
+
+RowBitmap RowBitmap::Or(const RowBitmap &a, const RowBitmap &b)
+{
+    RowBitmap result;
+    size_t ia = 0, ib = 0;
+    while (ia < a.keys.size() || ib < b.keys.size())
+    {
+        if (ib == b.keys.size() || (ia < a.keys.size() && a.keys[ia] < b.keys[ib]))
+        {
+            result.AddChunk(a.keys[ia], a.chunks[ia]);
+            ++ia;
+        }
+        else if (ia == a.keys.size() || b.keys[ib] < a.keys[ia])
+        {
+            result.AddChunk(b.keys[ib], b.chunks[ib]);
+            ++ib;
+        }
+        else
+        {
+            result.AddChunk(a.keys[ia], Chunk::Or(a.chunks[ia], b.chunks[ib]));
+            ++ia;
+            ++ib;
+        }
+    }
+
+    return result;
+}
+
+RowBitmap RowBitmap::AndNot(const RowBitmap &a, const RowBitmap &b)
+{
+    RowBitmap result;
+    size_t ib = 0;
+    for (size_t ia = 0; ia < a.keys.size(); ++ia)
+    {
+        while (ib < b.keys.size() && b.keys[ib] < a.keys[ia])
+            ++ib;
+
+        if (ib < b.keys.size() && b.keys[ib] == a.keys[ia])
+        {
+            if (auto chunk = Chunk::AndNot(a.chunks[ia], b.chunks[ib]))
+                result.AddChunk(a.keys[ia], std::move(chunk));
+        }
+        else
+            result.AddChunk(a.keys[ia], a.chunks[ia]);
+    }
+
+    return result;
+}
+
+std::vector<uint32_t> RowBitmap::ToVector() const
+{
+    std::vector<uint32_t> rows;
+    rows.reserve(count);
+    for (uint32_t row : *this)
+        rows.push_back(row);
+
+    return rows;
+}
+
+size_t RowBitmap::MemoryUsed() const
+{
+    size_t bytes = sizeof(*this) + keys.capacity() * sizeof(uint16_t) + chunks.capacity() * sizeof(std::shared_ptr<Chunk>) + rowsBefore.capacity() * sizeof(size_t);
+    for (auto &c : chunks)
+        bytes += sizeof(Chunk) + c->Array.capacity() * sizeof(uint16_t) + c->Bits.capacity() * sizeof(uint64_t) + c->WordRanks.capacity() * sizeof(uint16_t);
+
+    return bytes;
+}
+
+RowBitmap::const_iterator RowBitmap::begin() const
+{
+    return chunks.empty() ? end() : const_iterator(this, 0, 0, chunks[0]->First());
+}
+
+RowBitmap::const_iterator RowBitmap::end() const
+{
+    return const_iterator(this, chunks.size(), 0, 0);
+}
+
+RowBitmap::const_iterator RowBitmap::IteratorAt(size_t position) const
+{
+    if (position >= count)
+        return end();
+
+    size_t i = std::upper_bound(rowsBefore.begin(), rowsBefore.end(), position) - rowsBefore.begin() - 1;
+    size_t index = position - rowsBefore[i];
+    return const_iterator(this, i, index, chunks[i]->Select(index));
+}
+
+void RowBitmap::AddChunk(uint16_t key, std::shared_ptr<Chunk> chunk)
+{
+    keys.push_back(key);
+    rowsBefore.push_back(count);
+    count += chunk->Count;
+    chunks.emplace_back(std::move(chunk));
+}
+
+RowBitmap::Chunk& RowBitmap::MutableChunk(size_t index)
+{
+    //copy on write, since other bitmaps may be sharing it
+    if (chunks[index].use_count() > 1)
+        chunks[index] = std::make_shared<Chunk>(*chunks[index]);
+
+    return *chunks[index];
+}
+
+void RowBitmap::RecountRows()
+{
+    count = 0;
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        rowsBefore[i] = count;
+        count += chunks[i]->Count;
+    }
+}
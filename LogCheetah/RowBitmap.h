@@ -0,0 +1,98 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <cstdint>
+#include <cstddef>
+
+//A compressed set of row numbers, split into chunks of 65536 rows the way a roaring bitmap is.  A chunk with few rows holds a sorted array of their low 16 bits,
+//and one with many holds a bit per row, along with how many rows come before each word of bits so finding the row at a position is a short search.  Chunks are shared between copies until one of the copies changes them, so copying a whole view's rows is cheap.
+class RowBitmap
+{
+private:
+    struct Chunk;
+
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = uint32_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const uint32_t*;
+        using reference = uint32_t;
+
+        const_iterator() = default;
+
+        inline uint32_t operator*() const { return ((uint32_t)owner->keys[chunk] << 16) | low; }
+        const_iterator& operator++();
+        const_iterator& operator--();
+        inline const_iterator operator++(int) { const_iterator prev = *this; ++*this; return prev; }
+        inline const_iterator operator--(int) { const_iterator prev = *this; --*this; return prev; }
+        inline bool operator==(const const_iterator &o) const { return chunk == o.chunk && index == o.index; }
+
+    private:
+        friend class RowBitmap;
+        inline const_iterator(const RowBitmap *owner, size_t chunk, size_t index, uint16_t low) : owner(owner), chunk(chunk), index(index), low(low) {}
+
+        const RowBitmap *owner = nullptr;
+        size_t chunk = 0;
+        size_t index = 0; //position within the chunk
+        uint16_t low = 0;
+    };
+
+    RowBitmap() = default;
+
+    //rows must be in ascending order without duplicates
+    static RowBitmap FromSorted(const std::vector<uint32_t> &rows);
+    static RowBitmap AllRows(size_t rowCount);
+
+    inline size_t size() const { return count; }
+    inline bool empty() const { return count == 0; }
+    void clear();
+
+    //adds a row after every row already in the set
+    void Append(uint32_t row);
+
+    //adds firstRow + i for each bit i set in bits, after every row already in the set.  firstRow must be a multiple of 64.
+    void AppendBits(uint32_t firstRow, uint64_t bits);
+
+    //removes every row from row onwards
+    void TruncateFrom(uint32_t row);
+
+    bool Contains(uint32_t row) const;
+
+    //the number of rows in the set that are less than row
+    size_t Rank(uint32_t row) const;
+
+    //the row at a position in the set, which must be less than size()
+    uint32_t Select(size_t position) const;
+    inline uint32_t operator[](size_t position) const { return Select(position); }
+
+    static RowBitmap And(const RowBitmap &a, const RowBitmap &b);
+    static RowBitmap Or(const RowBitmap &a, const RowBitmap &b);
+    static RowBitmap AndNot(const RowBitmap &a, const RowBitmap &b);
+
+    std::vector<uint32_t> ToVector() const;
+    size_t MemoryUsed() const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    //an iterator to the row at a position in the set, or end() if it's past the last
+    const_iterator IteratorAt(size_t position) const;
+
+private:
+    void AddChunk(uint16_t key, std::shared_ptr<Chunk> chunk);
+    Chunk& MutableChunk(size_t index);
+    void RecountRows();
+
+    std::vector<uint16_t> keys; //the high 16 bits of the rows in each chunk, ascending
+    std::vector<std::shared_ptr<Chunk>> chunks; //only changed in place when not shared with another copy
+    std::vector<size_t> rowsBefore; //the number of rows in the chunks before each one
+    size_t count = 0;
+};
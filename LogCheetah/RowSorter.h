@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "LogParserCommon.h"
+
+//Sorts rows by a column without comparing LogEntry objects or moving them around while sorting.  Each row gets a key of two integers that compare in the same
+//order as its value, along with where the whole value is for ties.  Text keys hold the first 16 bytes of the value after any bytes every value starts with.
+//Number and time keys hold the value itself, and version keys are text keys of the value with each run of digits written out so that it sorts as a number.
+//Sorting by more than one column gives each row a single key of every column's value in turn, written so that comparing keys byte by byte orders the rows the
+//same way as comparing them column by column.  The keys are sorted as a compact array, and the rows are then moved into their new order once.
+class RowSorter
+{
+public:
+    //stable sorts lines begin to end by the columns of order, using up to workerCount threads
+    static void Sort(std::vector<LogEntry> &lines, size_t begin, size_t end, const std::vector<LogSortEntry> &order, size_t workerCount);
+
+    //picks the type most of a sample of the values of column are: numbers, then times, then versions, otherwise text
+    static SortType InferType(const std::vector<LogEntry> &lines, size_t begin, size_t end, uint16_t column);
+
+    //orders two values the way Sort does (ascending), as less than zero, zero, or more than zero
+    static int CompareValues(const ExternalSubstring<const char> &a, const ExternalSubstring<const char> &b, SortType type);
+
+    //orders two rows the way Sort does, as less than zero, zero, or more than zero
+    static int CompareRows(const LogEntry &a, const LogEntry &b, const std::vector<LogSortEntry> &order);
+
+    //checks Sort against std::stable_sort with CompareRows on generated rows of each type, in both directions and by several columns.  returns true if they agreed.
+    static bool VerifySort(AppStatusMonitor &monitor);
+};
@@ -18,6 +18,9 @@ int cpuCountSort = 1;
 int cpuCountFilter = 1;
 
 bool allowMemoryUseChecks = true;
+bool deferUnusedJsonColumns = false;
+bool explodeJsonArrays = false;
+bool indexRawTextForSearch = false;
 bool isAppStatusCanceling = false;
 
 void OverrideCpuCount(int &val, int targetVal)
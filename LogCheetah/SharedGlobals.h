@@ -33,6 +33,9 @@ void OverrideCpuCount(int general, int parse, int sort, int filter);
 
 //
 extern bool allowMemoryUseChecks; //default is true
+extern bool deferUnusedJsonColumns; //default is false.  when set, the json parser only pulls out values for time, date, and name columns up front, leaving the rest for when they're used
+extern bool explodeJsonArrays; //default is false.  when set, json arrays also get a path[N] column per element, with later elements only pulled out when they're used
+extern bool indexRawTextForSearch; //default is false.  when set, a trigram index of the raw text is built the first time rows are searched or filtered, and used from then on
 struct VMUState
 {
     inline VMUState(int skipCallsCount = 10000) : HasAskedUserCurrentFull(false), HasAskedUserTooMuchForSystem(false), UserResponse(true), SkipCur(0), SkipMax(skipCallsCount)
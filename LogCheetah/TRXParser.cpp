@@ -7,11 +7,11 @@
 #include "XmlLexicon.h"
 #include <cstdint>
 #include <vector>
-#include <sstream>
 #include <array>
 #include <map>
 #include <set>
-#include <iomanip>
+#include <unordered_map>
+#include <algorithm>
 #include <string_view>
 
 namespace
@@ -29,16 +29,6 @@ namespace
     const uint16_t COLUMNINDEX_OUTPUT = 10;
     const uint16_t COLUMNINDEX_MAXFIXED = COLUMNINDEX_OUTPUT;
 
-    // Must be treated read-only
-    struct VectorToIStream : std::streambuf
-    {
-        VectorToIStream(const std::vector<char> &vec)
-        {
-            std::vector<char> &vecNonConst = const_cast<std::vector<char>&>(vec);
-            setg(vecNonConst.data(), vecNonConst.data(), vecNonConst.data() + vecNonConst.size());
-        }
-    };
-
     inline void AddColumnExtraData(std::vector<LogEntryColumn> &columnData, std::string &extraData, uint16_t columnIndex, const std::string_view valueToAdd)
     {
         columnData.emplace_back(columnIndex, (uint32_t)extraData.size(), (uint32_t)(extraData.size() + valueToAdd.size()));
@@ -55,116 +45,191 @@ namespace
         std::string Category;
     };
 
-    std::unordered_map<std::string, TestDefinition> FindTestDefinitions(const XmlLexicon::Node &testRunNode)
+    //what has to be known about a test run before its results can be turned into rows
+    struct TestRunInfo
+    {
+        std::string RunFinishedTime;
+        std::unordered_map<std::string, TestDefinition> IdToTestDefinition;
+    };
+
+    //names of the currently open elements, and whether each has had a child element yet
+    struct OpenElement
+    {
+        std::string_view Name;
+        bool HasChildren;
+    };
+
+    //matches the trimming done to element values by the tree parser, which is just spaces and tabs
+    inline std::string_view TrimElementValue(std::string_view value)
+    {
+        size_t begin = 0;
+        while (begin < value.size() && (value[begin] == ' ' || value[begin] == '\t'))
+            ++begin;
+
+        size_t end = value.size();
+        while (end > begin && (value[end - 1] == ' ' || value[end - 1] == '\t'))
+            --end;
+
+        return value.substr(begin, end - begin);
+    }
+
+    //tracks the open element path for a start event, either descending into it or skipping it entirely.  returns true if descending.
+    inline bool EnterElement(XmlLexicon::PullReader &reader, std::vector<OpenElement> &path, bool descend)
+    {
+        if (!path.empty())
+            path.back().HasChildren = true;
+
+        if (!descend)
+        {
+            reader.SkipElement();
+            return false;
+        }
+
+        path.push_back({ reader.Name(), false });
+        return true;
+    }
+
+    void ReadTestMethod(const XmlLexicon::PullReader &reader, TestDefinition &testDef)
+    {
+        //VSTest is inconsistent here. className could be 2 parts separated by a comma (class and assembly), or it could be just the class, in which case we'll have to scrape the assembly out of another field
+        const std::string_view *classNameBlob = reader.FindAttribute("className");
+        if (classNameBlob)
+        {
+            std::vector<std::string> classNameBlobParts = StringSplit({ ',' }, std::string(*classNameBlob));
+            if (classNameBlobParts.size() >= 2)
+            {
+                testDef.ClassName = classNameBlobParts[0];
+                testDef.AssemblyName = classNameBlobParts[1];
+            }
+            else
+                testDef.ClassName = *classNameBlob;
+        }
+
+        if (testDef.AssemblyName.empty())
+        {
+            const std::string_view *assemblyFullPath = reader.FindAttribute("codeBase");
+            if (assemblyFullPath)
+            {
+                std::vector<std::string> pathParts = StringSplit({ '/','\\' }, std::string(*assemblyFullPath));
+                testDef.AssemblyName = pathParts.back();
+                if (EndsWith(StringToLower(testDef.AssemblyName), ".dll"))
+                    testDef.AssemblyName.resize(testDef.AssemblyName.size() - 4);
+            }
+        }
+    }
+
+    //first pass over the document, which collects the finish time and test definitions of each run and skips over everything else
+    std::vector<TestRunInfo> ReadTestRuns(AppStatusMonitor &monitor, std::string_view xml)
     {
-        std::unordered_map<std::string, TestDefinition> idToTestDefinition;
+        std::vector<TestRunInfo> runs;
+        TestDefinition testDef;
+        std::vector<OpenElement> path;
+        size_t reportedPos = 0;
 
-        for (const XmlLexicon::Node &testRunChild : testRunNode.Children)
+        XmlLexicon::PullReader reader { xml };
+        while (reader.Next() && !monitor.IsCancelling())
         {
-            if (testRunChild.Name == "TestDefinitions")
+            if (reader.Type() == XmlLexicon::PullReader::EventType::StartElement)
             {
-                for (const XmlLexicon::Node &testDefinitionsChild : testRunChild.Children)
+                std::string_view name = reader.Name();
+                size_t depth = reader.Depth();
+
+                if (depth == 1)
                 {
-                    if (testDefinitionsChild.Name == "UnitTest")
+                    if (EnterElement(reader, path, name == "TestRun"))
+                        runs.emplace_back();
+                }
+                else if (depth == 2)
+                {
+                    if (name == "Times")
                     {
-                        TestDefinition testDef;
-                        for (auto &kvp : testDefinitionsChild.PropertyList)
-                        {
-                            if (kvp.first == "name")
-                                testDef.TestName = kvp.second;
-                            else if (kvp.first == "id")
-                                testDef.Id = kvp.second;
-                        }
+                        const std::string_view *time = reader.FindAttribute("finish");
+                        if (time && runs.back().RunFinishedTime.empty())
+                            runs.back().RunFinishedTime = *time;
+                    }
 
-                        for (const XmlLexicon::Node &unitTestChild : testDefinitionsChild.Children)
+                    EnterElement(reader, path, name == "TestDefinitions");
+                }
+                else if (depth == 3)
+                {
+                    if (EnterElement(reader, path, name == "UnitTest"))
+                    {
+                        testDef = TestDefinition();
+                        if (const std::string_view *testName = reader.FindAttribute("name"))
+                            testDef.TestName = *testName;
+                        if (const std::string_view *id = reader.FindAttribute("id"))
+                            testDef.Id = *id;
+                    }
+                }
+                else if (depth == 4)
+                {
+                    if (name == "TestMethod")
+                        ReadTestMethod(reader, testDef);
+
+                    EnterElement(reader, path, name == "Description" || name == "TestCategory");
+                }
+                else if (depth == 5 && path[3].Name == "TestCategory")
+                {
+                    if (name == "TestCategoryItem")
+                    {
+                        const std::string_view *category = reader.FindAttribute("TestCategory");
+                        if (category)
                         {
-                            if (unitTestChild.Name == "Description")
-                                testDef.Description = unitTestChild.Value;
-                            else if (unitTestChild.Name == "TestCategory")
-                            {
-                                for (const XmlLexicon::Node &testCategoryChild : unitTestChild.Children)
-                                {
-                                    if (testCategoryChild.Name == "TestCategoryItem")
-                                    {
-                                        const std::string *category = testCategoryChild.FindProperty("TestCategory");
-                                        if (category)
-                                        {
-                                            if (!testDef.Category.empty())
-                                                testDef.Category.append(", ");
-                                            testDef.Category.append(*category);
-                                        }
-                                    }
-                                }
-                            }
-                            else if (unitTestChild.Name == "TestMethod")
-                            {
-                                //VSTest is inconsistent here. className could be 2 parts separated by a comma (class and assembly), or it could be just the class, in which case we'll have to scrape the assembly out of another field
-                                const std::string *classNameBlob = unitTestChild.FindProperty("className");
-                                if (classNameBlob)
-                                {
-                                    std::vector<std::string> classNameBlobParts = StringSplit({ ',' }, *classNameBlob);
-                                    if (classNameBlobParts.size() >= 2)
-                                    {
-                                        testDef.ClassName = classNameBlobParts[0];
-                                        testDef.AssemblyName = classNameBlobParts[1];
-                                    }
-                                    else
-                                        testDef.ClassName = *classNameBlob;
-                                }
-
-                                if (testDef.AssemblyName.empty())
-                                {
-                                    const std::string *assemblyFullPath = unitTestChild.FindProperty("codeBase");
-                                    if (assemblyFullPath)
-                                    {
-                                        std::vector<std::string> pathParts = StringSplit({ '/','\\' }, *assemblyFullPath);
-                                        testDef.AssemblyName = pathParts.back();
-                                        if (EndsWith(StringToLower(testDef.AssemblyName), ".dll"))
-                                            testDef.AssemblyName.resize(testDef.AssemblyName.size() - 4);
-                                    }
-                                }
-                            }
+                            if (!testDef.Category.empty())
+                                testDef.Category.append(", ");
+                            testDef.Category.append(*category);
                         }
-
-                        idToTestDefinition.emplace(StringToLower(testDef.Id), std::move(testDef));
                     }
+
+                    EnterElement(reader, path, false);
                 }
+                else
+                    EnterElement(reader, path, false);
             }
-        }
+            else if (reader.Type() == XmlLexicon::PullReader::EventType::EndElement && !path.empty())
+            {
+                OpenElement closed = path.back();
+                path.pop_back();
 
-        return std::move(idToTestDefinition);
-    }
+                if (path.size() == 3 && closed.Name == "Description" && !closed.HasChildren)
+                    testDef.Description = TrimElementValue(reader.InnerTextWithoutCData());
+                else if (path.size() == 2 && closed.Name == "UnitTest")
+                {
+                    std::string key = StringToLower(testDef.Id);
+                    runs.back().IdToTestDefinition.emplace(std::move(key), std::move(testDef));
 
-    std::string FindRunFinishedTime(const XmlLexicon::Node &testRunNode)
-    {
-        for (const XmlLexicon::Node &testRunChild : testRunNode.Children)
-        {
-            if (testRunChild.Name == "Times")
-            {
-                const std::string *time = testRunChild.FindProperty("finish");
-                if (time)
-                    return *time;
+                    monitor.AddProgress(reader.Position() - reportedPos);
+                    reportedPos = reader.Position();
+                }
             }
         }
 
-        return std::string();
+        monitor.AddProgress(xml.size() - reportedPos);
+        return std::move(runs);
     }
 
-    void WalkAllChildOutput(std::string &output, const XmlLexicon::Node &node, std::string prefix = "")
+    //appends the value of a leaf element somewhere under an Output element, labelled with the path from the Output element down to it
+    void AppendOutputValue(std::string &output, const std::vector<OpenElement> &path, size_t outputDepth, std::string_view value)
     {
-        if (!node.Value.empty())
-        {
-            if (!output.empty())
-                output.append("\r\n");
+        value = TrimElementValue(value);
+        if (value.empty())
+            return;
 
-            if (!prefix.empty())
-                output.append(prefix + ":\r\n");
+        if (!output.empty())
+            output.append("\r\n");
 
-            output.append(node.Value);
+        if (path.size() > outputDepth)
+        {
+            for (size_t i = outputDepth; i < path.size(); ++i)
+            {
+                if (i != outputDepth)
+                    output.push_back('.');
+                output.append(path[i].Name);
+            }
+            output.append(":\r\n");
         }
 
-        for (const XmlLexicon::Node &child : node.Children)
-            WalkAllChildOutput(output, child, prefix.empty() ? child.Name : prefix + "." + child.Name);
+        output.append(value);
     }
 }
 
@@ -188,112 +253,141 @@ namespace TRX
         logs.Columns.emplace_back("Output");
 
         monitor.SetControlFeatures(true);
-        monitor.SetProgressFeatures(0, "xml files", 1);
 
-        // rawDataToConsume should contain a complete xml file
-        VectorToIStream xmlStreamWrapper { rawDataToConsume };
-        std::istream xmlStream { &xmlStreamWrapper };
-        XmlLexicon xml { xmlStream };
+        // rawDataToConsume should contain a complete xml file.  it's walked twice without building a tree, first for the test definitions that results refer to, then for the results themselves.
+        std::string_view xml { rawDataToConsume.data(), rawDataToConsume.size() };
+        monitor.SetProgressFeatures(xml.size() * 2, "MB", 1000000);
+
+        std::vector<TestRunInfo> runs = ReadTestRuns(monitor, xml);
+
+        const TestRunInfo *run = nullptr;
+        size_t runIndex = 0;
+        std::string_view runId;
+        std::vector<OpenElement> path;
+        size_t reportedPos = 0;
+
+        //the row currently being built, from either a ResultSummary or a UnitTestResult
+        std::string extraData;
+        std::vector<LogEntryColumn> columnData;
+        std::string output;
+        std::vector<XmlLexicon::PullReader::Attribute> counters;
 
-        for (const XmlLexicon::Node &testRunNode : xml.GetRoots())
+        XmlLexicon::PullReader reader { xml };
+        while (reader.Next() && !monitor.IsCancelling())
         {
-            if (testRunNode.Name == "TestRun")
+            if (reader.Type() == XmlLexicon::PullReader::EventType::StartElement)
             {
-                std::string runId;
-                std::string runFinishedTime = FindRunFinishedTime(testRunNode);
-                std::unordered_map<std::string, TestDefinition> idToTestDefinition = FindTestDefinitions(testRunNode);
+                std::string_view name = reader.Name();
+                size_t depth = reader.Depth();
 
-                const std::string *id = testRunNode.FindProperty("id");
-                if (id)
-                    runId = *id;
-
-                for (const XmlLexicon::Node &testRunChild : testRunNode.Children)
+                if (depth == 1)
+                {
+                    if (EnterElement(reader, path, name == "TestRun" && runIndex < runs.size()))
+                    {
+                        run = &runs[runIndex++];
+                        const std::string_view *id = reader.FindAttribute("id");
+                        runId = id ? *id : std::string_view();
+                    }
+                }
+                else if (depth == 2)
                 {
-                    if (testRunChild.Name == "ResultSummary")
+                    if (EnterElement(reader, path, name == "ResultSummary" || name == "Results") && name == "ResultSummary")
                     {
-                        std::string extraData;
-                        std::vector<LogEntryColumn> columnData;
+                        extraData.clear();
+                        columnData.clear();
+                        output.clear();
                         AddColumnExtraData(columnData, extraData, COLUMNINDEX_ITEMTYPE, "Summary");
                         AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTRUNID, runId);
-                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_DATE, runFinishedTime);
+                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_DATE, run->RunFinishedTime);
 
-                        const std::string *outcome = testRunChild.FindProperty("outcome");
+                        const std::string_view *outcome = reader.FindAttribute("outcome");
                         if (outcome)
                             AddColumnExtraData(columnData, extraData, COLUMNINDEX_OUTCOME, *outcome);
-
-                        std::string resultsBlob;
-                        for (const XmlLexicon::Node &resultSummaryChild : testRunChild.Children)
+                    }
+                }
+                else if (depth == 3 && path[1].Name == "ResultSummary")
+                {
+                    if (name == "Counters")
+                    {
+                        //attributes come out in name order, same as the tree parser
+                        counters = reader.Attributes();
+                        std::sort(counters.begin(), counters.end(), [](const XmlLexicon::PullReader::Attribute &a, const XmlLexicon::PullReader::Attribute &b) { return a.Name != b.Name ? a.Name < b.Name : a.Value < b.Value; });
+                        for (const XmlLexicon::PullReader::Attribute &counter : counters)
                         {
-                            if (resultSummaryChild.Name == "Counters")
-                            {
-                                for (auto &kvp : resultSummaryChild.PropertyList)
-                                {
-                                    if (!resultsBlob.empty())
-                                        resultsBlob.append(" ");
+                            if (!output.empty())
+                                output.append(" ");
 
-                                    resultsBlob.append(kvp.first + "=" + kvp.second);
-                                }
-                            }
+                            output.append(counter.Name);
+                            output.append("=");
+                            output.append(counter.Value);
                         }
-
-                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_OUTPUT, resultsBlob);
-
-                        logs.Lines.emplace_back(std::string(), extraData, std::vector<LogEntryColumn>(), columnData);
                     }
-                    else if (testRunChild.Name == "Results")
+
+                    EnterElement(reader, path, false);
+                }
+                else if (depth == 3)
+                {
+                    if (EnterElement(reader, path, name == "UnitTestResult"))
                     {
-                        for (const XmlLexicon::Node &resultsChild : testRunChild.Children)
+                        extraData.clear();
+                        columnData.clear();
+                        output.clear();
+                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_ITEMTYPE, "TestResult");
+                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTRUNID, runId);
+
+                        const std::string_view *startTime = reader.FindAttribute("startTime");
+                        if (startTime)
+                            AddColumnExtraData(columnData, extraData, COLUMNINDEX_DATE, *startTime);
+
+                        const std::string_view *outcome = reader.FindAttribute("outcome");
+                        if (outcome)
+                            AddColumnExtraData(columnData, extraData, COLUMNINDEX_OUTCOME, *outcome);
+
+                        const std::string_view *duration = reader.FindAttribute("duration");
+                        if (duration)
+                            AddColumnExtraData(columnData, extraData, COLUMNINDEX_DURATION, *duration);
+
+                        const std::string_view *testId = reader.FindAttribute("testId");
+                        if (testId)
                         {
-                            if (resultsChild.Name == "UnitTestResult")
+                            auto testDefIter = run->IdToTestDefinition.find(StringToLower(std::string(*testId)));
+                            if (testDefIter != run->IdToTestDefinition.end())
                             {
-                                std::string extraData;
-                                std::vector<LogEntryColumn> columnData;
-                                AddColumnExtraData(columnData, extraData, COLUMNINDEX_ITEMTYPE, "TestResult");
-                                AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTRUNID, runId);
-
-                                const std::string *startTime = resultsChild.FindProperty("startTime");
-                                if (startTime)
-                                    AddColumnExtraData(columnData, extraData, COLUMNINDEX_DATE, *startTime);
-
-                                const std::string *outcome = resultsChild.FindProperty("outcome");
-                                if (outcome)
-                                    AddColumnExtraData(columnData, extraData, COLUMNINDEX_OUTCOME, *outcome);
-
-                                const std::string *duration = resultsChild.FindProperty("duration");
-                                if (duration)
-                                    AddColumnExtraData(columnData, extraData, COLUMNINDEX_DURATION, *duration);
-
-                                const std::string *testId = resultsChild.FindProperty("testId");
-                                if (testId)
-                                {
-                                    auto testDefIter = idToTestDefinition.find(StringToLower(*testId));
-                                    if (testDefIter != idToTestDefinition.end())
-                                    {
-                                        const TestDefinition &testDef = testDefIter->second;
-                                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTASSEMBLY, testDef.AssemblyName);
-                                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTNAME, testDef.TestName);
-                                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_CLASSNAME, testDef.ClassName);
-                                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_DESCRIPTION, testDef.Description);
-                                        AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTCATEGORY, testDef.Category);
-                                    }
-                                }
-                                else
-                                    AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTNAME, "TestIdNotFound??");
-
-                                std::string output;
-                                for (const XmlLexicon::Node &unitTestResultChild : resultsChild.Children)
-                                {
-                                    if (unitTestResultChild.Name == "Output")
-                                        WalkAllChildOutput(output, unitTestResultChild);
-                                }
-
-                                AddColumnExtraData(columnData, extraData, COLUMNINDEX_OUTPUT, output);
-
-                                logs.Lines.emplace_back(std::string(), extraData, std::vector<LogEntryColumn>(), columnData);
+                                const TestDefinition &testDef = testDefIter->second;
+                                AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTASSEMBLY, testDef.AssemblyName);
+                                AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTNAME, testDef.TestName);
+                                AddColumnExtraData(columnData, extraData, COLUMNINDEX_CLASSNAME, testDef.ClassName);
+                                AddColumnExtraData(columnData, extraData, COLUMNINDEX_DESCRIPTION, testDef.Description);
+                                AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTCATEGORY, testDef.Category);
                             }
                         }
+                        else
+                            AddColumnExtraData(columnData, extraData, COLUMNINDEX_TESTNAME, "TestIdNotFound??");
                     }
                 }
+                else if (depth == 4)
+                    EnterElement(reader, path, name == "Output");
+                else
+                    EnterElement(reader, path, true); //everything under Output
+            }
+            else if (reader.Type() == XmlLexicon::PullReader::EventType::EndElement && !path.empty())
+            {
+                OpenElement closed = path.back();
+
+                //leaves under Output hold the actual output, labelled with their path below Output
+                if (path.size() >= 4 && !closed.HasChildren)
+                    AppendOutputValue(output, path, 4, reader.InnerTextWithoutCData());
+
+                path.pop_back();
+
+                if ((path.size() == 1 && closed.Name == "ResultSummary") || (path.size() == 2 && closed.Name == "UnitTestResult"))
+                {
+                    AddColumnExtraData(columnData, extraData, COLUMNINDEX_OUTPUT, output);
+                    logs.Lines.emplace_back(std::string(), extraData, std::vector<LogEntryColumn>(), columnData);
+
+                    monitor.AddProgress(reader.Position() - reportedPos);
+                    reportedPos = reader.Position();
+                }
             }
         }
 
@@ -0,0 +1,122 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "ThreadPool.h"
+#include "WorkStealingScheduler.h"
+#include <algorithm>
+
+ThreadPool& ThreadPool::Instance()
+{
+    //never destroyed, since the workers just end along with the process
+    static ThreadPool *pool = []()
+    {
+        ThreadPool *p = new ThreadPool();
+        p->EnsureThreads((size_t)std::max({ cpuCountGeneral, cpuCountParse, cpuCountSort, cpuCountFilter }) - 1);
+        return p;
+    }();
+
+    return *pool;
+}
+
+void ThreadPool::EnsureThreads(size_t count)
+{
+    std::lock_guard<std::mutex> guard(mut);
+    while (threads.size() < count)
+        threads.emplace_back([this]() { WorkerLoop(); });
+}
+
+void ThreadPool::RunClaimedWorkers(Job &job)
+{
+    for (size_t workerIndex = job.NextWorker.fetch_add(1); workerIndex < job.WorkerCount; workerIndex = job.NextWorker.fetch_add(1))
+    {
+        (*job.Body)(workerIndex);
+
+        if (job.Unfinished.fetch_sub(1) == 1)
+        {
+            std::lock_guard<std::mutex> guard(job.DoneMutex);
+            job.Done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(mut);
+    while (true)
+    {
+        //drop jobs that have nothing left to hand out, and help with the oldest one that does
+        std::shared_ptr<Job> job;
+        while (!jobs.empty() && !job)
+        {
+            if (jobs.front()->NextWorker.load() >= jobs.front()->WorkerCount)
+                jobs.pop_front();
+            else
+                job = jobs.front();
+        }
+
+        if (!job)
+        {
+            wake.wait(lock);
+            continue;
+        }
+
+        lock.unlock();
+        RunClaimedWorkers(*job);
+        lock.lock();
+    }
+}
+
+void ThreadPool::Run(size_t workerCount, const std::function<void(size_t workerIndex)> &body)
+{
+    if (workerCount == 0)
+        return;
+
+    if (workerCount == 1)
+    {
+        body(0);
+        return;
+    }
+
+    EnsureThreads(workerCount - 1);
+
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->Body = &body;
+    job->WorkerCount = workerCount;
+    job->Unfinished = workerCount;
+
+    {
+        std::lock_guard<std::mutex> guard(mut);
+        jobs.push_back(job);
+    }
+    wake.notify_all();
+
+    RunClaimedWorkers(*job);
+
+    {
+        std::lock_guard<std::mutex> guard(mut);
+        auto found = std::find(jobs.begin(), jobs.end(), job);
+        if (found != jobs.end())
+            jobs.erase(found);
+    }
+
+    std::unique_lock<std::mutex> doneLock(job->DoneMutex);
+    job->Done.wait(doneLock, [&]() { return job->Unfinished.load() == 0; });
+}
+
+bool ParallelFor(AppStatusMonitor &monitor, size_t workerCount, size_t begin, size_t end, size_t batchSize, const std::function<void(size_t workerIndex, size_t batchBegin, size_t batchEnd)> &body)
+{
+    batchSize = std::max<size_t>(batchSize, 1);
+    size_t batchCount = (std::max(begin, end) - begin + batchSize - 1) / batchSize;
+    workerCount = std::clamp<size_t>(workerCount, 1, std::max<size_t>(batchCount, 1));
+
+    WorkStealingScheduler scheduler { begin, end, workerCount, batchSize };
+    ThreadPool::Instance().Run(workerCount, [&](size_t workerIndex)
+    {
+        size_t batchBegin = 0;
+        size_t batchEnd = 0;
+        while (!monitor.IsCancelling() && scheduler.NextBatch(workerIndex, batchBegin, batchEnd))
+            body(workerIndex, batchBegin, batchEnd);
+    });
+
+    return !monitor.IsCancelling();
+}
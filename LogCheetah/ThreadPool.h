@@ -0,0 +1,74 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SharedGlobals.h"
+
+//Worker threads that live for the whole process, so short parallel operations (like a search on every keypress) don't pay to start threads with cold caches
+//every time.  The thread that starts a job always works on it too, which means a job started from inside another job finishes even if every worker is busy.
+class ThreadPool
+{
+public:
+    //the pool shared by everything.  it starts with enough threads for the largest cpuCount setting, and grows if a job asks for more.
+    static ThreadPool& Instance();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    //calls body once for each worker index from 0 to workerCount - 1, spread across the pool and the calling thread, and returns once they've all finished.
+    //when the pool is busy one thread may run several indexes in turn, so bodies must never wait on each other.
+    void Run(size_t workerCount, const std::function<void(size_t workerIndex)> &body);
+
+private:
+    struct Job
+    {
+        const std::function<void(size_t)> *Body = nullptr;
+        size_t WorkerCount = 0;
+        std::atomic<size_t> NextWorker = 0;
+        std::atomic<size_t> Unfinished = 0;
+        std::mutex DoneMutex;
+        std::condition_variable Done;
+    };
+
+    ThreadPool() = default;
+
+    void EnsureThreads(size_t count);
+    void WorkerLoop();
+    static void RunClaimedWorkers(Job &job);
+
+    std::mutex mut;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Job>> jobs; //jobs that may still have worker indexes left to claim
+    std::vector<std::thread> threads;
+};
+
+//splits begin to end into batches of batchSize, handed out to up to workerCount workers by a WorkStealingScheduler.  body is called as body(workerIndex, batchBegin, batchEnd).
+//workers stop taking batches once monitor is cancelling.  returns false if cancelled.
+bool ParallelFor(AppStatusMonitor &monitor, size_t workerCount, size_t begin, size_t end, size_t batchSize, const std::function<void(size_t workerIndex, size_t batchBegin, size_t batchEnd)> &body);
+
+//like ParallelFor, but each worker folds its batches into its own value with reduceBatch(value, batchBegin, batchEnd), starting from identity.  the worker values are then
+//folded together with combine(a, b), in worker order.  a worker may get batches in any order, so the reduction must not depend on it.
+template <typename T, typename ReduceBatch, typename Combine>
+T ParallelReduce(AppStatusMonitor &monitor, size_t workerCount, size_t begin, size_t end, size_t batchSize, const T &identity, ReduceBatch &&reduceBatch, Combine &&combine)
+{
+    std::vector<T> partials(std::max<size_t>(workerCount, 1), identity);
+    ParallelFor(monitor, partials.size(), begin, end, batchSize, [&](size_t workerIndex, size_t batchBegin, size_t batchEnd)
+    {
+        partials[workerIndex] = reduceBatch(std::move(partials[workerIndex]), batchBegin, batchEnd);
+    });
+
+    T result = std::move(partials[0]);
+    for (size_t i = 1; i < partials.size(); ++i)
+        result = combine(std::move(result), std::move(partials[i]));
+    return result;
+}
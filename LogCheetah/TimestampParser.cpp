@@ -0,0 +1,275 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "TimestampParser.h"
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    //reads between minDigits and maxDigits decimal digits
+    inline bool ReadDigits(const char *&cur, const char *end, int minDigits, int maxDigits, int &out)
+    {
+        int value = 0;
+        int count = 0;
+        while (cur != end && count < maxDigits && (unsigned char)(*cur - '0') < 10)
+        {
+            value = value * 10 + (*cur - '0');
+            ++cur;
+            ++count;
+        }
+
+        out = value;
+        return count >= minDigits;
+    }
+
+    inline bool ReadChar(const char *&cur, const char *end, char c)
+    {
+        if (cur == end || *cur != c)
+            return false;
+
+        ++cur;
+        return true;
+    }
+
+    //reads the digits of a fraction of a second, keeping 100ns precision and dropping the rest
+    inline int32_t ReadFractionTicks(const char *&cur, const char *end)
+    {
+        int32_t ticks = 0;
+        int digits = 0;
+        while (cur != end && (unsigned char)(*cur - '0') < 10)
+        {
+            if (digits < 7)
+            {
+                ticks = ticks * 10 + (*cur - '0');
+                ++digits;
+            }
+            ++cur;
+        }
+
+        for (; digits < 7; ++digits)
+            ticks *= 10;
+
+        return ticks;
+    }
+
+    inline bool IsLeapYear(int year)
+    {
+        return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    }
+
+    inline bool AreComponentsValid(const Timestamp::Components &c)
+    {
+        static const int daysInMonth[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+        if (c.Month < 1 || c.Month > 12 || c.Day < 1)
+            return false;
+        if (c.Day > daysInMonth[c.Month - 1] + (c.Month == 2 && IsLeapYear(c.Year) ? 1 : 0))
+            return false;
+
+        return c.Hour < 24 && c.Minute < 60 && c.Second <= 60; //allow leap seconds, they roll into the next minute
+    }
+
+    //reads the time portion shared by both formats: h:m:s with an optional fraction
+    inline bool ReadTimeOfDay(const char *&cur, const char *end, Timestamp::Components &out)
+    {
+        if (!ReadDigits(cur, end, 1, 2, out.Hour) || !ReadChar(cur, end, ':'))
+            return false;
+        if (!ReadDigits(cur, end, 1, 2, out.Minute) || !ReadChar(cur, end, ':'))
+            return false;
+        if (!ReadDigits(cur, end, 1, 2, out.Second))
+            return false;
+
+        out.SubsecondTicks = 0;
+        if (cur != end && (*cur == '.' || *cur == ','))
+        {
+            ++cur;
+            out.SubsecondTicks = ReadFractionTicks(cur, end);
+        }
+
+        return true;
+    }
+
+    inline const char* SkipLeadingWhitespace(const char *cur, const char *end)
+    {
+        while (cur != end && (*cur == ' ' || *cur == '\t'))
+            ++cur;
+        return cur;
+    }
+}
+
+namespace Timestamp
+{
+    bool ParseIso8601(std::string_view text, Components &out)
+    {
+        const char *end = text.data() + text.size();
+        const char *cur = SkipLeadingWhitespace(text.data(), end);
+
+        if (!ReadDigits(cur, end, 1, 4, out.Year) || !ReadChar(cur, end, '-'))
+            return false;
+        if (!ReadDigits(cur, end, 1, 2, out.Month) || !ReadChar(cur, end, '-'))
+            return false;
+        if (!ReadDigits(cur, end, 1, 2, out.Day))
+            return false;
+        if (!ReadChar(cur, end, 'T') && !ReadChar(cur, end, ' '))
+            return false;
+        if (!ReadTimeOfDay(cur, end, out))
+            return false;
+
+        //zone, anything unrecognized after the time is ignored and treated as UTC
+        out.UtcOffsetMinutes = 0;
+        if (cur != end && (*cur == '+' || *cur == '-'))
+        {
+            int sign = *cur == '-' ? -1 : 1;
+            ++cur;
+
+            int offsetHours = 0;
+            int offsetMinutes = 0;
+            if (ReadDigits(cur, end, 2, 2, offsetHours))
+            {
+                ReadChar(cur, end, ':');
+                ReadDigits(cur, end, 2, 2, offsetMinutes);
+                out.UtcOffsetMinutes = sign * (offsetHours * 60 + offsetMinutes);
+            }
+        }
+
+        return AreComponentsValid(out);
+    }
+
+    bool ParseUsDateTime(std::string_view text, Components &out)
+    {
+        const char *end = text.data() + text.size();
+        const char *cur = SkipLeadingWhitespace(text.data(), end);
+
+        if (!ReadDigits(cur, end, 1, 2, out.Month) || !ReadChar(cur, end, '/'))
+            return false;
+        if (!ReadDigits(cur, end, 1, 2, out.Day) || !ReadChar(cur, end, '/'))
+            return false;
+        if (!ReadDigits(cur, end, 1, 4, out.Year) || !ReadChar(cur, end, ' '))
+            return false;
+        if (!ReadTimeOfDay(cur, end, out))
+            return false;
+
+        out.UtcOffsetMinutes = 0;
+        return AreComponentsValid(out);
+    }
+
+    int64_t DaysFromCivil(int year, int month, int day)
+    {
+        //shift the year to start in march so the leap day is at the end
+        int64_t y = (int64_t)year - (month <= 2 ? 1 : 0);
+        int64_t era = (y >= 0 ? y : y - 399) / 400;
+        int64_t yearOfEra = y - era * 400;
+        int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + dayOfEra - 719468;
+    }
+
+    int64_t ToUnixTicks(const Components &c)
+    {
+        int64_t seconds = DaysFromCivil(c.Year, c.Month, c.Day) * 86400 + c.Hour * 3600 + c.Minute * 60 + c.Second - c.UtcOffsetMinutes * 60;
+        return seconds * TicksPerSecond + c.SubsecondTicks;
+    }
+
+    bool VerifyParsers(AppStatusMonitor &monitor)
+    {
+        struct KnownAnswer
+        {
+            bool Iso;
+            const char *Text;
+            bool Valid;
+            int64_t Ticks;
+        };
+
+        static const KnownAnswer knownAnswers[] =
+        {
+            { true, "1970-01-01T00:00:00Z", true, 0 },
+            { true, "2016-02-25T20:08:38.6443339Z", true, 14564309186443339 },
+            { true, "2016-02-29T23:59:59.99999999Z", true, 14567903999999999 }, //leap year, extra fraction digits dropped
+            { true, "2000-02-29T12:00:00Z", true, 9518256000000000 }, //divisible by 400 is a leap year
+            { true, "1900-02-29T00:00:00Z", false, 0 }, //divisible by 100 is not
+            { true, "2023-02-29T00:00:00Z", false, 0 },
+            { true, "2024-12-31T23:59:59.5Z", true, 17356895995000000 },
+            { true, "2016-07-27T22:56:47.0107862+01:00", true, 14696566070107862 },
+            { true, "2016-07-27 22:56:47.01Z", true, 14696602070100000 },
+            { true, "1969-12-31T23:59:59.9Z", true, -1000000 },
+            { true, "2038-01-19T03:14:08Z", true, 21474836480000000 }, //past 32-bit time_t
+            { true, "2016-13-01T00:00:00Z", false, 0 },
+            { true, "2016-02-25", false, 0 },
+            { false, "1/1/1970 0:00:00", true, 0 },
+            { false, "2/29/2016 23:59:59.999", true, 14567903999990000 },
+            { false, "12/31/1999 23:59:59.5", true, 9466847995000000 },
+            { false, "2/29/2100 00:00:00", false, 0 },
+            { false, "3/1/2100 00:00:00", true, 41075424000000000 },
+            { false, "3/1/2100", false, 0 },
+        };
+
+        bool allPassed = true;
+        for (const KnownAnswer &ka : knownAnswers)
+        {
+            Components c;
+            bool valid = ka.Iso ? ParseIso8601(ka.Text, c) : ParseUsDateTime(ka.Text, c);
+            if (valid != ka.Valid || (valid && ToUnixTicks(c) != ka.Ticks))
+            {
+                monitor.AddDebugOutput(std::string("Timestamp parser mismatch: ") + ka.Text + " got " + (valid ? std::to_string(ToUnixTicks(c)) : std::string("invalid")));
+                allPassed = false;
+            }
+        }
+
+        return allPassed;
+    }
+
+    void BenchmarkParsers(AppStatusMonitor &monitor)
+    {
+        int iters = 200000;
+#ifdef _DEBUG
+        iters = 10000;
+#endif
+
+        std::vector<std::string> isoSamples;
+        std::vector<std::string> usSamples;
+        for (int i = 0; i < 1000; ++i)
+        {
+            int day = 1 + i % 28;
+            int second = i % 60;
+            isoSamples.emplace_back("2016-02-" + std::to_string(10 + day % 18) + "T20:08:" + std::to_string(10 + second % 50) + ".6443339Z");
+            usSamples.emplace_back("2/" + std::to_string(day) + "/2016 20:08:" + std::to_string(10 + second % 50) + ".644");
+        }
+
+        int64_t checksum = 0;
+        auto tpBegin = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            Components c;
+            if (ParseIso8601(isoSamples[i % isoSamples.size()], c))
+                checksum += ToUnixMilliseconds(c);
+        }
+        auto tpIso = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            Components c;
+            if (ParseUsDateTime(usSamples[i % usSamples.size()], c))
+                checksum += ToUnixMilliseconds(c);
+        }
+        auto tpUs = std::chrono::high_resolution_clock::now();
+
+        //the standard library is much slower, so give it fewer iterations
+        int stdIters = iters / 10;
+        for (int i = 0; i < stdIters; ++i)
+        {
+            std::istringstream stream(isoSamples[i % isoSamples.size()]);
+            std::chrono::sys_time<std::chrono::milliseconds> tp;
+            std::chrono::from_stream(stream, "%Y-%m-%dT%H:%M:%S", tp);
+            checksum += tp.time_since_epoch().count();
+        }
+        auto tpStd = std::chrono::high_resolution_clock::now();
+
+        auto nsPerParse = [](auto begin, auto end, int count) { return std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / (double)count; };
+
+        std::stringstream ss;
+        ss << "Timestamp parsing: ISO-8601 " << nsPerParse(tpBegin, tpIso, iters) << "ns, US " << nsPerParse(tpIso, tpUs, iters) << "ns, std::chrono::from_stream " << nsPerParse(tpUs, tpStd, stdIters) << "ns per timestamp (checksum " << checksum << ")";
+        monitor.AddDebugOutput(ss.str());
+    }
+}
@@ -0,0 +1,48 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <string_view>
+#include <cstdint>
+#include "SharedGlobals.h"
+
+//Parsing for the fixed-layout timestamps found in logs.  Nothing here allocates or calls into the C runtime, so it's cheap enough to run on every line.
+namespace Timestamp
+{
+    const int64_t TicksPerMillisecond = 10000; //ticks are 100ns
+    const int64_t TicksPerSecond = 1000 * TicksPerMillisecond;
+
+    //a broken down UTC time
+    struct Components
+    {
+        int Year = 0;
+        int Month = 0;
+        int Day = 0;
+        int Hour = 0;
+        int Minute = 0;
+        int Second = 0;
+        int32_t SubsecondTicks = 0;
+        int32_t UtcOffsetMinutes = 0;
+    };
+
+    //ISO-8601 style, such as "2016-02-25T20:08:38.6443339Z".  the date and time may be separated by 'T' or ' ', the fraction is optional, and the zone may be 'Z', missing, or an offset like "+01:00".
+    bool ParseIso8601(std::string_view text, Components &out);
+
+    //US style, such as "2/25/2016 20:08:38.644".  the fraction is optional.
+    bool ParseUsDateTime(std::string_view text, Components &out);
+
+    //days since 1970-01-01 for a date in the proleptic gregorian calendar
+    int64_t DaysFromCivil(int year, int month, int day);
+
+    //conversions to time since 1970-01-01 UTC
+    int64_t ToUnixTicks(const Components &c);
+    inline int64_t ToUnixMilliseconds(const Components &c) { int64_t t = ToUnixTicks(c); return (t >= 0 ? t : t - TicksPerMillisecond + 1) / TicksPerMillisecond; }
+    inline int64_t ToUnixSeconds(const Components &c) { int64_t t = ToUnixTicks(c); return (t >= 0 ? t : t - TicksPerSecond + 1) / TicksPerSecond; }
+
+    //checks the parsers against a table of known answers (including leap years and sub-second precision), reporting any mismatches.  returns true if everything matched.
+    bool VerifyParsers(AppStatusMonitor &monitor);
+
+    //times the parsers against the standard library and reports the results
+    void BenchmarkParsers(AppStatusMonitor &monitor);
+}
@@ -0,0 +1,357 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "TrigramIndex.h"
+#include "CaseInsensitiveSearch.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <cctype>
+
+namespace
+{
+    //intersecting more than this many posting lists rarely removes anything the rarest ones didn't already
+    const size_t MaxTrigramsPerLookup = 6;
+
+    inline uint8_t FoldCase(char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? (uint8_t)(c - 'A' + 'a') : (uint8_t)c;
+    }
+
+    void AppendTrigrams(const char *begin, const char *end, std::vector<uint32_t> &trigrams)
+    {
+        if (end - begin < 3)
+            return;
+
+        uint32_t key = ((uint32_t)FoldCase(begin[0]) << 8) | FoldCase(begin[1]);
+        for (const char *c = begin + 2; c != end; ++c)
+        {
+            key = ((key << 8) | FoldCase(*c)) & 0xffffff;
+            trigrams.push_back(key);
+        }
+    }
+
+    inline void AppendVarint(std::vector<uint8_t> &bytes, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            bytes.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+
+        bytes.push_back((uint8_t)value);
+    }
+
+    //postings for one trigram while a segment is being built
+    struct PostingBuilder
+    {
+        uint32_t Trigram;
+        uint32_t LastBlock = 0;
+        std::vector<uint8_t> Bytes;
+    };
+
+    //open addressed map from trigram to its builder, since there's a lookup for every distinct trigram of every block
+    class PostingBuilderMap
+    {
+    public:
+        PostingBuilderMap() : slots(1024, Empty)
+        {
+        }
+
+        PostingBuilder& operator[](uint32_t trigram)
+        {
+            size_t mask = slots.size() - 1;
+            for (size_t probe = (trigram * 2654435761u) & mask; ; probe = (probe + 1) & mask)
+            {
+                if (slots[probe] == Empty)
+                {
+                    slots[probe] = (uint32_t)builders.size();
+                    builders.emplace_back().Trigram = trigram;
+                    if (builders.size() * 2 > slots.size())
+                        Grow();
+                    return builders.back();
+                }
+
+                if (builders[slots[probe]].Trigram == trigram)
+                    return builders[slots[probe]];
+            }
+        }
+
+        std::vector<PostingBuilder>& Builders() { return builders; }
+
+    private:
+        static const uint32_t Empty = 0xffffffff;
+
+        void Grow()
+        {
+            slots.assign(slots.size() * 2, Empty);
+            size_t mask = slots.size() - 1;
+            for (uint32_t i = 0; i < (uint32_t)builders.size(); ++i)
+            {
+                size_t probe = (builders[i].Trigram * 2654435761u) & mask;
+                while (slots[probe] != Empty)
+                    probe = (probe + 1) & mask;
+                slots[probe] = i;
+            }
+        }
+
+        std::vector<uint32_t> slots;
+        std::vector<PostingBuilder> builders;
+    };
+
+    //text with lots of repeated trigrams, with mixed case and bytes outside ascii
+    std::string MakeSampleText(uint32_t &seed, size_t length)
+    {
+        static const char alphabet[] = "abcABCxyz09 :\"{}\xc3\xa9";
+        std::string text;
+        text.reserve(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            text.push_back(alphabet[(seed >> 16) % (sizeof(alphabet) - 1)]);
+        }
+
+        return text;
+    }
+}
+
+std::shared_ptr<const TrigramIndex> TrigramIndex::Build(AppStatusMonitor &monitor, const LogCollection &logs)
+{
+    auto tpBegin = std::chrono::high_resolution_clock::now();
+
+    monitor.SetControlFeatures(true);
+    monitor.SetProgressFeatures(logs.Lines.size(), "kiloline", 1000);
+
+    std::shared_ptr<TrigramIndex> index = std::make_shared<TrigramIndex>();
+    index->rowCount = logs.Lines.size();
+
+    //a couple of segments per thread evens out rows of different lengths, without each segment repeating too much of the trigram list
+    size_t blockCount = index->BlockCount();
+    size_t segmentCount = std::min<size_t>(blockCount, (size_t)cpuCountFilter * 2);
+    index->segments.resize(segmentCount);
+
+    ParallelFor(monitor, cpuCountFilter, 0, segmentCount, 1, [&](size_t threadIndex, size_t s, size_t sEnd)
+    {
+        BuildSegment(monitor, logs.Lines, blockCount * s / segmentCount, blockCount * (s + 1) / segmentCount, index->segments[s]);
+    });
+
+    if (monitor.IsCancelling())
+        return nullptr;
+
+    auto tpEnd = std::chrono::high_resolution_clock::now();
+    monitor.AddDebugOutputTime("TrigramIndex::Build", std::chrono::duration_cast<std::chrono::microseconds>(tpEnd - tpBegin).count() / 1000.0);
+    monitor.AddDebugOutput("Search index uses " + std::to_string(index->MemoryUsed() / 1024 / 1024) + "MB for " + std::to_string(index->rowCount) + " rows");
+
+    return index;
+}
+
+void TrigramIndex::BuildSegment(AppStatusMonitor &monitor, const std::vector<LogEntry> &rows, size_t blockBegin, size_t blockEnd, Segment &segment)
+{
+    PostingBuilderMap builders;
+    std::vector<uint32_t> blockTrigrams;
+    std::vector<uint32_t> distinctTrigrams;
+    std::vector<uint64_t> seen(((size_t)1 << 24) / 64); //a bit per trigram, cleared again after each block
+
+    for (size_t block = blockBegin; block < blockEnd && !monitor.IsCancelling(); ++block)
+    {
+        size_t rowBegin = block * RowsPerBlock;
+        size_t rowEnd = std::min(rowBegin + RowsPerBlock, rows.size());
+
+        //the original log and extra data are indexed separately, since text can't match across the two
+        blockTrigrams.clear();
+        for (size_t row = rowBegin; row < rowEnd; ++row)
+        {
+            const LogEntry &le = rows[row];
+            AppendTrigrams(le.OriginalLogBegin(), le.OriginalLogEnd(), blockTrigrams);
+            AppendTrigrams(le.ExtraDataBegin(), le.ExtraDataEnd(), blockTrigrams);
+        }
+
+        distinctTrigrams.clear();
+        for (uint32_t trigram : blockTrigrams)
+        {
+            uint64_t bit = (uint64_t)1 << (trigram & 63);
+            if (!(seen[trigram >> 6] & bit))
+            {
+                seen[trigram >> 6] |= bit;
+                distinctTrigrams.push_back(trigram);
+            }
+        }
+
+        for (uint32_t trigram : distinctTrigrams)
+        {
+            seen[trigram >> 6] = 0;
+            PostingBuilder &pb = builders[trigram];
+            AppendVarint(pb.Bytes, (uint32_t)block - pb.LastBlock);
+            pb.LastBlock = (uint32_t)block;
+        }
+
+        monitor.AddProgress(rowEnd - rowBegin);
+    }
+
+    //flatten into one sorted list
+    std::vector<PostingBuilder> &sorted = builders.Builders();
+    std::sort(sorted.begin(), sorted.end(), [](const PostingBuilder &a, const PostingBuilder &b) { return a.Trigram < b.Trigram; });
+
+    size_t totalBytes = 0;
+    for (auto &pb : sorted)
+        totalBytes += pb.Bytes.size();
+
+    segment.Trigrams.reserve(sorted.size());
+    segment.Offsets.reserve(sorted.size() + 1);
+    segment.Postings.reserve(totalBytes);
+    for (auto &pb : sorted)
+    {
+        segment.Trigrams.push_back(pb.Trigram);
+        segment.Offsets.push_back(segment.Postings.size());
+        segment.Postings.insert(segment.Postings.end(), pb.Bytes.begin(), pb.Bytes.end());
+    }
+
+    segment.Offsets.push_back(segment.Postings.size());
+}
+
+void TrigramIndex::DecodePostings(uint32_t trigram, std::vector<uint32_t> &outBlocks) const
+{
+    outBlocks.clear();
+
+    //segments cover ascending runs of blocks, so appending them in order keeps the result sorted
+    for (const Segment &segment : segments)
+    {
+        auto found = std::lower_bound(segment.Trigrams.begin(), segment.Trigrams.end(), trigram);
+        if (found == segment.Trigrams.end() || *found != trigram)
+            continue;
+
+        size_t i = found - segment.Trigrams.begin();
+        const uint8_t *cur = segment.Postings.data() + segment.Offsets[i];
+        const uint8_t *end = segment.Postings.data() + segment.Offsets[i + 1];
+
+        uint32_t block = 0;
+        while (cur != end)
+        {
+            uint32_t gap = 0;
+            for (int shift = 0; ; shift += 7)
+            {
+                uint8_t b = *cur++;
+                gap |= (uint32_t)(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    break;
+            }
+
+            block += gap;
+            outBlocks.push_back(block);
+        }
+    }
+}
+
+size_t TrigramIndex::EstimatePostingSize(uint32_t trigram) const
+{
+    size_t bytes = 0;
+    for (const Segment &segment : segments)
+    {
+        auto found = std::lower_bound(segment.Trigrams.begin(), segment.Trigrams.end(), trigram);
+        if (found != segment.Trigrams.end() && *found == trigram)
+        {
+            size_t i = found - segment.Trigrams.begin();
+            bytes += segment.Offsets[i + 1] - segment.Offsets[i];
+        }
+    }
+
+    return bytes;
+}
+
+bool TrigramIndex::FindCandidateBlocks(std::string_view text, std::vector<uint32_t> &outBlocks) const
+{
+    outBlocks.clear();
+    if (text.size() < 3)
+        return false;
+
+    std::vector<uint32_t> trigrams;
+    AppendTrigrams(text.data(), text.data() + text.size(), trigrams);
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    //start from the rarest, since the intersection only gets smaller
+    std::vector<std::pair<size_t, uint32_t>> bySize;
+    for (uint32_t t : trigrams)
+        bySize.emplace_back(EstimatePostingSize(t), t);
+    std::sort(bySize.begin(), bySize.end());
+    if (bySize.size() > MaxTrigramsPerLookup)
+        bySize.resize(MaxTrigramsPerLookup);
+
+    DecodePostings(bySize[0].second, outBlocks);
+
+    std::vector<uint32_t> next;
+    std::vector<uint32_t> intersection;
+    for (size_t i = 1; i < bySize.size() && !outBlocks.empty(); ++i)
+    {
+        DecodePostings(bySize[i].second, next);
+        intersection.clear();
+        std::set_intersection(outBlocks.begin(), outBlocks.end(), next.begin(), next.end(), std::back_inserter(intersection));
+        outBlocks.swap(intersection);
+    }
+
+    return true;
+}
+
+size_t TrigramIndex::MemoryUsed() const
+{
+    size_t bytes = sizeof(*this);
+    for (const Segment &segment : segments)
+        bytes += segment.Trigrams.capacity() * sizeof(uint32_t) + segment.Offsets.capacity() * sizeof(size_t) + segment.Postings.capacity();
+
+    return bytes;
+}
+
+bool TrigramIndex::VerifyIndex(AppStatusMonitor &monitor)
+{
+    uint32_t seed = 3;
+    LogCollection logs;
+    for (int i = 0; i < 2000; ++i)
+        logs.Lines.emplace_back(MakeSampleText(seed, seed % 100), MakeSampleText(seed, seed % 3 == 0 ? seed % 20 : 0), std::vector<LogEntryColumn>(), std::vector<LogEntryColumn>());
+
+    std::shared_ptr<const TrigramIndex> index = Build(AppStatusMonitor::Instance, logs);
+
+    bool allPassed = true;
+    std::vector<uint32_t> candidates;
+    for (int i = 0; i < 300 && allPassed; ++i)
+    {
+        //mostly take needles from the rows so there are matches to find, then change their case
+        std::string needle;
+        const LogEntry &source = logs.Lines[seed % logs.Lines.size()];
+        size_t sourceLength = source.OriginalLogEnd() - source.OriginalLogBegin();
+        if (sourceLength > 0 && seed % 4 != 0)
+        {
+            size_t start = (seed >> 8) % sourceLength;
+            needle.assign(source.OriginalLogBegin() + start, std::min<size_t>(3 + (seed >> 4) % 8, sourceLength - start));
+            for (char &c : needle)
+            {
+                seed = seed * 1103515245 + 12345;
+                if ((seed >> 16) & 1)
+                    c = (char)std::toupper((unsigned char)c);
+            }
+        }
+        else
+            needle = MakeSampleText(seed, 3 + seed % 4);
+
+        if (!index->FindCandidateBlocks(needle, candidates))
+        {
+            allPassed = needle.size() < 3;
+            continue;
+        }
+
+        for (size_t row = 0; row < logs.Lines.size() && allPassed; ++row)
+        {
+            const LogEntry &le = logs.Lines[row];
+            bool contains = CaseInsensitiveSearch::Find(std::string_view(le.OriginalLogBegin(), le.OriginalLogEnd() - le.OriginalLogBegin()), needle) != std::string_view::npos
+                || CaseInsensitiveSearch::Find(std::string_view(le.ExtraDataBegin(), le.ExtraDataEnd() - le.ExtraDataBegin()), needle) != std::string_view::npos;
+
+            if (contains && !std::binary_search(candidates.begin(), candidates.end(), (uint32_t)(row / RowsPerBlock)))
+            {
+                monitor.AddDebugOutput("Search index missed \"" + needle + "\" in row " + std::to_string(row));
+                allPassed = false;
+            }
+        }
+    }
+
+    return allPassed;
+}
@@ -0,0 +1,50 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "LogParserCommon.h"
+
+//An index from every three byte sequence in the raw text of the rows (original log and extra data, with ASCII case folded) to the blocks of rows containing it.
+//Text of three or more bytes can only be in a block that has every one of its trigrams, so intersecting their posting lists narrows a search down to a few
+//blocks that then get checked properly.  Posting lists are the gaps between block numbers, varint encoded.
+class TrigramIndex
+{
+public:
+    static constexpr size_t RowsPerBlock = 128;
+
+    //indexes every row of logs, in parallel.  returns null if cancelled.
+    static std::shared_ptr<const TrigramIndex> Build(AppStatusMonitor &monitor, const LogCollection &logs);
+
+    //the number of rows that were indexed, so an index left over from before rows were added or removed can be spotted
+    inline size_t RowCount() const { return rowCount; }
+    inline size_t BlockCount() const { return (rowCount + RowsPerBlock - 1) / RowsPerBlock; }
+
+    //fills outBlocks with the blocks (in ascending order) that may contain text, ignoring case.  returns false if text is too short to narrow anything down.
+    bool FindCandidateBlocks(std::string_view text, std::vector<uint32_t> &outBlocks) const;
+
+    size_t MemoryUsed() const;
+
+    //checks that the candidates for generated text always include every row a brute force search finds.  returns true if they did.
+    static bool VerifyIndex(AppStatusMonitor &monitor);
+
+private:
+    //the postings for a contiguous run of blocks, built by one thread
+    struct Segment
+    {
+        std::vector<uint32_t> Trigrams; //sorted
+        std::vector<size_t> Offsets; //where each trigram's postings start, plus the end of the last
+        std::vector<uint8_t> Postings;
+    };
+
+    static void BuildSegment(AppStatusMonitor &monitor, const std::vector<LogEntry> &rows, size_t blockBegin, size_t blockEnd, Segment &segment);
+    void DecodePostings(uint32_t trigram, std::vector<uint32_t> &outBlocks) const;
+    size_t EstimatePostingSize(uint32_t trigram) const;
+
+    std::vector<Segment> segments;
+    size_t rowCount = 0;
+};
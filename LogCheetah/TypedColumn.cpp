@@ -0,0 +1,259 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "TypedColumn.h"
+#include "TimestampParser.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    const double MissingValue = std::numeric_limits<double>::quiet_NaN();
+
+    inline std::string_view TrimSpace(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+            text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+            text.remove_suffix(1);
+        return text;
+    }
+
+    //a bit for each of count (up to 64) values that's from lower to upper.  NaN compares false both ways, so missing values never match.
+    inline uint64_t MatchWord(const double *values, size_t count, double lower, double upper)
+    {
+        uint64_t bits = 0;
+        size_t i = 0;
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+        const __m128d lowerBound = _mm_set1_pd(lower);
+        const __m128d upperBound = _mm_set1_pd(upper);
+        for (; i + 2 <= count; i += 2)
+        {
+            __m128d v = _mm_loadu_pd(values + i);
+            __m128d inRange = _mm_and_pd(_mm_cmpge_pd(v, lowerBound), _mm_cmple_pd(v, upperBound));
+            bits |= (uint64_t)_mm_movemask_pd(inRange) << i;
+        }
+#endif
+
+        for (; i < count; ++i)
+            bits |= (uint64_t)(values[i] >= lower && values[i] <= upper) << i;
+
+        return bits;
+    }
+
+    RowBitmap RowsBetween(size_t begin, size_t end)
+    {
+        if (begin >= end)
+            return RowBitmap();
+
+        return RowBitmap::AndNot(RowBitmap::AllRows(end), RowBitmap::AllRows(begin));
+    }
+}
+
+std::shared_ptr<const TypedColumn> TypedColumn::Build(AppStatusMonitor &monitor, const LogCollection &logs, uint16_t column, RangeValueType type)
+{
+    auto tpBegin = std::chrono::high_resolution_clock::now();
+
+    std::shared_ptr<TypedColumn> typed = std::make_shared<TypedColumn>();
+    typed->column = column;
+    typed->type = type;
+    typed->values.resize(logs.Lines.size(), MissingValue);
+
+    //times are stored relative to the first one, so that has to be found before the rest
+    if (type == RangeValueType::Time)
+    {
+        for (const LogEntry &le : logs.Lines)
+        {
+            auto value = le.GetColumnNumberValue(column);
+            if (ParseTime(std::string_view(value.begin(), value.size()), typed->timeBase))
+                break;
+        }
+    }
+
+    ParallelFor(monitor, cpuCountParse, 0, logs.Lines.size(), 4096, [&](size_t threadIndex, size_t batchBegin, size_t batchEnd)
+    {
+        for (size_t row = batchBegin; row < batchEnd; ++row)
+        {
+            auto value = logs.Lines[row].GetColumnNumberValue(column);
+            std::string_view text { value.begin(), value.size() };
+
+            double number = 0;
+            int64_t ticks = 0;
+            if (type == RangeValueType::Number && ParseNumber(text, number))
+                typed->values[row] = number;
+            else if (type == RangeValueType::Time && ParseTime(text, ticks))
+                typed->values[row] = (double)(ticks - typed->timeBase);
+        }
+    });
+
+    if (monitor.IsCancelling())
+        return nullptr;
+
+    typed->FindOrder();
+
+    auto tpEnd = std::chrono::high_resolution_clock::now();
+    monitor.AddDebugOutputTime("TypedColumn::Build", std::chrono::duration_cast<std::chrono::microseconds>(tpEnd - tpBegin).count() / 1000.0);
+
+    return typed;
+}
+
+bool TypedColumn::ParseNumber(std::string_view text, double &out)
+{
+    text = TrimSpace(text);
+    if (text.size() > 1 && text[0] == '+')
+        text.remove_prefix(1);
+    if (text.empty())
+        return false;
+
+    auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+bool TypedColumn::ParseTime(std::string_view text, int64_t &outTicks)
+{
+    text = TrimSpace(text);
+
+    Timestamp::Components components;
+    if (!Timestamp::ParseIso8601(text, components) && !Timestamp::ParseUsDateTime(text, components))
+        return false;
+
+    outTicks = Timestamp::ToUnixTicks(components);
+    return true;
+}
+
+bool TypedColumn::FindRangeType(const LogFilterEntry &filter, RangeValueType &outType)
+{
+    bool hasUpper = (filter.Comparison == FilterComparison::Between);
+
+    double number = 0;
+    if (ParseNumber(filter.Value, number) && (!hasUpper || ParseNumber(filter.UpperValue, number)))
+    {
+        outType = RangeValueType::Number;
+        return true;
+    }
+
+    int64_t ticks = 0;
+    if (ParseTime(filter.Value, ticks) && (!hasUpper || ParseTime(filter.UpperValue, ticks)))
+    {
+        outType = RangeValueType::Time;
+        return true;
+    }
+
+    return false;
+}
+
+double TypedColumn::StoredTime(int64_t ticks) const
+{
+    return (double)(ticks - timeBase);
+}
+
+void TypedColumn::FindOrder()
+{
+    ascending = !values.empty() && !std::isnan(values[0]);
+    descending = ascending;
+    for (size_t row = 1; row < values.size() && (ascending || descending); ++row)
+    {
+        if (std::isnan(values[row]))
+            ascending = descending = false;
+        else if (values[row] < values[row - 1])
+            ascending = false;
+        else if (values[row] > values[row - 1])
+            descending = false;
+    }
+}
+
+RowBitmap TypedColumn::FindRange(double lower, double upper) const
+{
+    if (!(lower <= upper))
+        return RowBitmap();
+
+    if (ascending)
+    {
+        size_t begin = std::lower_bound(values.begin(), values.end(), lower) - values.begin();
+        size_t end = std::upper_bound(values.begin(), values.end(), upper) - values.begin();
+        return RowsBetween(begin, end);
+    }
+    else if (descending)
+    {
+        size_t begin = std::partition_point(values.begin(), values.end(), [upper](double v) { return v > upper; }) - values.begin();
+        size_t end = std::partition_point(values.begin(), values.end(), [lower](double v) { return v >= lower; }) - values.begin();
+        return RowsBetween(begin, end);
+    }
+
+    return ScanRange(lower, upper);
+}
+
+RowBitmap TypedColumn::ScanRange(double lower, double upper) const
+{
+    //batches are whole chunks of the bitmap, so each one's words are appended in order
+    return ParallelReduce(AppStatusMonitor::Instance, cpuCountFilter, 0, values.size(), 65536, RowBitmap(), [&](RowBitmap &&workerRows, size_t batchBegin, size_t batchEnd)
+    {
+        RowBitmap batchRows;
+        for (size_t wordBegin = batchBegin; wordBegin < batchEnd; wordBegin += 64)
+            batchRows.AppendBits((uint32_t)wordBegin, MatchWord(values.data() + wordBegin, std::min<size_t>(64, batchEnd - wordBegin), lower, upper));
+
+        return workerRows.empty() ? std::move(batchRows) : RowBitmap::Or(workerRows, batchRows);
+    }, [](RowBitmap &&a, RowBitmap &&b) { return RowBitmap::Or(a, b); });
+}
+
+bool TypedColumn::VerifyRanges(AppStatusMonitor &monitor)
+{
+    std::mt19937 rng(2016);
+    size_t mismatches = 0;
+    size_t cases = 0;
+
+    for (int shape = 0; shape < 4; ++shape)
+    {
+        //unordered with gaps, ascending, descending, and ascending with a gap that rules out the binary search
+        TypedColumn typed;
+        typed.values.resize(1000 + rng() % 200000);
+        for (double &v : typed.values)
+            v = (shape == 0 && rng() % 10 == 0) ? MissingValue : (double)(rng() % 5000) / 4.0;
+
+        if (shape == 1 || shape == 3)
+            std::sort(typed.values.begin(), typed.values.end());
+        else if (shape == 2)
+            std::sort(typed.values.begin(), typed.values.end(), std::greater<double>());
+        if (shape == 3)
+            typed.values[typed.values.size() / 2] = MissingValue;
+        typed.FindOrder();
+
+        for (int i = 0; i < 50; ++i)
+        {
+            double lower = (double)(rng() % 5200) / 4.0 - 25.0;
+            double upper = lower + (double)(rng() % 2000) / 4.0;
+            if (i == 0)
+                lower = -std::numeric_limits<double>::infinity();
+            else if (i == 1)
+                upper = std::numeric_limits<double>::infinity();
+
+            std::vector<uint32_t> expected;
+            for (size_t row = 0; row < typed.values.size(); ++row)
+            {
+                if (typed.values[row] >= lower && typed.values[row] <= upper)
+                    expected.push_back((uint32_t)row);
+            }
+
+            ++cases;
+            if (typed.FindRange(lower, upper).ToVector() != expected || typed.ScanRange(lower, upper).ToVector() != expected)
+                ++mismatches;
+        }
+    }
+
+    std::stringstream ss;
+    ss << "TypedColumn range verification: " << cases << " cases, " << mismatches << " mismatches";
+    monitor.AddDebugOutput(ss.str());
+
+    return mismatches == 0;
+}
@@ -0,0 +1,52 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include "LogParserCommon.h"
+
+//The values of one column parsed once into numbers or times, so range filters can compare them without going back to the text of every row.  Missing and
+//unparsable values are NaN, which fails every comparison.  Times are kept as ticks from the column's first time, which a double holds exactly for 28 years
+//either side of it.
+class TypedColumn
+{
+public:
+    //parses every row's value of column in parallel.  returns null if cancelled.
+    static std::shared_ptr<const TypedColumn> Build(AppStatusMonitor &monitor, const LogCollection &logs, uint16_t column, RangeValueType type);
+
+    //a whole value (surrounding whitespace aside) as a number, or as an ISO-8601 or US style time in unix ticks
+    static bool ParseNumber(std::string_view text, double &out);
+    static bool ParseTime(std::string_view text, int64_t &outTicks);
+
+    //the type a range filter compares as: numbers if its bounds are all numbers, otherwise times if they're all times.  returns false if they're neither.
+    static bool FindRangeType(const LogFilterEntry &filter, RangeValueType &outType);
+
+    inline uint16_t Column() const { return column; }
+    inline RangeValueType Type() const { return type; }
+    inline size_t RowCount() const { return values.size(); }
+
+    //values as they're stored, which is the form FindRange takes too
+    inline double Value(size_t row) const { return values[row]; }
+    double StoredTime(int64_t ticks) const;
+
+    //the rows with values from lower to upper, inclusive.  when every row has a value and they're in order, this is just a binary search.
+    RowBitmap FindRange(double lower, double upper) const;
+
+    //checks FindRange against a plain loop on generated columns, in and out of order.  returns true if they agreed.
+    static bool VerifyRanges(AppStatusMonitor &monitor);
+
+private:
+    RowBitmap ScanRange(double lower, double upper) const;
+    void FindOrder();
+
+    std::vector<double> values;
+    uint16_t column = 0;
+    RangeValueType type = RangeValueType::Number;
+    int64_t timeBase = 0;
+    bool ascending = false; //every row has a value, and none is less than the one before
+    bool descending = false;
+};
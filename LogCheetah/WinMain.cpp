@@ -25,6 +25,7 @@
 #include "Globals.h"
 #include "MainLogView.h"
 #include "CatWindow.h"
+#include "ThreadPool.h"
 
 #include <chrono>
 #include <vector>
@@ -127,6 +128,13 @@ void MoveAndLoadLogs(LogCollection &&logs, bool merge)
     UpdateTitleText();
 }
 
+//drops the current logs, along with what the parsers learned from them, before loading new ones in their place
+void ClearLogsForNewLoad()
+{
+    MoveAndLoadLogs(LogCollection(), false);
+    JSON::ForgetKnownSchema();
+}
+
 void CopyTextToClipboard(const std::string &text)
 {
     if (!text.empty())
@@ -164,7 +172,7 @@ void PromptAndParseDataFromClipboard()
         merge = MessageBox(hwndMain, "Merge new logs with existing logs?", "", MB_YESNO) == IDYES;
 
     if (!merge)
-        MoveAndLoadLogs(LogCollection(), false); //clear old logs before we start to reduce memory use
+        ClearLogsForNewLoad(); //clear old logs before we start to reduce memory use
 
     std::vector<ObtainerSource> obtainers;
     obtainers.emplace_back();
@@ -249,6 +257,8 @@ void AddDnsLookupColumnForIpColumn(int dataCol)
         if (dataCol < 0 || dataCol >= globalLogs.Columns.size())
             return;
 
+        globalLogs.ExtractDeferredColumns(monitor, std::vector<uint32_t> { (uint32_t)dataCol });
+
         //since this is cancellable (and it's slow so they might actually cancel it), we need to do all of the lookups before we actually touch the original data
         std::vector<std::string*> dnsColText;
         dnsColText.resize(globalLogs.Lines.size(), nullptr);
@@ -257,72 +267,66 @@ void AddDnsLookupColumnForIpColumn(int dataCol)
 
         std::atomic<size_t> sharedRow = 0;
         std::mutex mut;
-        std::vector<std::thread> threads;
 
-        for (int t = 0; t < 10; ++t) //do up to 10 in parallel since they're rather slow to resolve
+        //do up to 10 in parallel since they're rather slow to resolve
+        ThreadPool::Instance().Run(10, [&](size_t threadIndex)
         {
-            threads.emplace_back([&]
+            while (true)
             {
-                while (true)
-                {
-                    size_t index = sharedRow++;
-                    if (index >= globalLogs.Lines.size())
-                        break;
+                size_t index = sharedRow++;
+                if (index >= globalLogs.Lines.size())
+                    break;
 
-                    if (monitor.IsCancelling())
-                        break;
+                if (monitor.IsCancelling())
+                    break;
 
-                    monitor.AddProgress(1);
+                monitor.AddProgress(1);
 
-                    auto &log = globalLogs.Lines[index];
-                    const std::string ipString = log.GetColumnNumberValue((uint16_t)dataCol).str();
-                    if (ipString.empty())
-                        continue;
+                auto &log = globalLogs.Lines[index];
+                const std::string ipString = log.GetColumnNumberValue((uint16_t)dataCol).str();
+                if (ipString.empty())
+                    continue;
 
-                    in_addr ipAddr = { 0 };
-                    unsigned long numericIp = INADDR_NONE;
-                    if (inet_pton(AF_INET, ipString.c_str(), &ipAddr) == 1)
-                        numericIp = ipAddr.S_un.S_addr;
+                in_addr ipAddr = { 0 };
+                unsigned long numericIp = INADDR_NONE;
+                if (inet_pton(AF_INET, ipString.c_str(), &ipAddr) == 1)
+                    numericIp = ipAddr.S_un.S_addr;
 
-                    if (numericIp == INADDR_NONE)
-                        continue;
-
-                    {
-                        std::lock_guard<std::mutex> guard(mut);
-
-                        auto existing = cachedLookups.find(numericIp);
-                        if (existing != cachedLookups.end())
-                        {
-                            dnsColText[index] = &existing->second;
-                            continue;
-                        }
-                    }
+                if (numericIp == INADDR_NONE)
+                    continue;
 
-                    sockaddr_in sa;
-                    sa.sin_family = AF_INET;
-                    sa.sin_addr.s_addr = numericIp;
-                    sa.sin_port = 0;
+                {
+                    std::lock_guard<std::mutex> guard(mut);
 
-                    char hostname[NI_MAXHOST];
-                    hostname[0] = 0;
-                    if (getnameinfo((sockaddr*)&sa, sizeof(sa), hostname, NI_MAXHOST, nullptr, 0, 0) || hostname[0] == 0) //failed, just put in IP
+                    auto existing = cachedLookups.find(numericIp);
+                    if (existing != cachedLookups.end())
                     {
-                        if (ipString.size() < NI_MAXHOST)
-                            strcpy(hostname, ipString.c_str());
+                        dnsColText[index] = &existing->second;
+                        continue;
                     }
+                }
 
-                    {
-                        std::lock_guard<std::mutex> guard(mut);
+                sockaddr_in sa;
+                sa.sin_family = AF_INET;
+                sa.sin_addr.s_addr = numericIp;
+                sa.sin_port = 0;
 
-                        auto iter = cachedLookups.emplace(numericIp, hostname);
-                        dnsColText[index] = &iter.first->second;
-                    }
+                char hostname[NI_MAXHOST];
+                hostname[0] = 0;
+                if (getnameinfo((sockaddr*)&sa, sizeof(sa), hostname, NI_MAXHOST, nullptr, 0, 0) || hostname[0] == 0) //failed, just put in IP
+                {
+                    if (ipString.size() < NI_MAXHOST)
+                        strcpy(hostname, ipString.c_str());
                 }
-            });
-        }
 
-        for (auto &t : threads)
-            t.join();
+                {
+                    std::lock_guard<std::mutex> guard(mut);
+
+                    auto iter = cachedLookups.emplace(numericIp, hostname);
+                    dnsColText[index] = &iter.first->second;
+                }
+            }
+        });
 
         //alter every logline to contain this new data
         if (!monitor.IsCancelling())
@@ -344,6 +348,7 @@ void AddDnsLookupColumnForIpColumn(int dataCol)
             columnAdded = true;
 
             //add the data
+            globalLogs.InvalidateRowIndexes();
             for (size_t row = 0; row < globalLogs.Lines.size(); ++row)
             {
                 if (dnsColText[row] && !dnsColText[row]->empty())
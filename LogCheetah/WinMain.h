@@ -18,6 +18,7 @@ bool HandleDragDropFileBusyCheck();
 
 void PromptAndParseDataFromClipboard();
 void MoveAndLoadLogs(LogCollection &&logs, bool merge);
+void ClearLogsForNewLoad();
 
 void AddDnsLookupColumnForIpColumn(int dataCol);
 
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#include "WorkStealingScheduler.h"
+#include <algorithm>
+
+namespace
+{
+    inline uint64_t PackFrontBack(uint64_t front, uint64_t back)
+    {
+        return (front << 32) | back;
+    }
+
+    inline uint64_t UnpackFront(uint64_t packed)
+    {
+        return packed >> 32;
+    }
+
+    inline uint64_t UnpackBack(uint64_t packed)
+    {
+        return packed & 0xffffffff;
+    }
+}
+
+WorkStealingScheduler::WorkStealingScheduler(size_t begin, size_t end, size_t workerCount, size_t batchSize) : rangeBegin(begin), rangeEnd(std::max(begin, end)), batchSize(std::max<size_t>(batchSize, 1)), slices(std::max<size_t>(workerCount, 1))
+{
+    //batch numbers are packed into 32 bits, so grow the batches for absurdly large ranges
+    uint64_t batchCount = (rangeEnd - rangeBegin + this->batchSize - 1) / this->batchSize;
+    while (batchCount > 0xffffffff)
+    {
+        this->batchSize *= 2;
+        batchCount = (rangeEnd - rangeBegin + this->batchSize - 1) / this->batchSize;
+    }
+
+    for (size_t i = 0; i < slices.size(); ++i)
+    {
+        uint64_t front = batchCount * i / slices.size();
+        uint64_t back = batchCount * (i + 1) / slices.size();
+        slices[i].FrontBack.store(PackFrontBack(front, back), std::memory_order_relaxed);
+    }
+}
+
+bool WorkStealingScheduler::TryTakeFront(Slice &slice, uint64_t &outBatch)
+{
+    uint64_t packed = slice.FrontBack.load(std::memory_order_relaxed);
+    while (UnpackFront(packed) < UnpackBack(packed))
+    {
+        if (slice.FrontBack.compare_exchange_weak(packed, PackFrontBack(UnpackFront(packed) + 1, UnpackBack(packed)), std::memory_order_relaxed))
+        {
+            outBatch = UnpackFront(packed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WorkStealingScheduler::TryTakeBack(Slice &slice, uint64_t &outBatch)
+{
+    uint64_t packed = slice.FrontBack.load(std::memory_order_relaxed);
+    while (UnpackFront(packed) < UnpackBack(packed))
+    {
+        if (slice.FrontBack.compare_exchange_weak(packed, PackFrontBack(UnpackFront(packed), UnpackBack(packed) - 1), std::memory_order_relaxed))
+        {
+            outBatch = UnpackBack(packed) - 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool WorkStealingScheduler::NextBatch(size_t workerIndex, size_t &outBatchBegin, size_t &outBatchEnd)
+{
+    workerIndex %= slices.size();
+
+    uint64_t batch = 0;
+    bool found = TryTakeFront(slices[workerIndex], batch);
+
+    //our own slice is empty, so steal from whoever has the most left
+    while (!found)
+    {
+        size_t victim = slices.size();
+        uint64_t victimRemaining = 0;
+        for (size_t i = 0; i < slices.size(); ++i)
+        {
+            uint64_t packed = slices[i].FrontBack.load(std::memory_order_relaxed);
+            uint64_t remaining = UnpackBack(packed) - std::min(UnpackFront(packed), UnpackBack(packed));
+            if (remaining > victimRemaining)
+            {
+                victim = i;
+                victimRemaining = remaining;
+            }
+        }
+
+        if (victim == slices.size())
+            return false;
+
+        found = TryTakeBack(slices[victim], batch);
+    }
+
+    outBatchBegin = rangeBegin + (size_t)batch * batchSize;
+    outBatchEnd = std::min(outBatchBegin + batchSize, rangeEnd);
+    return true;
+}
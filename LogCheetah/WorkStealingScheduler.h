@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+//Splits an index range into small batches for a fixed set of worker threads.  Each worker starts with its own contiguous slice of batches and takes
+//them from the front, so nearby work stays on the same thread.  Once a worker's slice runs dry it steals batches from the back of other slices,
+//so a few slow batches don't leave the other threads idle while one thread finishes its share.
+class WorkStealingScheduler
+{
+public:
+    WorkStealingScheduler(size_t begin, size_t end, size_t workerCount, size_t batchSize);
+
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    //claims the next batch for a worker.  returns false once all work has been claimed.
+    bool NextBatch(size_t workerIndex, size_t &outBatchBegin, size_t &outBatchEnd);
+
+private:
+    //front and back batch numbers of a slice, packed together so owner and thieves can both claim with a single compare-exchange
+    struct alignas(64) Slice
+    {
+        std::atomic<uint64_t> FrontBack;
+    };
+
+    bool TryTakeFront(Slice &slice, uint64_t &outBatch);
+    bool TryTakeBack(Slice &slice, uint64_t &outBatch);
+
+    size_t rangeBegin;
+    size_t rangeEnd;
+    size_t batchSize;
+    std::vector<Slice> slices;
+};
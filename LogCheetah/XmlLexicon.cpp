@@ -218,6 +218,270 @@ namespace
     }
 }
 
+namespace
+{
+    inline bool IsXmlWhitespace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    inline bool IsXmlNameTerminator(char c)
+    {
+        return IsXmlWhitespace(c) || c == '/' || c == '>';
+    }
+
+    inline size_t SkipXmlWhitespace(std::string_view source, size_t pos)
+    {
+        while (pos < source.size() && IsXmlWhitespace(source[pos]))
+            ++pos;
+        return pos;
+    }
+
+    inline size_t FindAfter(std::string_view source, std::string_view terminator, size_t start)
+    {
+        size_t found = source.find(terminator, start);
+        return found == std::string_view::npos ? source.size() : found + terminator.size();
+    }
+}
+
+XmlLexicon::PullReader::PullReader(std::string_view source) : source(source)
+{
+}
+
+bool XmlLexicon::PullReader::Next()
+{
+    //the end of a self-closing element comes right after its start
+    if (pendingSelfClose)
+    {
+        pendingSelfClose = false;
+        type = EventType::EndElement;
+        innerText = std::string_view();
+        return true;
+    }
+
+    while (pos < source.size())
+    {
+        //character data
+        if (source[pos] != '<')
+        {
+            size_t textEnd = std::min(source.find('<', pos), source.size());
+            std::string_view run = source.substr(pos, textEnd - pos);
+            pos = textEnd;
+
+            if (std::any_of(run.begin(), run.end(), [](char c) { return !IsXmlWhitespace(c); }))
+            {
+                type = EventType::Text;
+                text = run;
+                depth = contentStarts.size();
+                return true;
+            }
+
+            continue;
+        }
+
+        //things that aren't elements
+        if (source.compare(pos, 4, "<!--") == 0)
+        {
+            pos = FindAfter(source, "-->", pos + 4);
+            continue;
+        }
+        else if (source.compare(pos, 2, "<?") == 0)
+        {
+            pos = FindAfter(source, "?>", pos + 2);
+            continue;
+        }
+        else if (source.compare(pos, 9, "<![CDATA[") == 0)
+        {
+            size_t textStart = pos + 9;
+            size_t textEnd = std::min(source.find("]]>", textStart), source.size());
+            pos = FindAfter(source, "]]>", textStart);
+
+            if (textEnd > textStart)
+            {
+                type = EventType::Text;
+                text = source.substr(textStart, textEnd - textStart);
+                depth = contentStarts.size();
+                return true;
+            }
+
+            continue;
+        }
+        else if (source.compare(pos, 2, "<!") == 0)
+        {
+            pos = FindAfter(source, ">", pos + 2);
+            continue;
+        }
+
+        //elements
+        size_t nameStart = SkipXmlWhitespace(source, pos + 1);
+        if (nameStart < source.size() && source[nameStart] == '/')
+        {
+            if (ReadEndTag())
+                return true;
+        }
+        else if (ReadStartTag())
+            return true;
+
+        //the tag ran off the end of the document
+        pos = source.size();
+    }
+
+    type = EventType::EndOfDocument;
+    depth = 0;
+    return false;
+}
+
+std::string XmlLexicon::PullReader::InnerTextWithoutCData() const
+{
+    std::string content;
+    size_t cur = 0;
+    for (;;)
+    {
+        size_t sectionStart = innerText.find("<![CDATA[", cur);
+        if (sectionStart == std::string_view::npos)
+        {
+            content.append(innerText.substr(cur));
+            return content;
+        }
+
+        content.append(innerText.substr(cur, sectionStart - cur));
+
+        size_t textStart = sectionStart + 9;
+        size_t textEnd = std::min(innerText.find("]]>", textStart), innerText.size());
+        content.append(innerText.substr(textStart, textEnd - textStart));
+        cur = std::min(textEnd + 3, innerText.size());
+    }
+}
+
+bool XmlLexicon::PullReader::ReadStartTag()
+{
+    size_t cur = SkipXmlWhitespace(source, pos + 1);
+    size_t nameStart = cur;
+    while (cur < source.size() && !IsXmlNameTerminator(source[cur]))
+        ++cur;
+    if (cur >= source.size())
+        return false;
+
+    name = source.substr(nameStart, cur - nameStart);
+    attributes.clear();
+
+    bool selfClosing = false;
+    while (true)
+    {
+        cur = SkipXmlWhitespace(source, cur);
+        if (cur >= source.size())
+            return false;
+
+        if (source[cur] == '>')
+        {
+            ++cur;
+            break;
+        }
+        else if (source[cur] == '/')
+        {
+            cur = SkipXmlWhitespace(source, cur + 1);
+            if (cur < source.size() && source[cur] == '>')
+                ++cur;
+            selfClosing = true;
+            break;
+        }
+
+        //attribute name, with an optional value
+        size_t attributeNameStart = cur;
+        while (cur < source.size() && !IsXmlNameTerminator(source[cur]) && source[cur] != '=')
+            ++cur;
+        if (cur >= source.size())
+            return false;
+
+        Attribute attribute;
+        attribute.Name = source.substr(attributeNameStart, cur - attributeNameStart);
+
+        cur = SkipXmlWhitespace(source, cur);
+        if (cur < source.size() && source[cur] == '=')
+        {
+            cur = SkipXmlWhitespace(source, cur + 1);
+            if (cur >= source.size())
+                return false;
+
+            char valueTermChar = source[cur];
+            if (valueTermChar == '\"' || valueTermChar == '\'')
+            {
+                size_t valueEnd = source.find(valueTermChar, cur + 1);
+                if (valueEnd == std::string_view::npos)
+                    return false;
+
+                attribute.Value = source.substr(cur + 1, valueEnd - cur - 1);
+                cur = valueEnd + 1;
+            }
+            else
+            {
+                size_t valueStart = cur;
+                while (cur < source.size() && !IsXmlNameTerminator(source[cur]))
+                    ++cur;
+                attribute.Value = source.substr(valueStart, cur - valueStart);
+            }
+        }
+
+        attributes.push_back(attribute);
+    }
+
+    pos = cur;
+    type = EventType::StartElement;
+
+    if (selfClosing)
+    {
+        depth = contentStarts.size() + 1;
+        pendingSelfClose = true;
+    }
+    else
+    {
+        contentStarts.push_back(pos);
+        depth = contentStarts.size();
+    }
+
+    return true;
+}
+
+bool XmlLexicon::PullReader::ReadEndTag()
+{
+    size_t tagStart = pos;
+    size_t cur = SkipXmlWhitespace(source, SkipXmlWhitespace(source, pos + 1) + 1);
+    size_t nameStart = cur;
+    while (cur < source.size() && !IsXmlNameTerminator(source[cur]))
+        ++cur;
+    if (cur >= source.size())
+        return false;
+
+    name = source.substr(nameStart, cur - nameStart);
+    pos = FindAfter(source, ">", cur);
+    type = EventType::EndElement;
+
+    //a stray closing tag just closes nothing
+    depth = contentStarts.size();
+    if (!contentStarts.empty())
+    {
+        innerText = source.substr(contentStarts.back(), tagStart - contentStarts.back());
+        contentStarts.pop_back();
+    }
+    else
+        innerText = std::string_view();
+
+    return true;
+}
+
+void XmlLexicon::PullReader::SkipElement()
+{
+    if (type != EventType::StartElement)
+        return;
+
+    size_t elementDepth = depth;
+    while (Next())
+    {
+        if (type == EventType::EndElement && depth == elementDepth)
+            break;
+    }
+}
+
 XmlLexicon::XmlLexicon(std::istream &stream)
 {
 #ifdef DUMP_PERF
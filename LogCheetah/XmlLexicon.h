@@ -7,6 +7,7 @@
 #include <map>
 #include <istream>
 #include <algorithm>
+#include <string_view>
 
 class XmlLexicon
 {
@@ -34,6 +35,79 @@ public:
         Node& operator=(Node &&o) = default;
     };
 
+    //Streaming alternative to building the whole tree.  Walks a buffer one event at a time, where every string is a view into the buffer, so nothing
+    //is copied and memory use doesn't grow with the document.  The buffer must outlive the reader.  Like the tree, entities are left as-is.
+    class PullReader
+    {
+    public:
+        enum class EventType
+        {
+            StartElement, //Name and Attributes are set.  a self-closing element is followed immediately by its EndElement.
+            EndElement, //Name and InnerText are set
+            Text, //Text is set to a run of character data that isn't just whitespace
+            EndOfDocument
+        };
+
+        struct Attribute
+        {
+            std::string_view Name;
+            std::string_view Value;
+        };
+
+        PullReader(std::string_view source);
+
+        //moves to the next event.  returns false once the end of the document is reached.
+        bool Next();
+
+        //skips the rest of the element whose StartElement was just read, leaving the reader on its EndElement
+        void SkipElement();
+
+        inline EventType Type() const { return type; }
+        inline std::string_view Name() const { return name; }
+        inline std::string_view Text() const { return text; }
+        inline const std::vector<Attribute>& Attributes() const { return attributes; }
+
+        //everything between the element's start and end tags, untouched.  only set for EndElement.
+        inline std::string_view InnerText() const { return innerText; }
+
+        //InnerText with the markers around any CDATA sections taken out, leaving just their contents
+        std::string InnerTextWithoutCData() const;
+
+        //depth of the current element, where root elements are 1.  text events get the depth of the element containing them.
+        inline size_t Depth() const { return depth; }
+
+        //offset into the source, for reporting progress
+        inline size_t Position() const { return pos; }
+
+        inline const std::string_view* FindAttribute(std::string_view attributeName) const
+        {
+            for (const Attribute &a : attributes)
+            {
+                if (a.Name == attributeName)
+                    return &a.Value;
+            }
+
+            return nullptr;
+        }
+
+    private:
+        bool ReadStartTag();
+        bool ReadEndTag();
+
+        std::string_view source;
+        size_t pos = 0;
+
+        EventType type = EventType::EndOfDocument;
+        std::string_view name;
+        std::string_view text;
+        std::string_view innerText;
+        std::vector<Attribute> attributes;
+        size_t depth = 0;
+        bool pendingSelfClose = false;
+
+        std::vector<size_t> contentStarts; //where the content of each open element begins
+    };
+
     XmlLexicon(std::istream &stream);
 
     const std::vector<Node>& GetRoots() const;